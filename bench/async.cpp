@@ -0,0 +1,235 @@
+#include "bench.h"
+#include <coroutine>
+#include <ctime>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    // A device played by a shared clock thread, one period at a time in real time
+    struct ClockedDevice : SamplerSink {
+        uint32_t channels;
+        DeviceQueue queue;
+        std::vector<float> buffer;
+        std::atomic<bool> active{false};
+        // Underruns only count between the first frame queued and the end of the stream's input
+        std::atomic<bool> started{false};
+        std::atomic<bool> finished{false};
+        uint64_t underrunFrames = 0;
+
+        ClockedDevice(uint32_t channels, uint32_t sampleRate, uint64_t period, uint64_t queueFrames) :
+                channels(channels), queue(channels, sampleRate, queueFrames, sampleRate / 200), buffer(period * channels) {}
+
+        void tick() {
+            uint64_t period = buffer.size() / channels;
+            uint64_t taken = queue.render(buffer.data(), period);
+            if (started.load(std::memory_order_acquire) && !finished.load(std::memory_order_acquire)) {
+                underrunFrames += period - taken;
+            }
+        }
+
+        void start() override {
+            active = true;
+        }
+
+        void stop() override {
+            active = false;
+            queue.releaseWaiter();
+        }
+
+        bool isActive() override {
+            return active;
+        }
+
+        // Polls for room like `PortAudioSink::write`
+        void write(const float *samples, uint64_t frames) override {
+            if (frames > 0) started = true;
+            while (frames > 0 && active) {
+                uint64_t written = queue.write(samples, frames);
+                samples += written * channels;
+                frames -= written;
+                if (frames > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        uint64_t tryWrite(const float *samples, uint64_t frames) override {
+            if (frames > 0) started = true;
+            return queue.write(samples, frames);
+        }
+
+        void notifyWhenFree(uint64_t frames, AsyncWaiter &waiter, SamplerExecutor &executor) override {
+            queue.notifyWhenFree(frames, waiter, executor);
+        }
+
+        void discard() override {
+            queue.discard();
+        }
+
+        void pause() override {
+            queue.pause();
+        }
+
+        void resume() override {
+            queue.resume();
+        }
+
+        double latency() override {
+            return 0;
+        }
+
+        uint64_t position() override {
+            return queue.position();
+        }
+
+        bool schedule(std::unique_ptr<TimelineEvent> event) override {
+            return queue.schedule(std::move(event));
+        }
+    };
+
+    // Fire-and-forget coroutine, started eagerly
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception() {
+                std::terminate();
+            }
+        };
+    };
+
+    Detached feed(Sampler &sampler, ClockedDevice &device, SamplerExecutor &executor, const std::vector<float> &track,
+                  uint32_t channels, uint64_t chunkFrames, std::atomic<int> &remaining) {
+        auto *data = reinterpret_cast<const uint8_t *>(track.data());
+        uint64_t frames = track.size() / channels;
+        for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+            uint64_t count = std::min(chunkFrames, frames - offset);
+            co_await sampler.playAsync(executor, data + offset * channels * sizeof(float), count * channels * sizeof(float));
+        }
+        device.finished = true;
+        co_await sampler.drained(executor);
+
+        remaining.fetch_sub(1);
+        remaining.notify_all();
+    }
+
+    struct AsyncResult {
+        size_t threads = 0;
+        double underrunMs = 0;
+        double elapsedSeconds = 0;
+        double cpuSeconds = 0;
+    };
+
+    AsyncResult run(bool coroutines, size_t streams, size_t executorThreads, const std::vector<float> &track,
+                    uint32_t sampleRate, uint32_t channels, uint64_t chunkFrames, uint64_t period, uint64_t queueFrames) {
+        std::vector<ClockedDevice *> devices;
+        std::vector<std::unique_ptr<Sampler>> samplers;
+        for (size_t s = 0; s < streams; ++s) {
+            auto *device = new ClockedDevice(channels, sampleRate, period, queueFrames);
+            devices.push_back(device);
+            samplers.push_back(std::make_unique<Sampler>(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(device)));
+            samplers.back()->start();
+        }
+
+        std::atomic<bool> clockRunning{true};
+        std::thread clock([&] {
+            auto next = std::chrono::steady_clock::now();
+            auto interval = std::chrono::nanoseconds(period * 1'000'000'000 / sampleRate);
+            while (clockRunning) {
+                for (auto *device: devices) device->tick();
+                next += interval;
+                std::this_thread::sleep_until(next);
+            }
+        });
+
+        AsyncResult result;
+        std::clock_t cpuStart = std::clock();
+        uint64_t start = nowNanos();
+        if (coroutines) {
+            SamplerExecutor executor;
+            std::atomic<int> remaining{static_cast<int>(streams)};
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < executorThreads; ++t) threads.emplace_back([&] { executor.run(); });
+            for (size_t s = 0; s < streams; ++s) feed(*samplers[s], *devices[s], executor, track, channels, chunkFrames, remaining);
+            for (int left = remaining.load(); left > 0; left = remaining.load()) remaining.wait(left);
+            executor.stop();
+            for (auto &thread: threads) thread.join();
+            result.threads = executorThreads;
+        } else {
+            // The usual approach: one thread per sampler, blocked in `play` while its device has no room
+            std::vector<std::thread> threads;
+            for (size_t s = 0; s < streams; ++s) {
+                threads.emplace_back([&, s] {
+                    auto *data = reinterpret_cast<const uint8_t *>(track.data());
+                    uint64_t frames = track.size() / channels;
+                    for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+                        uint64_t count = std::min(chunkFrames, frames - offset);
+                        samplers[s]->play(data + offset * channels * sizeof(float), count * channels * sizeof(float));
+                    }
+                    devices[s]->finished = true;
+                    while (devices[s]->queue.size() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                });
+            }
+            for (auto &thread: threads) thread.join();
+            result.threads = streams;
+        }
+        result.elapsedSeconds = static_cast<double>(nowNanos() - start) / 1e9;
+        result.cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+        clockRunning = false;
+        clock.join();
+
+        uint64_t underruns = 0;
+        for (auto *device: devices) underruns += device->underrunFrames;
+        result.underrunMs = static_cast<double>(underruns) * 1000 / sampleRate;
+
+        for (auto &sampler: samplers) sampler->stop();
+        return result;
+    }
+}
+
+int runAsync(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto period = static_cast<uint64_t>(options.getDouble("period", 256));
+    auto queueFrames = static_cast<uint64_t>(options.getDouble("queue-ms", 100) * sampleRate / 1000);
+    auto streams = static_cast<size_t>(options.getDouble("streams", 16));
+    auto threads = static_cast<size_t>(options.getDouble("threads", 1));
+    auto seconds = options.getDouble("seconds", 2);
+
+    auto track = signals::music(sampleRate, channels, static_cast<uint64_t>(seconds * sampleRate));
+
+    std::cout << std::left << std::setw(12) << "approach" << std::setw(10) << "streams" << std::setw(10) << "threads"
+              << std::setw(16) << "underrun ms" << std::setw(12) << "elapsed s" << "cpu s\n";
+
+    bool passed = true;
+    for (bool coroutines: {false, true}) {
+        auto result = run(coroutines, streams, threads, track, sampleRate, channels, chunkFrames, period, queueFrames);
+        std::cout << std::setw(12) << (coroutines ? "coroutines" : "blocking") << std::setw(10) << streams << std::setw(10)
+                  << result.threads << std::fixed << std::setprecision(2) << std::setw(16) << result.underrunMs
+                  << std::setw(12) << result.elapsedSeconds << result.cpuSeconds << std::defaultfloat << "\n";
+
+        // Fed in real time: no stream may run dry for more than a period in total
+        if (coroutines && result.underrunMs > static_cast<double>(period) * 1000 / sampleRate) {
+            std::cout << "FAIL  coroutine feeding of " << streams << " streams on " << threads << " threads\n";
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include "bench.h"
+#include <iomanip>
+#include <iostream>
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    struct BatchResult {
+        double nanosPerFrame = 0;
+        uint64_t outputFrames = 0;
+    };
+
+    // Plays `signal` in packets of `packetFrames`, `batch` packets per call (0 for one `play` call per packet)
+    BatchResult measure(const std::vector<float> &signal, uint32_t sampleRate, uint32_t channels, double speed,
+                        uint64_t packetFrames, size_t batch) {
+        auto *sink = new NullSink();
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        // Packets as a decoder hands them over, each in its own buffer
+        uint64_t frames = signal.size() / channels;
+        std::vector<std::vector<float>> packets;
+        for (uint64_t offset = 0; offset < frames; offset += packetFrames) {
+            auto from = signal.begin() + static_cast<std::ptrdiff_t>(offset * channels);
+            packets.emplace_back(from, from + static_cast<std::ptrdiff_t>(std::min(packetFrames, frames - offset) * channels));
+        }
+
+        std::vector<SamplerChunk> chunks;
+        uint64_t start = nowNanos();
+        for (size_t p = 0; p < packets.size(); ++p) {
+            auto *data = reinterpret_cast<const uint8_t *>(packets[p].data());
+            uint64_t size = packets[p].size() * sizeof(float);
+            if (batch == 0) {
+                sampler.play(data, size);
+                continue;
+            }
+            chunks.push_back(SamplerChunk{data, size});
+            if (chunks.size() == batch || p + 1 == packets.size()) {
+                sampler.playBatch(chunks.data(), chunks.size());
+                chunks.clear();
+            }
+        }
+
+        BatchResult result;
+        result.nanosPerFrame = static_cast<double>(nowNanos() - start) / static_cast<double>(frames);
+        result.outputFrames = sink->framesWritten();
+        sampler.stop();
+        return result;
+    }
+}
+
+int runBatch(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto speed = options.getDouble("speed", 1);
+    auto packetSizes = options.getDoubles("packets", "64,256,1024,4096");
+    auto batch = static_cast<size_t>(options.getDouble("batch", 16));
+    int repeats = static_cast<int>(options.getDouble("repeats", 5));
+
+    auto names = options.getList("signals", "silence,speech");
+    auto frames = static_cast<uint64_t>(options.getDouble("seconds", 4) * sampleRate);
+
+    std::cout << std::left << std::setw(10) << "signal" << std::setw(14) << "packet frames" << std::setw(18) << "play ns/frame"
+              << std::setw(18) << "batch ns/frame" << std::setw(12) << "saving" << "output frames play/batch\n";
+
+    bool passed = true;
+    for (const auto &name: names) for (double packet: packetSizes) {
+        // The stretcher skips silent input, which leaves the per-call overhead
+        auto signal = name == "silence" ? signals::silence(sampleRate, channels, frames) : signals::speech(sampleRate, channels, frames);
+        auto packetFrames = static_cast<uint64_t>(packet);
+        std::vector<double> single, batched;
+        BatchResult singleResult, batchResult;
+        for (int r = 0; r < repeats; ++r) {
+            singleResult = measure(signal, sampleRate, channels, speed, packetFrames, 0);
+            batchResult = measure(signal, sampleRate, channels, speed, packetFrames, batch);
+            single.push_back(singleResult.nanosPerFrame);
+            batched.push_back(batchResult.nanosPerFrame);
+        }
+        double singleNanos = percentile(single, 0.5), batchNanos = percentile(batched, 0.5);
+
+        std::cout << std::setw(10) << name << std::setw(14) << packetFrames << std::fixed << std::setprecision(1) << std::setw(18) << singleNanos
+                  << std::setw(18) << batchNanos << std::setw(12) << (1 - batchNanos / singleNanos) * 100 << std::defaultfloat
+                  << singleResult.outputFrames << "/" << batchResult.outputFrames << "\n";
+
+        // The batch is one stretch call over the same input: the output length may only differ by per-call rounding
+        auto calls = static_cast<double>(signal.size() / channels / packetFrames + 1);
+        if (std::abs(static_cast<double>(singleResult.outputFrames) - static_cast<double>(batchResult.outputFrames)) > calls) {
+            std::cout << "FAIL  output length of batches of " << packetFrames << "-frame packets\n";
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,365 @@
+#include "bench.h"
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "exception.h"
+
+namespace {
+    std::atomic<uint64_t> allocations{0};
+}
+
+// The replacement operators below pair malloc with free, which GCC misreads once they are inlined into each other
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    if (void *pointer = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+uint64_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+Options::Options(int argc, char **argv, int first) {
+    for (int i = first; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            throw SamplerException("Unexpected argument: " + arg);
+        }
+        std::string key = arg.substr(2);
+        bool hasValue = i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0;
+        values.insert_or_assign(key, std::string(hasValue ? argv[++i] : "1"));
+    }
+}
+
+bool Options::has(const std::string &key) const {
+    return values.count(key) > 0;
+}
+
+std::string Options::get(const std::string &key, const std::string &fallback) const {
+    auto found = values.find(key);
+    return found == values.end() ? fallback : found->second;
+}
+
+double Options::getDouble(const std::string &key, double fallback) const {
+    return has(key) ? std::stod(get(key, "")) : fallback;
+}
+
+std::vector<std::string> Options::getList(const std::string &key, const std::string &fallback) const {
+    std::vector<std::string> list;
+    std::stringstream stream(get(key, fallback));
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) list.push_back(item);
+    }
+    return list;
+}
+
+std::vector<double> Options::getDoubles(const std::string &key, const std::string &fallback) const {
+    std::vector<double> list;
+    for (const auto &item: getList(key, fallback)) {
+        list.push_back(std::stod(item));
+    }
+    return list;
+}
+
+void JsonWriter::separator(const std::string &key) {
+    if (!first.empty()) {
+        if (!first.back()) output << ',';
+        first.back() = false;
+    }
+    if (!key.empty()) output << '"' << key << "\":";
+}
+
+JsonWriter &JsonWriter::beginObject(const std::string &key) {
+    separator(key);
+    output << '{';
+    first.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+    output << '}';
+    first.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray(const std::string &key) {
+    separator(key);
+    output << '[';
+    first.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+    output << ']';
+    first.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const std::string &key, double number) {
+    separator(key);
+    output << number;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const std::string &key, const std::string &text) {
+    separator(key);
+    output << '"' << text << '"';
+    return *this;
+}
+
+namespace {
+    struct JsonParser {
+        const std::string &document;
+        size_t position = 0;
+
+        void skipWhitespace() {
+            while (position < document.size() && std::isspace(static_cast<unsigned char>(document[position]))) ++position;
+        }
+
+        char peek() {
+            skipWhitespace();
+            if (position >= document.size()) throw SamplerException("Unexpected end of JSON");
+            return document[position];
+        }
+
+        void expect(char character) {
+            if (peek() != character) throw SamplerException(std::string("Expected '") + character + "' in JSON");
+            ++position;
+        }
+
+        std::string parseString() {
+            expect('"');
+            std::string text;
+            while (position < document.size() && document[position] != '"') {
+                if (document[position] == '\\' && position + 1 < document.size()) ++position;
+                text += document[position++];
+            }
+            expect('"');
+            return text;
+        }
+
+        JsonValue parseValue() {
+            JsonValue value;
+            char next = peek();
+            if (next == '{') {
+                value.type = JsonValue::Type::object;
+                expect('{');
+                if (peek() != '}') {
+                    do {
+                        std::string key = parseString();
+                        expect(':');
+                        value.object[key] = parseValue();
+                    } while (peek() == ',' && ++position);
+                }
+                expect('}');
+            } else if (next == '[') {
+                value.type = JsonValue::Type::array;
+                expect('[');
+                if (peek() != ']') {
+                    do {
+                        value.array.push_back(parseValue());
+                    } while (peek() == ',' && ++position);
+                }
+                expect(']');
+            } else if (next == '"') {
+                value.type = JsonValue::Type::string;
+                value.text = parseString();
+            } else if (document.compare(position, 4, "null") == 0) {
+                position += 4;
+            } else {
+                size_t length = 0;
+                value.type = JsonValue::Type::number;
+                value.number = std::stod(document.substr(position), &length);
+                position += length;
+            }
+            return value;
+        }
+    };
+}
+
+JsonValue JsonValue::parse(const std::string &document) {
+    JsonParser parser{document};
+    return parser.parseValue();
+}
+
+const JsonValue *JsonValue::find(const std::string &key) const {
+    auto found = object.find(key);
+    return found == object.end() ? nullptr : &found->second;
+}
+
+static void usage() {
+    std::cerr << "Usage: klarity_bench [playback] [options]\n"
+                 "\n"
+                 "playback: drives Sampler::play through a headless sink\n"
+                 "  --signals speech,music,silence,transients   test material (or --input file.raw)\n"
+                 "  --input PATH --input-channels N              raw interleaved float32 recording\n"
+                 "  --speeds 0.5,1,1.5,2,3                       playback speed factors\n"
+                 "  --channels 1,2,8                             channel counts\n"
+                 "  --chunks 64,1024,65536                       frames per play() call\n"
+                 "  --presets standard,cheaper                   stretch presets\n"
+                 "  --memory heap,arena                          stretcher allocation modes (default heap)\n"
+                 "  --rate 48000 --seconds 4                     sample rate and input length\n"
+                 "  --json PATH                                  write results as JSON ('-' for stdout)\n"
+                 "\n"
+                 "check: performance regression and golden-output test against a stored baseline\n"
+                 "  --baseline bench/baseline.json               baseline file to compare with (or write)\n"
+                 "  --update                                     record the current results as the new baseline\n"
+                 "  --repeats 9                                  measurements per benchmark (median and 95% CI)\n"
+                 "  --threshold 0.15                             allowed slowdown before failing\n"
+                 "  --golden-tolerance 0.001                     allowed relative deviation of golden output\n"
+                 "\n"
+                 "rt-audit: self-test of the real-time safety audit (needs KLARITY_SAMPLER_RT_AUDIT=ON)\n"
+                 "  --channels 2 --chunk 1024 --speeds 0.5,1,2    steady-state playback checked for violations\n"
+                 "\n"
+                 "denormals: cost of a decaying tail with and without flush-to-zero, and NaN/Inf containment\n"
+                 "  --rate 48000 --seconds 4 --chunk 1024\n"
+                 "\n"
+                 "memory: per-component footprint with full and compact state, and compact-mode quality\n"
+                 "  --channels 1,2,8 --chunk 1024 --rate 48000    configurations to report\n"
+                 "  --margin 3                                    allowed dB below the bf16-input reference\n"
+                 "\n"
+                 "gapless: track transitions spliced with queueNext/finishTrack against stopping and restarting the device\n"
+                 "  --channels 2 --chunk 1024 --speeds 0.5,1,2     --rate 48000 --seconds 2 (length of each track)\n"
+                 "\n"
+                 "seek: seek-to-audio latency of Sampler::seek against stopping and restarting the device\n"
+                 "  --channels 2 --chunk 1024 --speeds 0.5,1,2     --rate 48000\n"
+                 "  --queue-ms 100                                audio queued in the device when seeking\n"
+                 "\n"
+                 "pause: pause/resume through a simulated device queue against stopping and restarting the device\n"
+                 "  --channels 2 --chunk 1024 --speeds 0.5,1,2     --rate 48000\n"
+                 "  --period 256 --queue-ms 100                    device period and queued audio\n"
+                 "\n"
+                 "loop: A-B loop with Sampler::startLoop/playLoop against re-sending the segment for every pass\n"
+                 "  --signals speech,music --speeds 0.75,1         --channels 2 --chunk 1024 --rate 48000\n"
+                 "  --passes 6 --crossfade-ms 20                   passes per run and loop-point crossfade\n"
+                 "\n"
+                 "cache: replaying a range after seeking back to it, with and without the render cache\n"
+                 "  --speeds 0.75,1,1.5 --channels 2 --chunk 1024  --rate 48000\n"
+                 "  --rewind 10 --replays 5 --cache-mb 64          seconds replayed, replays per run and cache limit\n"
+                 "\n"
+                 "schedule: events placed on the stream timeline with scheduleAtFrame/scheduleAtTime against writing them with play()\n"
+                 "  --speeds 0.75,1,1.5 --channels 2 --chunk 1024  --rate 48000 --events 8\n"
+                 "  --period 256 --queue-ms 100 --lead-ms 50       device period, queued audio and scheduling lead\n"
+                 "\n"
+                 "batch: cost per frame of one play() call per decoded packet against playBatch over several packets\n"
+                 "  --packets 64,256,1024,4096 --batch 16          packet sizes and packets per batch\n"
+                 "  --speed 1 --channels 2 --rate 48000 --seconds 4 --repeats 5\n"
+                 "\n"
+                 "async: many samplers fed by coroutines on a few executor threads against one blocked thread per sampler\n"
+                 "  --streams 16 --threads 1 --seconds 2           samplers, executor threads and length of each stream\n"
+                 "  --period 256 --queue-ms 100 --chunk 1024       simulated device period and queue, frames per play\n"
+                 "\n"
+                 "file: mapped WAV playback against reading the file into memory and calling play\n"
+                 "  --seconds 60 --speed 1 --repeats 3              length of the file and playback speed\n"
+                 "  --dir <temp directory>                         where the file is written\n"
+                 "\n"
+                 "pool: track start to first audio with a new sampler per track against one from a SamplerPool\n"
+                 "  --tracks 20 --chunk 1024 --channels 2 --rate 48000\n"
+                 "\n"
+                 "pitch: cost of transposed playback (spectral peak mapping on every hop) against unity pitch\n"
+                 "  --semitones 0,3,-5,12 --signals speech,music   --channels 2 --chunk 1024 --rate 48000\n"
+                 "  --seconds 10 --repeats 3 --tonality-hz 0       tonality limit passed to setPitchSemitones\n"
+                 "\n"
+                 "match: TrackMatcher gliding a follower track onto the leader's tempo and key, and what the analysis costs\n"
+                 "  --leader-bpm 120 --follower-bpm 128            tempos of the two generated tracks\n"
+                 "  --follower-semitones 2 --seconds 30 --repeats 3 --channels 2 --chunk 1024 --rate 48000\n"
+                 "\n"
+                 "transients: onset rise time and log-spectral distance against CPU, presets with and without the transient reset\n"
+                 "  --speeds 2,3 --signals speech,transients       --seconds 10 --repeats 3 --chunk 1024 --rate 48000\n"
+                 "\n"
+                 "clips: clips/s of a ClipRenderer batch against a stretcher per clip, by worker thread count\n"
+                 "  --clips 500 --min-seconds 0.02 --max-seconds 0.25 --threads 1,<hardware threads>\n"
+                 "  --repeats 3 --channels 2 --rate 48000\n";
+}
+
+int main(int argc, char **argv) {
+    std::string mode = argc > 1 && std::string(argv[1]).rfind("--", 0) != 0 ? argv[1] : "playback";
+    int first = mode == "playback" && (argc < 2 || std::string(argv[1]) != "playback") ? 1 : 2;
+
+    try {
+        Options options(argc, argv, first);
+        if (options.has("help")) {
+            usage();
+            return 0;
+        }
+        if (mode == "playback") return runPlayback(options);
+        if (mode == "check") return runRegression(options);
+        if (mode == "rt-audit") return runRealtimeAudit(options);
+        if (mode == "denormals") return runDenormals(options);
+        if (mode == "memory") return runMemory(options);
+        if (mode == "gapless") return runGapless(options);
+        if (mode == "seek") return runSeek(options);
+        if (mode == "pause") return runPause(options);
+        if (mode == "loop") return runLoop(options);
+        if (mode == "cache") return runCache(options);
+        if (mode == "schedule") return runSchedule(options);
+        if (mode == "batch") return runBatch(options);
+        if (mode == "async") return runAsync(options);
+        if (mode == "file") return runFile(options);
+        if (mode == "pool") return runPool(options);
+        if (mode == "pitch") return runPitch(options);
+        if (mode == "match") return runMatch(options);
+        if (mode == "transients") return runTransients(options);
+        if (mode == "clips") return runClips(options);
+    } catch (const std::exception &e) {
+        std::cerr << "klarity_bench: " << e.what() << std::endl;
+        return 2;
+    }
+
+    usage();
+    return 2;
+}
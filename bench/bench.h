@@ -0,0 +1,126 @@
+#ifndef KLARITY_BENCH_H
+#define KLARITY_BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Command line as `--key value` pairs (a bare `--flag` maps to "1")
+struct Options {
+    std::map<std::string, std::string> values;
+
+    Options(int argc, char **argv, int first);
+
+    bool has(const std::string &key) const;
+
+    std::string get(const std::string &key, const std::string &fallback) const;
+
+    double getDouble(const std::string &key, double fallback) const;
+
+    std::vector<std::string> getList(const std::string &key, const std::string &fallback) const;
+
+    std::vector<double> getDoubles(const std::string &key, const std::string &fallback) const;
+};
+
+// Number of heap allocations made by the whole process so far (counted by the benchmark's operator new)
+uint64_t allocationCount();
+
+inline uint64_t nowNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+    ).count());
+}
+
+// Nearest-rank percentile of an unsorted sample set
+template<typename T>
+T percentile(std::vector<T> values, double quantile) {
+    if (values.empty()) return T();
+    auto index = static_cast<size_t>(quantile * static_cast<double>(values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+    return values[index];
+}
+
+// Minimal streaming JSON writer, inserting commas between siblings
+struct JsonWriter {
+    std::ostream &output;
+    std::vector<bool> first;
+
+    explicit JsonWriter(std::ostream &output) : output(output) {}
+
+    JsonWriter &beginObject(const std::string &key = "");
+
+    JsonWriter &endObject();
+
+    JsonWriter &beginArray(const std::string &key = "");
+
+    JsonWriter &endArray();
+
+    JsonWriter &value(const std::string &key, double number);
+
+    JsonWriter &value(const std::string &key, const std::string &text);
+
+private:
+    void separator(const std::string &key);
+};
+
+// Parsed JSON document (enough of the grammar for the benchmark's own files)
+struct JsonValue {
+    enum class Type {
+        null, number, string, array, object
+    };
+
+    Type type = Type::null;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    static JsonValue parse(const std::string &document);
+
+    const JsonValue *find(const std::string &key) const;
+};
+
+int runPlayback(const Options &options);
+
+int runRegression(const Options &options);
+
+int runRealtimeAudit(const Options &options);
+
+int runDenormals(const Options &options);
+
+int runMemory(const Options &options);
+
+int runGapless(const Options &options);
+
+int runSeek(const Options &options);
+
+int runPause(const Options &options);
+
+int runLoop(const Options &options);
+
+int runCache(const Options &options);
+
+int runSchedule(const Options &options);
+
+int runBatch(const Options &options);
+
+int runAsync(const Options &options);
+
+int runFile(const Options &options);
+
+int runPool(const Options &options);
+
+int runPitch(const Options &options);
+
+int runMatch(const Options &options);
+
+int runTransients(const Options &options);
+
+int runClips(const Options &options);
+
+#endif //KLARITY_BENCH_H
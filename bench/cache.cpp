@@ -0,0 +1,134 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    struct ReplayResult {
+        // Output of each replay of the range, and of the playback continuing past it after the last one
+        std::vector<std::vector<float>> replays;
+        std::vector<float> continuation;
+        std::vector<double> replayMicros;
+        RenderCacheStats stats;
+        size_t cacheBytes = 0;
+        uint64_t callsPerReplay = 0;
+    };
+
+    // Plays up to `to`, then seeks back to `from` and plays up to `to` again `replays` times, as a "rewind" button does
+    ReplayResult render(const std::vector<float> &piece, uint32_t sampleRate, uint32_t channels, double speed,
+                        uint64_t chunkFrames, uint64_t from, uint64_t to, int replays, size_t cacheLimit) {
+        auto *sink = new CaptureSink(channels);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.setCacheLimit(cacheLimit);
+        sampler.start();
+
+        uint64_t head = std::max(sampler.getPreRollFrames(), chunkFrames);
+        uint64_t history = std::min(sampler.getSeekHistoryFrames(), from);
+        auto *data = reinterpret_cast<const uint8_t *>(piece.data());
+        uint64_t frameBytes = channels * sizeof(float);
+
+        ReplayResult result;
+        result.callsPerReplay = (to - from - head + chunkFrames - 1) / chunkFrames;
+        playRange(sampler, piece, channels, 0, chunkFrames, to);
+
+        for (int replay = 0; replay < replays; ++replay) {
+            uint64_t mark = sink->samples.size();
+            uint64_t start = nowNanos();
+            sampler.seek(data + (from - history) * frameBytes, history * frameBytes, data + from * frameBytes, head * frameBytes);
+            playRange(sampler, piece, channels, from + head, chunkFrames, to);
+            result.replayMicros.push_back(static_cast<double>(nowNanos() - start) / 1e3);
+            result.replays.emplace_back(sink->samples.begin() + static_cast<std::ptrdiff_t>(mark), sink->samples.end());
+        }
+
+        uint64_t mark = sink->samples.size();
+        playRange(sampler, piece, channels, to, chunkFrames);
+        result.continuation.assign(sink->samples.begin() + static_cast<std::ptrdiff_t>(mark), sink->samples.end());
+
+        result.stats = sampler.getCacheStats();
+        result.cacheBytes = sampler.getMemoryUsage().cache;
+        sampler.stop();
+        return result;
+    }
+
+    double maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+        if (a.size() != b.size()) return INFINITY;
+        double worst = 0;
+        for (size_t i = 0; i < a.size(); ++i) worst = std::max(worst, static_cast<double>(std::abs(a[i] - b[i])));
+        return worst;
+    }
+
+    // Milliseconds of 5 ms blocks in the first 250 ms more than 20 dB below the reference (dropouts after the rebuild)
+    double dropoutMs(const std::vector<float> &output, const std::vector<float> &reference, uint32_t sampleRate, uint32_t channels) {
+        uint64_t block = sampleRate / 200;
+        uint64_t dropped = 0;
+        for (uint64_t start = 0; start < sampleRate / 4; start += block) {
+            double expected = blockRms(reference, start, block, channels);
+            if (expected < 1e-3) continue;
+            if (blockRms(output, start, block, channels) < 0.1 * expected) dropped += block;
+        }
+        return static_cast<double>(dropped) * 1000.0 / sampleRate;
+    }
+}
+
+int runCache(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto speeds = options.getDoubles("speeds", "0.75,1,1.5");
+    auto rewind = options.getDouble("rewind", 10);
+    int replays = static_cast<int>(options.getDouble("replays", 5));
+    auto cacheLimit = static_cast<size_t>(options.getDouble("cache-mb", 64) * 1024 * 1024);
+
+    // Two seconds of lead-in before the replayed range and two of new material after it
+    auto from = static_cast<uint64_t>(sampleRate) * 2;
+    auto to = from + static_cast<uint64_t>(rewind * sampleRate);
+    auto piece = signals::speech(sampleRate, channels, to + sampleRate * 2);
+
+    std::cout << std::left << std::setw(8) << "speed" << std::setw(10) << "cache" << std::setw(16) << "ms per replay"
+              << std::setw(10) << "hit rate" << std::setw(14) << "cache MiB" << std::setw(16) << "replay diff"
+              << "dropout ms\n";
+
+    bool passed = true;
+    for (double speed: speeds) {
+        auto uncached = render(piece, sampleRate, channels, speed, chunkFrames, from, to, replays, 0);
+        auto cached = render(piece, sampleRate, channels, speed, chunkFrames, from, to, replays, cacheLimit);
+
+        // The first replay renders and stores the range, the later ones are served from the cache
+        double uncachedMs = 0, cachedMs = 0, difference = 0;
+        for (int replay = 1; replay < replays; ++replay) {
+            uncachedMs += uncached.replayMicros[replay] / 1e3 / (replays - 1);
+            cachedMs += cached.replayMicros[replay] / 1e3 / (replays - 1);
+            difference = std::max(difference, maxDifference(cached.replays[replay], uncached.replays[replay]));
+        }
+        double dropout = dropoutMs(cached.continuation, uncached.continuation, sampleRate, channels);
+        uint64_t lookups = cached.stats.hits + cached.stats.misses;
+        double hitRate = lookups > 0 ? static_cast<double>(cached.stats.hits) / static_cast<double>(lookups) : 0;
+
+        for (auto *result: {&uncached, &cached}) {
+            bool caching = result == &cached;
+            std::cout << std::setw(8) << speed << std::setw(10) << (caching ? "on" : "off") << std::fixed << std::setprecision(2)
+                      << std::setw(16) << (caching ? cachedMs : uncachedMs) << std::setw(10) << (caching ? hitRate : 0.0)
+                      << std::setw(14) << static_cast<double>(result->cacheBytes) / (1024 * 1024) << std::defaultfloat;
+            if (caching) {
+                std::cout << std::setw(16) << difference << dropout << "\n";
+            } else {
+                std::cout << std::setw(16) << "-" << "-\n";
+            }
+        }
+
+        // Every call of the later replays hits, and a hit is exactly what the stretcher would have rendered (it only
+        // randomises phases below 0.5x); the stretcher rebuilt after the hits keeps playing without dropouts
+        bool allHit = cached.stats.hits == cached.callsPerReplay * (replays - 1);
+        bool exact = speed < 0.5 || difference == 0;
+        if (!allHit || !exact || dropout > 0 || cachedMs * 2 > uncachedMs || cached.stats.bytes > cacheLimit) {
+            std::cout << "FAIL  cached replay at speed " << speed << "\n";
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
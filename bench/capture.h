@@ -0,0 +1,176 @@
+#ifndef KLARITY_BENCH_CAPTURE_H
+#define KLARITY_BENCH_CAPTURE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "sampler.h"
+#include "sink.h"
+
+/*
+ * Keeps everything that would be heard, and counts device starts. The device is modelled as holding the last
+ * `queueFrames` frames written: `stop` lets them play out, `discard` drops them. Scheduled events are mixed in at
+ * their frame, as if the device had played every frame written so far, and stream time counts from the first frame.
+ */
+struct CaptureSink : SamplerSink {
+    uint32_t channels;
+    uint64_t queueFrames;
+    bool active = false;
+    uint64_t starts = 0;
+    uint64_t written = 0;
+    uint32_t sampleRate;
+    std::vector<float> samples;
+
+    explicit CaptureSink(uint32_t channels, uint64_t queueFrames = 0, uint32_t sampleRate = 48000) :
+            channels(channels), queueFrames(queueFrames), sampleRate(sampleRate) {}
+
+    void start() override {
+        active = true;
+        ++starts;
+    }
+
+    void stop() override {
+        active = false;
+    }
+
+    bool isActive() override {
+        return active;
+    }
+
+    void write(const float *data, uint64_t frames) override {
+        mix(written, data, frames);
+        written += frames;
+    }
+
+    void discard() override {
+        written -= std::min(written, queueFrames);
+        samples.resize(written * channels);
+    }
+
+    void pause() override {
+    }
+
+    void resume() override {
+    }
+
+    double latency() override {
+        return 0;
+    }
+
+    uint64_t position() override {
+        return written;
+    }
+
+    bool schedule(std::unique_ptr<TimelineEvent> event) override {
+        mix(event->timed ? static_cast<uint64_t>(std::llround(event->time * sampleRate)) : event->frame, event->samples.data(),
+            event->samples.size() / channels);
+        return true;
+    }
+
+    void mix(uint64_t frame, const float *data, uint64_t frames) {
+        if (samples.size() < (frame + frames) * channels) samples.resize((frame + frames) * channels);
+        for (uint64_t i = 0; i < frames * channels; ++i) samples[frame * channels + i] += data[i];
+    }
+
+    uint64_t frames() const {
+        return samples.size() / channels;
+    }
+};
+
+// The device side of `DeviceQueue`, rendered one period at a time whenever the producer has to wait for space
+struct SimulatedDevice : SamplerSink {
+    uint32_t channels;
+    uint32_t sampleRate;
+    uint64_t period;
+    DeviceQueue queue;
+    bool active = false;
+    uint64_t starts = 0;
+    std::vector<float> buffer;
+    // Everything the device played, and only the frames it took from the queue
+    std::vector<float> output, content;
+
+    SimulatedDevice(uint32_t channels, uint32_t sampleRate, uint64_t period, uint64_t queueFrames, uint64_t fadeFrames) :
+            channels(channels), sampleRate(sampleRate), period(period), queue(channels, sampleRate, queueFrames, fadeFrames),
+            buffer(period * channels) {}
+
+    void tick() {
+        // Stream time is the device position, with no delay to the DAC
+        uint64_t taken = queue.render(buffer.data(), period, static_cast<double>(queue.position()) / sampleRate);
+        output.insert(output.end(), buffer.begin(), buffer.end());
+        content.insert(content.end(), buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(taken * channels));
+    }
+
+    void start() override {
+        active = true;
+        ++starts;
+    }
+
+    // Plays out the queue, as `PortAudioSink::stop` does
+    void stop() override {
+        if (queue.isPaused()) {
+            queue.discard();
+            queue.resume();
+        }
+        while (queue.size() > 0) tick();
+        active = false;
+    }
+
+    bool isActive() override {
+        return active;
+    }
+
+    void write(const float *samples, uint64_t frames) override {
+        while (frames > 0) {
+            uint64_t written = queue.write(samples, frames);
+            samples += written * channels;
+            frames -= written;
+            if (frames > 0) tick();
+        }
+    }
+
+    void discard() override {
+        queue.discard();
+    }
+
+    void pause() override {
+        queue.pause();
+    }
+
+    void resume() override {
+        queue.resume();
+    }
+
+    double latency() override {
+        return 0;
+    }
+
+    uint64_t position() override {
+        return queue.position();
+    }
+
+    bool schedule(std::unique_ptr<TimelineEvent> event) override {
+        return queue.schedule(std::move(event));
+    }
+};
+
+// RMS over `frames` frames from `from`, counting frames past the end as silence
+inline double blockRms(const std::vector<float> &samples, uint64_t from, uint64_t frames, uint32_t channels) {
+    double sum = 0;
+    uint64_t end = std::min<uint64_t>(samples.size(), (from + frames) * channels);
+    for (uint64_t i = from * channels; i < end; ++i) sum += samples[i] * samples[i];
+    return std::sqrt(sum / static_cast<double>(frames * channels));
+}
+
+// Plays interleaved frames from `from` up to `to` (or the end of `track`), `chunkFrames` per call
+inline void playRange(Sampler &sampler, const std::vector<float> &track, uint32_t channels, uint64_t from, uint64_t chunkFrames,
+                      uint64_t to = UINT64_MAX) {
+    uint64_t frames = std::min<uint64_t>(to, track.size() / channels);
+    auto *data = reinterpret_cast<const uint8_t *>(track.data());
+    for (uint64_t offset = from; offset < frames; offset += chunkFrames) {
+        uint64_t count = std::min(chunkFrames, frames - offset);
+        sampler.play(data + offset * channels * sizeof(float), count * channels * sizeof(float));
+    }
+}
+
+#endif //KLARITY_BENCH_CAPTURE_H
@@ -0,0 +1,151 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "clips.h"
+#include "signals.h"
+
+namespace {
+    // What each clip costs without a renderer: a stretcher constructed and configured for it, as `Sampler::renderEvent` renders it
+    std::vector<float> renderFresh(const ClipRequest &clip, uint32_t sampleRate, uint32_t channels) {
+        signalsmith::stretch::SignalsmithStretch<float> stretch;
+        stretch.presetDefault(static_cast<int>(channels), static_cast<float>(sampleRate));
+        stretch.setTransposeFactor(clip.pitchFactor, clip.tonalityLimit / static_cast<float>(sampleRate));
+
+        auto inputSamples = static_cast<int>(clip.frames);
+        int tailInputSamples = stretch.inputLatency();
+        int bodyOutputSamples = static_cast<int>(std::lround((inputSamples + tailInputSamples) / clip.speed));
+        int outputSamples = bodyOutputSamples + stretch.outputLatency();
+
+        std::vector<std::vector<float>> inputs(channels, std::vector<float>(inputSamples + tailInputSamples));
+        std::vector<std::vector<float>> outputs(channels, std::vector<float>(outputSamples));
+        for (uint32_t c = 0; c < channels; ++c) {
+            for (int i = 0; i < inputSamples; ++i) inputs[c][i] = clip.samples[i * channels + c];
+        }
+        std::vector<float *> flushPointers;
+        for (auto &output: outputs) flushPointers.push_back(output.data() + bodyOutputSamples);
+        stretch.process(inputs, inputSamples + tailInputSamples, outputs, bodyOutputSamples);
+        stretch.flush(flushPointers, stretch.outputLatency());
+
+        int preRollSamples = stretch.inputLatency() + static_cast<int>(std::lround(stretch.outputLatency() * clip.speed));
+        int skippedSamples = std::min(outputSamples, static_cast<int>(std::lround(preRollSamples / clip.speed)));
+        std::vector<float> result(static_cast<size_t>(outputSamples - skippedSamples) * channels);
+        for (int i = skippedSamples; i < outputSamples; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) result[(i - skippedSamples) * channels + c] = outputs[c][i] * clip.volume;
+        }
+        return result;
+    }
+}
+
+int runClips(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto count = static_cast<size_t>(options.getDouble("clips", 500));
+    auto minSeconds = options.getDouble("min-seconds", 0.02), maxSeconds = options.getDouble("max-seconds", 0.25);
+    auto hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    auto threadCounts = options.getDoubles("threads", "1," + std::to_string(hardwareThreads));
+    int repeats = static_cast<int>(options.getDouble("repeats", 3));
+
+    bool passed = true;
+
+    // Sound effects cut from speech and drum-like bursts, played from half to double speed, a third of them transposed
+    auto speech = signals::speech(sampleRate, channels, static_cast<uint64_t>(4 * sampleRate));
+    auto bursts = signals::transients(sampleRate, channels, static_cast<uint64_t>(4 * sampleRate));
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> seconds(minSeconds, maxSeconds), octaves(-1, 1), semitones(-12, 12);
+    std::vector<ClipRequest> clips(count);
+    uint64_t inputFrames = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto &source = i % 2 ? bursts : speech;
+        auto frames = static_cast<uint64_t>(seconds(random) * sampleRate);
+        auto offset = std::uniform_int_distribution<uint64_t>(0, source.size() / channels - frames)(random);
+        clips[i].samples = source.data() + offset * channels;
+        clips[i].frames = frames;
+        clips[i].speed = static_cast<float>(std::exp2(octaves(random)));
+        if (i % 3 == 0) clips[i].pitchFactor = static_cast<float>(std::exp2(semitones(random) / 12));
+        inputFrames += frames;
+    }
+    std::cout << count << " clips, " << std::fixed << std::setprecision(1) << static_cast<double>(inputFrames) / sampleRate
+              << " s of input, " << hardwareThreads << " hardware threads\n\n" << std::defaultfloat << std::setprecision(6);
+
+    // A stretcher per clip, on the calling thread
+    std::vector<std::vector<float>> fresh(count);
+    std::vector<double> freshRates;
+    for (int r = 0; r < repeats; ++r) {
+        uint64_t start = nowNanos();
+        for (size_t i = 0; i < count; ++i) fresh[i] = renderFresh(clips[i], sampleRate, channels);
+        freshRates.push_back(static_cast<double>(count) * 1e9 / static_cast<double>(nowNanos() - start));
+    }
+    double freshRate = percentile(freshRates, 0.5);
+
+    std::cout << std::left << std::setw(26) << "renderer" << std::setw(12) << "clips/s" << std::setw(10) << "scaling"
+              << std::setw(9) << "steals" << std::setw(12) << "p50 clip" << "p99 clip\n";
+    std::cout << std::setw(26) << "stretcher per clip" << std::fixed << std::setprecision(0) << std::setw(12) << freshRate
+              << std::defaultfloat << std::setprecision(6) << "-\n";
+
+    double singleRate = 0;
+    std::vector<RenderedClip> single;
+    for (double threads: threadCounts) {
+        ClipRendererOptions rendererOptions;
+        rendererOptions.sampleRate = sampleRate;
+        rendererOptions.channels = channels;
+        rendererOptions.threads = static_cast<size_t>(threads);
+        ClipRenderer renderer(rendererOptions);
+
+        // The first batch grows each worker's buffers, as a game's first burst of effects would
+        std::vector<RenderedClip> rendered = renderer.render(clips);
+        renderer.resetStats();
+        std::vector<double> rates;
+        for (int r = 0; r < repeats; ++r) {
+            uint64_t start = nowNanos();
+            rendered = renderer.render(clips);
+            rates.push_back(static_cast<double>(count) * 1e9 / static_cast<double>(nowNanos() - start));
+        }
+        double rate = percentile(rates, 0.5);
+        auto stats = renderer.getStats();
+        if (single.empty()) {
+            single = rendered;
+            singleRate = rate;
+        }
+
+        std::ostringstream name;
+        name << "ClipRenderer, " << renderer.threadCount() << (renderer.threadCount() == 1 ? " thread" : " threads");
+        std::cout << std::setw(26) << name.str() << std::fixed << std::setprecision(0) << std::setw(12) << rate
+                  << std::setprecision(2) << std::setw(10) << rate / singleRate << std::setw(9) << stats.steals / repeats
+                  << std::setprecision(0) << std::setw(12) << (std::to_string(stats.clip.percentile(0.5) / 1000) + " us")
+                  << stats.clip.percentile(0.99) / 1000 << " us" << std::defaultfloat << std::setprecision(6) << "\n";
+
+        // However the clips were spread over the workers, each comes out the same
+        for (size_t i = 0; i < count; ++i) {
+            if (rendered[i].samples != single[i].samples) {
+                std::cout << "FAIL  clip " << i << " differs between 1 and " << renderer.threadCount() << " threads\n";
+                passed = false;
+                break;
+            }
+        }
+    }
+
+    // A reused stretcher renders each clip as a fresh one would, at its speed's length
+    double worst = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const auto &clip = clips[i];
+        const auto &samples = single[i].samples;
+        auto expected = static_cast<double>(clip.frames) / clip.speed;
+        if (std::abs(static_cast<double>(samples.size() / channels) - expected) > 2 || samples.size() != fresh[i].size()) {
+            std::cout << "FAIL  clip " << i << " rendered " << samples.size() / channels << " frames, expected " << expected << "\n";
+            passed = false;
+            break;
+        }
+        for (size_t s = 0; s < samples.size(); ++s) worst = std::max(worst, static_cast<double>(std::abs(samples[s] - fresh[i][s])));
+    }
+    if (worst > 1e-5) {
+        std::cout << "FAIL  reused stretchers differ from fresh ones by up to " << worst << "\n";
+        passed = false;
+    }
+    std::cout << "\n" << std::fixed << std::setprecision(2) << singleRate / freshRate << "x the clips/s of a stretcher per clip on one thread\n"
+              << std::defaultfloat << std::setprecision(6);
+
+    return passed ? 0 : 1;
+}
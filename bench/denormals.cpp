@@ -0,0 +1,127 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    constexpr uint32_t channels = 2;
+
+    // Music on the left, and on the right a noise tail decaying from 1e-20 into the subnormal range, as after a fade-out.
+    // The loud channel keeps the stretcher out of its silence bypass, so the quiet one is fully processed.
+    std::vector<float> makeSignal(uint32_t sampleRate, uint64_t frames) {
+        auto music = signals::music(sampleRate, 1, frames);
+        std::vector<float> output(frames * channels);
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> noise(-1, 1);
+        double gain = 1e-20;
+        for (uint64_t i = 0; i < frames; ++i) {
+            output[i * channels] = music[i];
+            output[i * channels + 1] = static_cast<float>(gain * noise(random));
+            gain = std::max(gain * 0.99999, 1e-40);
+        }
+        return output;
+    }
+
+    // Milliseconds of processing per second of input
+    double timeStretch(const std::vector<float> &input, uint32_t sampleRate, uint64_t chunkFrames, bool stopDenormals) {
+        signalsmith::stretch::SignalsmithStretch<float> stretch;
+        stretch.presetDefault(channels, static_cast<float>(sampleRate));
+
+        uint64_t frames = input.size() / channels;
+        std::vector<std::vector<float>> inputBuffers(channels, std::vector<float>(chunkFrames));
+        std::vector<std::vector<float>> outputBuffers(channels, std::vector<float>(chunkFrames));
+
+        uint64_t start = nowNanos();
+        for (uint64_t offset = 0; offset + chunkFrames <= frames; offset += chunkFrames) {
+            for (uint64_t i = 0; i < chunkFrames; ++i) {
+                for (uint32_t c = 0; c < channels; ++c) {
+                    inputBuffers[c][i] = input[(offset + i) * channels + c];
+                }
+            }
+            if (stopDenormals) {
+                signalsmith::perf::StopDenormals scope;
+                stretch.process(inputBuffers, static_cast<int>(chunkFrames), outputBuffers, static_cast<int>(chunkFrames));
+            } else {
+                stretch.process(inputBuffers, static_cast<int>(chunkFrames), outputBuffers, static_cast<int>(chunkFrames));
+            }
+        }
+        return static_cast<double>(nowNanos() - start) / 1e6 / (static_cast<double>(frames) / sampleRate);
+    }
+
+    double timeSampler(const std::vector<float> &input, uint32_t sampleRate, uint64_t chunkFrames) {
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.start();
+
+        uint64_t frames = input.size() / channels;
+        auto *data = reinterpret_cast<const uint8_t *>(input.data());
+        uint64_t chunkBytes = chunkFrames * channels * sizeof(float);
+
+        uint64_t start = nowNanos();
+        for (uint64_t offset = 0; offset + chunkFrames <= frames; offset += chunkFrames) {
+            sampler.play(data + offset * channels * sizeof(float), chunkBytes);
+        }
+        double result = static_cast<double>(nowNanos() - start) / 1e6 / (static_cast<double>(frames) / sampleRate);
+
+        sampler.stop();
+        return result;
+    }
+
+    // Injects NaN and Inf into the input and checks they're counted and kept out of the stretcher
+    bool checkNonFinite(uint32_t sampleRate, uint64_t chunkFrames) {
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.start();
+
+        auto input = signals::music(sampleRate, channels, chunkFrames * 8);
+        uint64_t injected = 0;
+        for (size_t i = 0; i < input.size(); i += 997) {
+            input[i] = (injected++ % 2) ? std::numeric_limits<float>::infinity() : std::numeric_limits<float>::quiet_NaN();
+        }
+
+        uint64_t chunkBytes = chunkFrames * channels * sizeof(float);
+        for (uint64_t chunk = 0; chunk < 8; ++chunk) {
+            sampler.play(reinterpret_cast<const uint8_t *>(input.data()) + chunk * chunkBytes, chunkBytes);
+        }
+        auto stats = sampler.getNonFiniteStats();
+        sampler.stop();
+
+        std::cout << "non-finite: injected " << injected << ", input " << stats.inputSamples << ", output "
+                  << stats.outputSamples << ", calls " << stats.affectedCalls << ", resets " << stats.stretchResets << "\n";
+
+        bool passed = stats.inputSamples == injected && stats.outputSamples == 0 && stats.stretchResets == 0;
+        if (!passed) std::cout << "FAIL  non-finite input was not contained\n";
+        return passed;
+    }
+}
+
+int runDenormals(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto seconds = options.getDouble("seconds", 4);
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+
+    auto input = makeSignal(sampleRate, static_cast<uint64_t>(seconds * sampleRate));
+
+    if (!signalsmith::perf::StopDenormals::flushes) {
+        std::cout << "note: no hardware flush-to-zero on this platform, Sampler flushes subnormals in software\n";
+    }
+
+    // Interleave the measurements so frequency scaling and noise affect both sides equally
+    std::vector<double> before, after, sampler;
+    for (int repeat = 0; repeat < 3; ++repeat) {
+        before.push_back(timeStretch(input, sampleRate, chunkFrames, false));
+        after.push_back(timeStretch(input, sampleRate, chunkFrames, true));
+        sampler.push_back(timeSampler(input, sampleRate, chunkFrames));
+    }
+    double beforeMs = percentile(before, 0.5), afterMs = percentile(after, 0.5), samplerMs = percentile(sampler, 0.5);
+
+    std::cout << std::left << std::setw(34) << "configuration" << "ms per second of audio\n"
+              << std::setw(34) << "stretch, default FP state" << beforeMs << "\n"
+              << std::setw(34) << "stretch, StopDenormals" << afterMs << "\n"
+              << std::setw(34) << "Sampler::play" << samplerMs << "\n"
+              << "denormal slowdown: " << std::setprecision(3) << beforeMs / afterMs << "x\n";
+
+    return checkNonFinite(sampleRate, chunkFrames) ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#include "bench.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    // Pages of the mapping of `path` resident in the process, 0 where it can't be read
+    uint64_t residentMappedBytes(const std::string &path) {
+#ifdef __linux__
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        bool mapping = false;
+        while (std::getline(smaps, line)) {
+            if (line.find(path) != std::string::npos) {
+                mapping = true;
+            } else if (mapping && line.rfind("Rss:", 0) == 0) {
+                return std::stoull(line.substr(4)) * 1024;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    // Discards the output, sampling the resident pages of the mapped file on every write
+    struct ResidentSink : NullSink {
+        std::string path;
+        uint64_t peak = 0;
+
+        explicit ResidentSink(std::string path) : path(std::move(path)) {}
+
+        void write(const float *samples, uint64_t frames) override {
+            NullSink::write(samples, frames);
+            peak = std::max(peak, residentMappedBytes(path));
+        }
+    };
+
+    void writeWav(const std::string &path, const std::vector<float> &samples, uint32_t sampleRate, uint32_t channels) {
+        auto dataBytes = static_cast<uint32_t>(samples.size() * sizeof(float));
+        auto u32 = [](std::ofstream &file, uint32_t value) { file.write(reinterpret_cast<const char *>(&value), 4); };
+        auto u16 = [](std::ofstream &file, uint16_t value) { file.write(reinterpret_cast<const char *>(&value), 2); };
+
+        std::ofstream file(path, std::ios::binary);
+        file.write("RIFF", 4);
+        u32(file, 36 + dataBytes);
+        file.write("WAVEfmt ", 8);
+        u32(file, 16);
+        u16(file, 3);
+        u16(file, static_cast<uint16_t>(channels));
+        u32(file, sampleRate);
+        u32(file, sampleRate * channels * 4);
+        u16(file, static_cast<uint16_t>(channels * 4));
+        u16(file, 32);
+        file.write("data", 4);
+        u32(file, dataBytes);
+        file.write(reinterpret_cast<const char *>(samples.data()), dataBytes);
+    }
+
+    // `play` in blocks of `Sampler::fileBlockFrames`, the reference for `renderFile`
+    std::vector<float> renderPlayed(const std::vector<float> &track, uint32_t sampleRate, uint32_t channels, double speed,
+                                    NonFiniteStats &stats) {
+        auto *sink = new CaptureSink(channels, 0, sampleRate);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        uint64_t frames = track.size() / channels;
+        for (uint64_t offset = 0; offset < frames; offset += Sampler::fileBlockFrames) {
+            uint64_t count = std::min(Sampler::fileBlockFrames, frames - offset);
+            sampler.play(reinterpret_cast<const uint8_t *>(track.data() + offset * channels), count * channels * sizeof(float));
+        }
+
+        stats = sampler.getNonFiniteStats();
+        auto output = sink->samples;
+        sampler.stop();
+        return output;
+    }
+
+    std::vector<float> renderMapped(const std::string &path, uint32_t sampleRate, uint32_t channels, double speed,
+                                    NonFiniteStats &stats) {
+        PcmFile file(path);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+
+        // Offline, the sink is never started
+        std::vector<float> output(sampler.getFileOutputFrames(file.frames()) * channels);
+        uint64_t written = sampler.renderFile(file, 0, file.frames(), output.data());
+        output.resize(written * channels);
+
+        stats = sampler.getNonFiniteStats();
+        return output;
+    }
+
+    double maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+        if (a.size() != b.size()) return std::numeric_limits<double>::infinity();
+        double difference = 0;
+        for (size_t i = 0; i < a.size(); ++i) difference = std::max(difference, std::abs(static_cast<double>(a[i] - b[i])));
+        return difference;
+    }
+
+    // Reads the whole file into memory and plays it in blocks, as a caller holding it in a byte array does
+    double playRead(const std::string &path, uint32_t sampleRate, uint32_t channels, double speed) {
+        uint64_t start = nowNanos();
+
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        std::ifstream input(path, std::ios::binary);
+        std::vector<uint8_t> bytes(std::filesystem::file_size(path));
+        input.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+        uint64_t blockBytes = Sampler::fileBlockFrames * channels * sizeof(float);
+        uint64_t frames = (bytes.size() - 44) / (channels * sizeof(float));
+        for (uint64_t offset = 44; offset < bytes.size(); offset += blockBytes) {
+            sampler.play(bytes.data() + offset, std::min<uint64_t>(blockBytes, bytes.size() - offset));
+        }
+
+        sampler.stop();
+        return static_cast<double>(nowNanos() - start) / static_cast<double>(frames);
+    }
+
+    /*
+     * Plays the file straight from its mapping. With `peakResident`, the output goes to a `ResidentSink` that reads the
+     * process's page tables on every write, which slows playback down, so it is timed without one.
+     */
+    double playMapped(const std::string &path, uint32_t sampleRate, uint32_t channels, double speed, uint64_t *peakResident) {
+        uint64_t start = nowNanos();
+
+        auto *sink = peakResident ? new ResidentSink(path) : nullptr;
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard,
+                        sink ? std::unique_ptr<SamplerSink>(sink) : std::make_unique<NullSink>());
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        PcmFile file(path);
+        sampler.playFile(file, 0, file.frames());
+
+        double nanosPerFrame = static_cast<double>(nowNanos() - start) / static_cast<double>(file.frames());
+        if (sink) *peakResident = sink->peak;
+        sampler.stop();
+        return nanosPerFrame;
+    }
+}
+
+int runFile(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto speed = options.getDouble("speed", 1);
+    auto seconds = options.getDouble("seconds", 60);
+    int repeats = static_cast<int>(options.getDouble("repeats", 3));
+    auto directory = options.get("dir", std::filesystem::temp_directory_path().string());
+
+    auto path = (std::filesystem::path(directory) / "klarity_bench_file.wav").string();
+    auto invalidPath = (std::filesystem::path(directory) / "klarity_bench_file_nan.wav").string();
+
+    bool passed = true;
+
+    // Mapped rendering against `play` of the same blocks: clean input, then input with NaNs in one block
+    {
+        auto track = signals::music(sampleRate, channels, static_cast<uint64_t>(std::min(seconds, 5.0) * sampleRate));
+        writeWav(path, track, sampleRate, channels);
+        auto invalid = track;
+        for (uint64_t i = 0; i < 64; ++i) invalid[(3 * Sampler::fileBlockFrames + 100 + i * 7) * channels] = std::numeric_limits<float>::quiet_NaN();
+        writeWav(invalidPath, invalid, sampleRate, channels);
+
+        std::cout << std::left << std::setw(10) << "input" << std::setw(16) << "max difference" << "non-finite play/file\n";
+        for (bool nan: {false, true}) {
+            NonFiniteStats playedStats, mappedStats;
+            auto played = renderPlayed(nan ? invalid : track, sampleRate, channels, speed, playedStats);
+            auto mapped = renderMapped(nan ? invalidPath : path, sampleRate, channels, speed, mappedStats);
+            double difference = maxDifference(played, mapped);
+
+            std::cout << std::setw(10) << (nan ? "with NaN" : "clean") << std::setw(16) << difference
+                      << playedStats.inputSamples << "/" << mappedStats.inputSamples << "\n";
+
+            if (difference != 0 || playedStats.inputSamples != mappedStats.inputSamples) {
+                std::cout << "FAIL  mapped rendering of " << (nan ? "input with NaN" : "clean input") << "\n";
+                passed = false;
+            }
+        }
+        std::filesystem::remove(invalidPath);
+    }
+
+    // A long file, played after it was read into memory and straight from the mapping
+    auto track = signals::music(sampleRate, channels, static_cast<uint64_t>(seconds * sampleRate));
+    writeWav(path, track, sampleRate, channels);
+    uint64_t fileBytes = std::filesystem::file_size(path);
+    track = {};
+    track.shrink_to_fit();
+
+    std::vector<double> read, mapped;
+    for (int r = 0; r < repeats; ++r) {
+        read.push_back(playRead(path, sampleRate, channels, speed));
+        mapped.push_back(playMapped(path, sampleRate, channels, speed, nullptr));
+    }
+
+    uint64_t peakResident = 0;
+    playMapped(path, sampleRate, channels, speed, &peakResident);
+
+    // Read into memory, all of the file is resident for as long as it plays
+    std::cout << "\n" << std::setw(12) << "source" << std::setw(14) << "ns/frame" << "file resident MiB\n" << std::fixed << std::setprecision(1)
+              << std::setw(12) << "read+play" << std::setw(14) << percentile(read, 0.5) << static_cast<double>(fileBytes) / (1 << 20) << "\n"
+              << std::setw(12) << "playFile" << std::setw(14) << percentile(mapped, 0.5) << static_cast<double>(peakResident) / (1 << 20) << "\n"
+              << std::defaultfloat;
+
+    // Released as it plays, the mapped file keeps a bounded window resident whatever its length
+    if (peakResident > 8 << 20) {
+        std::cout << "FAIL  resident memory of the mapped file\n";
+        passed = false;
+    }
+
+    std::filesystem::remove(path);
+    return passed ? 0 : 1;
+}
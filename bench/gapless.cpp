@@ -0,0 +1,114 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    enum class Transition {
+        continuous, restart, gapless
+    };
+
+    struct Render {
+        std::vector<float> output;
+        uint64_t starts = 0;
+    };
+
+    Render render(Transition transition, const std::vector<float> &first, const std::vector<float> &second,
+                  uint32_t sampleRate, uint32_t channels, double speed, uint64_t chunkFrames) {
+        auto *sink = new CaptureSink(channels);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        // Each play() call rounds its output length, so the continuous rendering plays the next track's head in one call too
+        uint64_t head = std::max(sampler.getPreRollFrames(), chunkFrames);
+        auto *headData = reinterpret_cast<const uint8_t *>(second.data());
+        uint64_t headBytes = head * channels * sizeof(float);
+
+        playRange(sampler, first, channels, 0, chunkFrames);
+        switch (transition) {
+            case Transition::continuous:
+                sampler.play(headData, headBytes);
+                playRange(sampler, second, channels, head, chunkFrames);
+                break;
+            case Transition::restart:
+                // The usual approach: stop the device, start it again and play the next track on a reset stretcher
+                sampler.stop();
+                sampler.start();
+                sampler.play(headData, headBytes);
+                playRange(sampler, second, channels, head, chunkFrames);
+                break;
+            case Transition::gapless:
+                sampler.queueNext(headData, headBytes);
+                sampler.finishTrack();
+                playRange(sampler, second, channels, head, chunkFrames);
+                break;
+        }
+
+        Render result{std::move(sink->samples), sink->starts};
+        sampler.stop();
+        return result;
+    }
+
+    // Longest run of 5 ms blocks near the boundary that are more than 20 dB below the continuous rendering (shorter
+    // blocks catch single-millisecond cancellations, as the phase vocoder's state differs after the splice)
+    double gapMs(const std::vector<float> &output, const std::vector<float> &reference, uint64_t boundary,
+                 uint32_t sampleRate, uint32_t channels) {
+        uint64_t block = sampleRate / 200;
+        uint64_t span = sampleRate / 4;
+        uint64_t from = boundary > span ? boundary - span : 0;
+        uint64_t run = 0, longest = 0;
+        for (uint64_t start = from; start < boundary + span; start += block) {
+            double expected = blockRms(reference, start, block, channels);
+            if (expected < 1e-3) continue;
+            run = blockRms(output, start, block, channels) < 0.1 * expected ? run + 1 : 0;
+            longest = std::max(longest, run);
+        }
+        return static_cast<double>(longest * block) * 1000.0 / sampleRate;
+    }
+}
+
+int runGapless(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto seconds = options.getDouble("seconds", 2);
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto speeds = options.getDoubles("speeds", "0.5,1,2");
+
+    // Both tracks are halves of one piece, so a perfect transition sounds like the continuous rendering
+    auto frames = static_cast<uint64_t>(seconds * sampleRate);
+    auto piece = signals::music(sampleRate, channels, frames * 2);
+    std::vector<float> first(piece.begin(), piece.begin() + static_cast<std::ptrdiff_t>(frames * channels));
+    std::vector<float> second(piece.begin() + static_cast<std::ptrdiff_t>(frames * channels), piece.end());
+
+    std::cout << std::left << std::setw(8) << "speed" << std::setw(12) << "transition" << std::setw(10) << "gap ms"
+              << std::setw(16) << "length error" << "device starts\n";
+
+    bool passed = true;
+    for (double speed: speeds) {
+        auto reference = render(Transition::continuous, first, second, sampleRate, channels, speed, chunkFrames);
+        auto boundary = static_cast<uint64_t>(std::lround(frames / speed));
+        auto expected = static_cast<int64_t>(reference.output.size() / channels);
+
+        for (auto transition: {Transition::restart, Transition::gapless}) {
+            auto result = render(transition, first, second, sampleRate, channels, speed, chunkFrames);
+            double gap = gapMs(result.output, reference.output, boundary, sampleRate, channels);
+            int64_t lengthError = static_cast<int64_t>(result.output.size() / channels) - expected;
+            bool gapless = transition == Transition::gapless;
+
+            std::cout << std::setw(8) << speed << std::setw(12) << (gapless ? "gapless" : "restart")
+                      << std::setw(10) << std::setprecision(3) << gap << std::setw(16) << lengthError << result.starts << "\n";
+
+            // Sample-accurate means the spliced output lines up with the continuous rendering, give or take rounding
+            if (gapless && (gap > 0 || std::abs(lengthError) > 2 || result.starts != 1)) {
+                std::cout << "FAIL  gapless transition at speed " << speed << "\n";
+                passed = false;
+            }
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    struct LoopResult {
+        std::vector<float> output;
+        // Output frame of each wrap, input bytes handed to the sampler per pass, and processing time per pass
+        std::vector<uint64_t> wraps;
+        double bytesPerPass = 0;
+        double microsPerPass = 0;
+        double periodError = 0;
+    };
+
+    // The usual approach: the app sends the segment again for every pass, and each pass starts with a hard cut
+    LoopResult renderResend(const std::vector<float> &segment, uint32_t sampleRate, uint32_t channels, double speed,
+                            uint64_t chunkFrames, int passes) {
+        auto *sink = new CaptureSink(channels);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        uint64_t segmentFrames = segment.size() / channels;
+        double latency = static_cast<double>(sampler.getPreRollFrames()) / speed;
+
+        LoopResult result;
+        uint64_t start = nowNanos();
+        for (int pass = 0; pass < passes; ++pass) {
+            playRange(sampler, segment, channels, 0, chunkFrames);
+            result.bytesPerPass += static_cast<double>(segment.size() * sizeof(float));
+        }
+        result.microsPerPass = static_cast<double>(nowNanos() - start) / 1e3 / passes;
+        result.bytesPerPass /= passes;
+
+        // Output lags input by the pre-roll
+        for (int pass = 1; pass < passes; ++pass) {
+            result.wraps.push_back(static_cast<uint64_t>(std::lround(static_cast<double>(pass * segmentFrames) / speed + latency)));
+        }
+
+        result.output = std::move(sink->samples);
+        sampler.stop();
+        return result;
+    }
+
+    LoopResult renderLoop(const std::vector<float> &segment, uint32_t sampleRate, uint32_t channels, double speed,
+                          uint64_t chunkFrames, int passes, uint64_t crossfadeFrames) {
+        auto *sink = new CaptureSink(channels);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        uint64_t periodFrames = segment.size() / channels - crossfadeFrames;
+
+        LoopResult result;
+        uint64_t start = nowNanos();
+        sampler.startLoop(reinterpret_cast<const uint8_t *>(segment.data()), segment.size() * sizeof(float), crossfadeFrames);
+        for (uint64_t played = 0; played < passes * periodFrames; played += chunkFrames) {
+            sampler.playLoop(std::min<uint64_t>(chunkFrames, passes * periodFrames - played));
+        }
+        result.microsPerPass = static_cast<double>(nowNanos() - start) / 1e3 / passes;
+        result.bytesPerPass = static_cast<double>(segment.size() * sizeof(float)) / passes;
+
+        // The first frame after `startLoop` is the start of a pass
+        for (int pass = 1; pass < passes; ++pass) {
+            result.wraps.push_back(static_cast<uint64_t>(std::lround(static_cast<double>(pass * periodFrames) / speed)));
+        }
+        result.periodError = static_cast<double>(sink->frames()) - static_cast<double>(passes * periodFrames) / speed;
+
+        result.output = std::move(sink->samples);
+        sampler.stop();
+        return result;
+    }
+
+    // RMS of the second difference of the channel mix per window, which weights the spectrum by frequency squared, so the
+    // broadband splatter of a discontinuity stands out against the material's own high frequencies
+    std::vector<double> roughness(const std::vector<float> &output, uint32_t channels, uint64_t window) {
+        std::vector<double> windows;
+        uint64_t frames = output.size() / channels;
+        double previous = 0, beforePrevious = 0, sum = 0;
+        for (uint64_t i = 0; i < frames; ++i) {
+            double mix = 0;
+            for (uint32_t c = 0; c < channels; ++c) mix += output[i * channels + c];
+            double curvature = mix - 2 * previous + beforePrevious;
+            sum += curvature * curvature;
+            beforePrevious = previous;
+            previous = mix;
+            if ((i + 1) % window == 0) {
+                windows.push_back(std::sqrt(sum / static_cast<double>(window)));
+                sum = 0;
+            }
+        }
+        return windows;
+    }
+
+    // Worst roughness within 20 ms of any of `positions`
+    double worstNear(const std::vector<double> &windows, const std::vector<uint64_t> &positions, uint64_t window, uint64_t reach) {
+        double worst = 0;
+        for (auto position: positions) {
+            for (uint64_t w = (position > reach ? position - reach : 0) / window; w <= (position + reach) / window && w < windows.size(); ++w) {
+                worst = std::max(worst, windows[w]);
+            }
+        }
+        return worst;
+    }
+
+    /*
+     * Roughness at the wraps relative to the same material played straight through: the worst of the segment's start
+     * and end in a continuous rendering of the piece (or the median, if both are silent)
+     */
+    double wrapExcessDb(const LoopResult &result, const std::vector<double> &reference, const std::vector<uint64_t> &boundaries,
+                        uint32_t sampleRate, uint32_t channels) {
+        uint64_t window = sampleRate / 400, reach = sampleRate / 50;
+        double worst = worstNear(roughness(result.output, channels, window), result.wraps, window, reach);
+        double expected = std::max(worstNear(reference, boundaries, window, reach), percentile(reference, 0.5));
+        return 20 * std::log10(worst / expected);
+    }
+}
+
+int runLoop(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto speeds = options.getDoubles("speeds", "0.75,1");
+    auto crossfadeFrames = static_cast<uint64_t>(options.getDouble("crossfade-ms", 20) * sampleRate / 1000);
+    auto names = options.getList("signals", "speech,music");
+    int passes = static_cast<int>(options.getDouble("passes", 6));
+
+    std::cout << std::left << std::setw(8) << "signal" << std::setw(8) << "speed" << std::setw(10) << "approach"
+              << std::setw(16) << "bytes per pass" << std::setw(14) << "us per pass" << std::setw(18) << "wrap excess dB"
+              << "period error\n";
+
+    bool passed = true;
+    for (const auto &name: names) {
+        // A 1.5 s segment cut mid-phrase, so the wrap is a hard discontinuity
+        auto piece = name == "speech" ? signals::speech(sampleRate, channels, sampleRate * 4) : signals::music(sampleRate, channels, sampleRate * 4);
+        auto from = static_cast<std::ptrdiff_t>(static_cast<uint64_t>(1.2345 * sampleRate) * channels);
+        std::vector<float> segment(piece.begin() + from, piece.begin() + from + static_cast<std::ptrdiff_t>(sampleRate * 3 / 2 * channels));
+
+        for (double speed: speeds) {
+            auto *sink = new CaptureSink(channels);
+            Sampler continuous(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+            continuous.setPlaybackSpeed(static_cast<float>(speed));
+            continuous.start();
+            double latency = static_cast<double>(continuous.getPreRollFrames());
+            playRange(continuous, piece, channels, 0, chunkFrames);
+            auto reference = roughness(sink->samples, channels, sampleRate / 400);
+            auto segmentStart = static_cast<double>(from / channels), segmentEnd = segmentStart + static_cast<double>(segment.size() / channels);
+            std::vector<uint64_t> boundaries{static_cast<uint64_t>((segmentStart + latency) / speed), static_cast<uint64_t>((segmentEnd + latency) / speed)};
+
+            auto resend = renderResend(segment, sampleRate, channels, speed, chunkFrames, passes);
+            auto loop = renderLoop(segment, sampleRate, channels, speed, chunkFrames, passes, crossfadeFrames);
+            double resendExcess = wrapExcessDb(resend, reference, boundaries, sampleRate, channels);
+            double loopExcess = wrapExcessDb(loop, reference, boundaries, sampleRate, channels);
+
+            for (auto *result: {&resend, &loop}) {
+                bool looped = result == &loop;
+                std::cout << std::setw(8) << name << std::setw(8) << speed << std::setw(10) << (looped ? "loop" : "resend")
+                          << std::setw(16) << static_cast<uint64_t>(result->bytesPerPass) << std::fixed << std::setprecision(0) << std::setw(14)
+                          << result->microsPerPass << std::setprecision(2) << std::setw(18)
+                          << (looped ? loopExcess : resendExcess) << std::defaultfloat;
+                if (looped) {
+                    std::cout << result->periodError << "\n";
+                } else {
+                    std::cout << "-\n";
+                }
+            }
+
+            // Seamless means about as smooth at the wrap as the material played straight through, and no drift of the period
+            if (loopExcess > 3 || std::abs(loop.periodError) > 1) {
+                std::cout << "FAIL  loop of " << name << " at speed " << speed << "\n";
+                passed = false;
+            }
+        }
+    }
+
+    return passed ? 0 : 1;
+}
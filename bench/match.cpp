@@ -0,0 +1,126 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "match.h"
+#include "signals.h"
+
+namespace {
+    std::string keyName(const TrackAnalysis &analysis) {
+        static constexpr const char *names[] = {"C", "C#", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"};
+        if (analysis.keyTonic < 0) return "-";
+        return std::string(names[analysis.keyTonic]) + (analysis.keyMinor ? "m" : "");
+    }
+
+    // Plays the whole signal, returning ns per input frame
+    double playCost(const std::vector<float> &signal, uint32_t sampleRate, uint32_t channels, uint64_t chunkFrames,
+                    TrackAnalyzer *analyzer, ProfileStats &stats) {
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        if (analyzer) sampler.setSpectrumObserver(analyzer);
+        sampler.start();
+
+        uint64_t frames = signal.size() / channels;
+        uint64_t start = nowNanos();
+        for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+            uint64_t count = std::min(chunkFrames, frames - offset);
+            sampler.play(reinterpret_cast<const uint8_t *>(signal.data() + offset * channels), count * channels * sizeof(float));
+        }
+        double nanos = static_cast<double>(nowNanos() - start) / static_cast<double>(frames);
+        stats = sampler.getProfileStats();
+        sampler.stop();
+        return nanos;
+    }
+}
+
+int runMatch(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto seconds = options.getDouble("seconds", 30);
+    auto leaderTempo = options.getDouble("leader-bpm", 120);
+    auto followerTempo = options.getDouble("follower-bpm", 128);
+    auto followerSemitones = options.getDouble("follower-semitones", 2);
+    int repeats = static_cast<int>(options.getDouble("repeats", 3));
+
+    bool passed = true;
+    auto frames = static_cast<uint64_t>(seconds * sampleRate);
+    auto leaderTrack = signals::music(sampleRate, channels, frames, leaderTempo);
+    auto followerTrack = signals::music(sampleRate, channels, frames, followerTempo, followerSemitones);
+
+    // The follower glides onto the leader while both play
+    TrackMatchState state;
+    {
+        Sampler leader(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        Sampler follower(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        TrackMatcher matcher(leader, follower);
+        leader.start();
+        follower.start();
+
+        std::cout << std::left << std::setw(8) << "time s" << std::setw(20) << "leader bpm/key" << std::setw(20)
+                  << "follower bpm/key" << std::setw(16) << "speed" << "semitones\n";
+        auto reportFrames = static_cast<uint64_t>(5 * sampleRate);
+        for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+            uint64_t count = std::min(chunkFrames, frames - offset);
+            leader.play(reinterpret_cast<const uint8_t *>(leaderTrack.data() + offset * channels), count * channels * sizeof(float));
+            follower.play(reinterpret_cast<const uint8_t *>(followerTrack.data() + offset * channels), count * channels * sizeof(float));
+            state = matcher.update(static_cast<double>(count) / sampleRate);
+
+            if ((offset + count) / reportFrames != offset / reportFrames) {
+                std::ostringstream leaderColumn, followerColumn;
+                leaderColumn << std::fixed << std::setprecision(1) << state.leader.tempo << " " << keyName(state.leader);
+                followerColumn << std::fixed << std::setprecision(1) << state.follower.tempo << " " << keyName(state.follower);
+                std::cout << std::setw(8) << (offset + count) / sampleRate << std::setw(20) << leaderColumn.str() << std::setw(20)
+                          << followerColumn.str() << std::fixed << std::setprecision(4) << std::setw(16) << state.speed
+                          << std::setprecision(2) << state.semitones << std::defaultfloat << std::setprecision(6) << "\n";
+            }
+        }
+        leader.stop();
+        follower.stop();
+    }
+
+    // Half or double time counts as a match, as it does for the matcher
+    auto octaveError = [](double estimate, double actual) {
+        return estimate > 0 ? std::abs(std::remainder(std::log2(estimate / actual), 1.0)) : 1.0;
+    };
+    double expectedSpeed = leaderTempo / followerTempo;
+    while (expectedSpeed > M_SQRT2) expectedSpeed /= 2;
+    while (expectedSpeed < M_SQRT1_2) expectedSpeed *= 2;
+    double expectedSemitones = -followerSemitones - 12 * std::round(-followerSemitones / 12);
+
+    if (octaveError(state.leader.tempo, leaderTempo) > 0.015 || octaveError(state.follower.tempo, followerTempo) > 0.015) {
+        std::cout << "FAIL  estimated " << state.leader.tempo << " and " << state.follower.tempo << " bpm\n";
+        passed = false;
+    }
+    if (std::abs(state.speed / expectedSpeed - 1) > 0.015) {
+        std::cout << "FAIL  follower speed " << state.speed << ", expected " << expectedSpeed << "\n";
+        passed = false;
+    }
+    if (std::abs(state.semitones - expectedSemitones) > 0.1) {
+        std::cout << "FAIL  follower transposed by " << state.semitones << " semitones, expected " << expectedSemitones << "\n";
+        passed = false;
+    }
+
+    // What the analysis adds to playing the follower's track
+    std::vector<double> plain, analyzed;
+    ProfileStats plainStats, analyzedStats;
+    for (int r = 0; r < repeats; ++r) {
+        TrackAnalyzer analyzer(sampleRate);
+        plain.push_back(playCost(followerTrack, sampleRate, channels, chunkFrames, nullptr, plainStats));
+        analyzed.push_back(playCost(followerTrack, sampleRate, channels, chunkFrames, &analyzer, analyzedStats));
+    }
+    double plainMedian = percentile(plain, 0.5), analyzedMedian = percentile(analyzed, 0.5);
+    std::cout << "\nns/frame " << std::fixed << std::setprecision(1) << plainMedian << " without analysis, " << analyzedMedian
+              << " with (" << std::showpos << (analyzedMedian / plainMedian - 1) * 100 << std::noshowpos << "%)";
+    // The stretcher's own STFT (`analysis`, which includes the observer) is what a separate analysis would repeat
+    auto meanMicros = [](const ProfileHistogram &histogram) {
+        return static_cast<double>(histogram.totalNanos) / static_cast<double>(std::max<uint64_t>(1, histogram.count)) / 1e3;
+    };
+    if (analyzedStats[ProfileStage::observeSpectrum].count > 0) {
+        double observe = meanMicros(analyzedStats[ProfileStage::observeSpectrum]);
+        std::cout << "\nper hop: observeSpectrum " << observe << " us, STFT " << meanMicros(analyzedStats[ProfileStage::analysis]) - observe
+                  << " us, whole hop " << meanMicros(analyzedStats[ProfileStage::hop]) << " us";
+    }
+    std::cout << std::defaultfloat << std::setprecision(6) << "\n";
+
+    return passed ? 0 : 1;
+}
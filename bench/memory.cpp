@@ -0,0 +1,146 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    constexpr long qualitySeed = 12345;
+
+    SamplerMemoryUsage measureUsage(uint32_t sampleRate, uint32_t channels, SamplerPreset preset, SamplerPrecision precision, uint64_t chunkFrames) {
+        Sampler sampler(sampleRate, channels, preset, std::make_unique<NullSink>(), SamplerMemory::heap, precision);
+        sampler.start();
+        auto input = signals::music(sampleRate, channels, chunkFrames * 4);
+        for (uint64_t chunk = 0; chunk < 4; ++chunk) {
+            sampler.play(reinterpret_cast<const uint8_t *>(input.data() + chunk * chunkFrames * channels), chunkFrames * channels * sizeof(float));
+        }
+        sampler.stop();
+        return sampler.getMemoryUsage();
+    }
+
+    // Planar output of a seeded stretch, so full and compact runs differ only by the stored precision
+    std::vector<std::vector<float>> render(const std::vector<float> &interleaved, uint32_t sampleRate, uint32_t channels, double speed, float semitones, bool compact) {
+        std::vector<std::vector<float>> input(channels, std::vector<float>(interleaved.size() / channels));
+        for (size_t i = 0; i < interleaved.size(); ++i) input[i % channels][i / channels] = interleaved[i];
+
+        signalsmith::stretch::SignalsmithStretch<float> stretch(qualitySeed);
+        stretch.setCompactState(compact);
+        stretch.presetDefault(static_cast<int>(channels), static_cast<float>(sampleRate));
+        if (semitones != 0) stretch.setTransposeSemitones(semitones);
+
+        constexpr int chunk = 1024;
+        int outputChunk = static_cast<int>(chunk / speed);
+        std::vector<std::vector<float>> output(channels);
+        std::vector<const float *> inputs(channels);
+        std::vector<float *> outputs(channels);
+        for (size_t offset = 0; offset + chunk <= input[0].size(); offset += chunk) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                output[c].resize(output[c].size() + outputChunk);
+                inputs[c] = input[c].data() + offset;
+                outputs[c] = output[c].data() + output[c].size() - outputChunk;
+            }
+            stretch.process(inputs, chunk, outputs, outputChunk);
+        }
+        return output;
+    }
+
+    // Magnitude spectrogram (Hann window, 75% overlap), which ignores the phase drift any small perturbation causes
+    std::vector<float> spectrogram(const std::vector<std::vector<float>> &planar) {
+        constexpr size_t size = 2048, hop = size / 4;
+        signalsmith::fft::RealFFT<float> fft(size);
+        std::vector<float> frame(size);
+        std::vector<std::complex<float>> spectrum(size / 2);
+        std::vector<float> magnitudes;
+        for (const auto &channel: planar) {
+            for (size_t offset = 0; offset + size <= channel.size(); offset += hop) {
+                for (size_t i = 0; i < size; ++i) {
+                    frame[i] = channel[offset + i] * static_cast<float>(0.5 - 0.5 * std::cos(2 * M_PI * (i + 0.5) / size));
+                }
+                fft.fft(frame, spectrum);
+                for (auto &bin: spectrum) magnitudes.push_back(std::abs(bin));
+            }
+        }
+        return magnitudes;
+    }
+
+    // Energy of the reference spectrogram relative to the difference between the two, in dB
+    double spectralSnr(const std::vector<std::vector<float>> &reference, const std::vector<std::vector<float>> &other) {
+        auto referenceMagnitudes = spectrogram(reference), otherMagnitudes = spectrogram(other);
+        double signal = 0, noise = 0;
+        for (size_t i = 0; i < referenceMagnitudes.size(); ++i) {
+            double difference = static_cast<double>(otherMagnitudes[i]) - referenceMagnitudes[i];
+            signal += static_cast<double>(referenceMagnitudes[i]) * referenceMagnitudes[i];
+            noise += difference * difference;
+        }
+        return noise > 0 ? 10 * std::log10(signal / noise) : INFINITY;
+    }
+}
+
+int runMemory(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channelCounts = options.getDoubles("channels", "1,2,8");
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    double margin = options.getDouble("margin", 3);
+
+    std::cout << std::left << std::setw(9) << "preset" << std::setw(4) << "ch" << std::setw(9) << "state"
+              << std::setw(10) << "stft" << std::setw(10) << "history" << std::setw(10) << "bands" << std::setw(10) << "previous"
+              << std::setw(12) << "predictions" << std::setw(10) << "other" << std::setw(10) << "buffers"
+              << std::setw(10) << "total" << "saving (KiB)\n";
+
+    auto kib = [](size_t bytes) {
+        return static_cast<double>(bytes) / 1024;
+    };
+    for (const char *presetName: {"standard", "cheaper"}) {
+        auto preset = std::string(presetName) == "standard" ? SamplerPreset::standard : SamplerPreset::cheaper;
+        for (double channelCount: channelCounts) {
+            auto channels = static_cast<uint32_t>(channelCount);
+            size_t fullTotal = 0;
+            for (auto precision: {SamplerPrecision::full, SamplerPrecision::compact}) {
+                auto usage = measureUsage(sampleRate, channels, preset, precision, chunkFrames);
+                const auto &stretch = usage.stretch;
+                size_t other = stretch.object + stretch.rotations + stretch.frequencyMap + stretch.scratch + usage.sampler;
+                if (precision == SamplerPrecision::full) fullTotal = usage.total();
+
+                std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(9) << presetName << std::setw(4) << channels
+                          << std::setw(9) << (precision == SamplerPrecision::full ? "full" : "compact")
+                          << std::setw(10) << kib(stretch.stft) << std::setw(10) << kib(stretch.inputHistory)
+                          << std::setw(10) << kib(stretch.bands) << std::setw(10) << kib(stretch.previousBands)
+                          << std::setw(12) << kib(stretch.predictions) << std::setw(10) << kib(other)
+                          << std::setw(10) << kib(usage.playbackBuffers) << std::setw(10) << kib(usage.total());
+                if (precision == SamplerPrecision::compact) {
+                    std::cout << std::setprecision(1) << 100.0 * (1 - static_cast<double>(usage.total()) / static_cast<double>(fullTotal)) << "%";
+                }
+                std::cout << "\n";
+            }
+        }
+    }
+
+    // Rounding the input itself to bfloat16 is an inaudible change, and shows how far any perturbation moves the output
+    std::cout << "\n" << std::left << std::setw(26) << "compact quality" << std::setw(18) << "spectral SNR (dB)" << "bf16 input reference (dB)\n";
+    bool passed = true;
+    struct Case {
+        const char *signal;
+        double speed;
+        float semitones;
+    };
+    for (const auto &test: {Case{"speech", 0.75, 0}, Case{"speech", 1.5, 0}, Case{"music", 0.75, 0}, Case{"music", 1.5, 0},
+                            Case{"music", 2.5, 0}, Case{"music", 1, 3}}) {
+        constexpr uint32_t channels = 2;
+        auto input = std::string(test.signal) == "speech" ? signals::speech(sampleRate, channels, sampleRate * 2) : signals::music(sampleRate, channels, sampleRate * 2);
+        auto roundedInput = input;
+        for (auto &sample: roundedInput) sample = signalsmith::perf::fromBf16(signalsmith::perf::toBf16(sample));
+
+        auto reference = render(input, sampleRate, channels, test.speed, test.semitones, false);
+        double snr = spectralSnr(reference, render(input, sampleRate, channels, test.speed, test.semitones, true));
+        double referenceSnr = spectralSnr(reference, render(roundedInput, sampleRate, channels, test.speed, test.semitones, false));
+
+        std::ostringstream name;
+        name << test.signal << ".x" << test.speed;
+        if (test.semitones != 0) name << ".transpose" << test.semitones;
+        std::cout << std::left << std::setw(26) << name.str() << std::setprecision(1) << std::setw(18) << snr << referenceSnr
+                  << (snr < referenceSnr - margin ? "  FAIL" : "") << "\n";
+        passed = passed && snr >= referenceSnr - margin;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    enum class Approach {
+        continuous, restart, pause
+    };
+
+    struct PauseResult {
+        std::vector<float> output, content;
+        // Device output frames at the pause and resume requests, and content frames played before the resume
+        uint64_t pauseFrame = 0, resumeFrame = 0, resumeContent = 0;
+        uint64_t starts = 0;
+    };
+
+    PauseResult render(Approach approach, const std::vector<float> &piece, uint64_t position, uint32_t sampleRate,
+                       uint32_t channels, double speed, uint64_t chunkFrames, uint64_t period, uint64_t queueFrames,
+                       uint64_t fadeFrames, uint64_t holdFrames) {
+        auto *device = new SimulatedDevice(channels, sampleRate, period, queueFrames, fadeFrames);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(device));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        PauseResult result;
+        playRange(sampler, piece, channels, 0, chunkFrames, position);
+        result.pauseFrame = device->output.size() / channels;
+
+        switch (approach) {
+            case Approach::continuous:
+                break;
+            case Approach::restart:
+                // The usual approach: stop the device (which plays out its queue), later start from a reset stretcher
+                sampler.stop();
+                sampler.start();
+                break;
+            case Approach::pause:
+                sampler.pause();
+                for (uint64_t held = 0; held < holdFrames; held += period) device->tick();
+                sampler.resume();
+                break;
+        }
+        result.resumeFrame = device->output.size() / channels;
+        result.resumeContent = device->content.size() / channels;
+
+        playRange(sampler, piece, channels, position, chunkFrames);
+        sampler.stop();
+
+        result.output = std::move(device->output);
+        result.content = std::move(device->content);
+        result.starts = device->starts;
+        return result;
+    }
+
+    // Frames from `from` until the output falls silent for good (or the end of the hold)
+    uint64_t silenceAfter(const std::vector<float> &output, uint64_t from, uint64_t to, uint32_t channels) {
+        uint64_t last = from;
+        for (uint64_t i = from; i < to; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                if (output[i * channels + c] != 0) last = i + 1;
+            }
+        }
+        return last - from;
+    }
+}
+
+int runPause(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto period = static_cast<uint64_t>(options.getDouble("period", 256));
+    auto queueFrames = static_cast<uint64_t>(options.getDouble("queue-ms", 100) * sampleRate / 1000);
+    auto speeds = options.getDoubles("speeds", "0.5,1,2");
+    uint64_t fadeFrames = sampleRate / 200, holdFrames = sampleRate / 5, block = sampleRate / 1000;
+
+    auto piece = signals::music(sampleRate, channels, sampleRate * 4);
+    uint64_t position = sampleRate * 2;
+
+    std::cout << std::left << std::setw(8) << "speed" << std::setw(12) << "approach" << std::setw(18) << "pause-to-silence"
+              << std::setw(18) << "resume-to-audible" << std::setw(16) << "position error" << "device starts\n";
+
+    bool passed = true;
+    for (double speed: speeds) {
+        auto reference = render(Approach::continuous, piece, position, sampleRate, channels, speed, chunkFrames, period,
+                                queueFrames, fadeFrames, holdFrames);
+        uint64_t referenceFrames = reference.content.size() / channels;
+
+        for (auto approach: {Approach::restart, Approach::pause}) {
+            auto result = render(approach, piece, position, sampleRate, channels, speed, chunkFrames, period, queueFrames,
+                                 fadeFrames, holdFrames);
+
+            uint64_t silence = silenceAfter(result.output, result.pauseFrame, result.resumeFrame, channels);
+
+            // Audible once a 1 ms block is within 6 dB of what the continuous rendering plays at that point of the piece
+            uint64_t ramp = 0;
+            while (ramp < sampleRate && blockRms(result.output, result.resumeFrame + ramp, block, channels) <
+                                        0.5 * blockRms(reference.content, result.resumeContent + ramp, block, channels)) {
+                ramp += block;
+            }
+
+            // Pausing must not skip or repeat anything: only the faded frames may differ from the continuous rendering
+            auto positionError = static_cast<int64_t>(result.content.size() / channels) - static_cast<int64_t>(referenceFrames);
+            uint64_t changed = 0;
+            for (uint64_t i = 0; i < std::min<uint64_t>(referenceFrames, result.content.size() / channels); ++i) {
+                for (uint32_t c = 0; c < channels; ++c) {
+                    if (result.content[i * channels + c] != reference.content[i * channels + c]) {
+                        ++changed;
+                        break;
+                    }
+                }
+            }
+
+            double silenceMs = static_cast<double>(silence) * 1000 / sampleRate;
+            double rampMs = static_cast<double>(ramp) * 1000 / sampleRate;
+            bool pausing = approach == Approach::pause;
+
+            std::cout << std::setw(8) << speed << std::setw(12) << (pausing ? "pause" : "restart") << std::fixed
+                      << std::setprecision(2) << std::setw(18) << silenceMs << std::setw(18) << rampMs << std::defaultfloat
+                      << std::setw(16) << positionError << result.starts << "\n";
+
+            if (pausing && (positionError != 0 || changed > 2 * fadeFrames || silence > fadeFrames + period || ramp > fadeFrames || result.starts != 1)) {
+                std::cout << "FAIL  pause/resume at speed " << speed << "\n";
+                passed = false;
+            }
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+#include "stretch/stretch.h"
+
+namespace {
+    struct PitchResult {
+        double nanosPerFrame = 0;
+        // Mean per hop, only recorded with -DKLARITY_SAMPLER_PROFILING=ON
+        double findPeaksMicros = 0;
+        double outputMapMicros = 0;
+    };
+
+    double meanMicros(const ProfileHistogram &histogram) {
+        return histogram.count ? static_cast<double>(histogram.totalNanos) / static_cast<double>(histogram.count) / 1e3 : 0;
+    }
+
+    PitchResult measure(const std::vector<float> &signal, uint32_t sampleRate, uint32_t channels, uint64_t chunkFrames,
+                        double semitones, double tonalityLimit) {
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.setPitchSemitones(static_cast<float>(semitones), static_cast<float>(tonalityLimit));
+        sampler.start();
+
+        uint64_t frames = signal.size() / channels;
+        uint64_t start = nowNanos();
+        for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+            uint64_t count = std::min(chunkFrames, frames - offset);
+            sampler.play(reinterpret_cast<const uint8_t *>(signal.data() + offset * channels), count * channels * sizeof(float));
+        }
+
+        PitchResult result;
+        result.nanosPerFrame = static_cast<double>(nowNanos() - start) / static_cast<double>(frames);
+        auto stats = sampler.getProfileStats();
+        result.findPeaksMicros = meanMicros(stats[ProfileStage::findPeaks]);
+        result.outputMapMicros = meanMicros(stats[ProfileStage::updateOutputMap]);
+        sampler.stop();
+        return result;
+    }
+
+    // Frequency of a steady tone from its upward zero crossings from frame `from`, skipping the stretcher's ramp-up
+    double toneFrequency(const std::vector<float> &samples, uint64_t from, uint32_t channels, uint32_t sampleRate) {
+        uint64_t frames = samples.size() / channels;
+        uint64_t first = 0, last = 0, crossings = 0;
+        for (uint64_t i = from + sampleRate / 2; i < frames; ++i) {
+            if (samples[(i - 1) * channels] < 0 && samples[i * channels] >= 0) {
+                if (crossings++ == 0) first = i;
+                last = i;
+            }
+        }
+        return crossings > 1 ? static_cast<double>(crossings - 1) * sampleRate / static_cast<double>(last - first) : 0;
+    }
+
+    // Pulls frequencies (in cycles per sample) towards the nearest equal-tempered semitone, smoothly enough to stay monotonic
+    struct KeyCorrection {
+        float sampleRate = 48000;
+        float strength = 0.8f;
+
+        float operator()(float frequency) const {
+            float semitones = 12 * std::log2(frequency * sampleRate / 440);
+            float pulled = semitones - strength * std::sin(2 * static_cast<float>(M_PI) * semitones) / (2 * static_cast<float>(M_PI));
+            return 440 * std::exp2(pulled / 12) / sampleRate;
+        }
+    };
+
+    struct MapResult {
+        double nanosPerFrame = 0;
+        double findPeaksMicros = 0;
+        std::vector<std::vector<float>> output;
+    };
+
+    // Stretches planar `input` at unity speed, with the map already set on `stretch`
+    template<class Stretch>
+    MapResult stretchMapped(Stretch &stretch, const std::vector<std::vector<float>> &input, uint32_t sampleRate, uint64_t chunkFrames) {
+        auto channels = static_cast<int>(input.size());
+        auto frames = static_cast<int>(input[0].size());
+        stretch.presetDefault(channels, static_cast<float>(sampleRate));
+
+        MapResult result;
+        result.output.assign(channels, std::vector<float>(frames));
+        std::vector<const float *> inputs(channels);
+        std::vector<float *> outputs(channels);
+
+        ProfileStats stats;
+        KLARITY_PROFILE_BIND(stats);
+        uint64_t start = nowNanos();
+        for (int offset = 0; offset < frames; offset += static_cast<int>(chunkFrames)) {
+            int count = std::min(static_cast<int>(chunkFrames), frames - offset);
+            for (int c = 0; c < channels; ++c) {
+                inputs[c] = input[c].data() + offset;
+                outputs[c] = result.output[c].data() + offset;
+            }
+            stretch.process(inputs, count, outputs, count);
+        }
+        result.nanosPerFrame = static_cast<double>(nowNanos() - start) / frames;
+        result.findPeaksMicros = meanMicros(stats[ProfileStage::findPeaks]);
+        return result;
+    }
+
+    // Where each way of setting `correction` puts a steady tone of `hz`, as {function, table, functor}
+    std::vector<double> correctedTone(const KeyCorrection &correction, double hz, uint32_t sampleRate) {
+        std::vector<std::vector<float>> tone(1, std::vector<float>(2 * sampleRate));
+        for (size_t i = 0; i < tone[0].size(); ++i) {
+            tone[0][i] = 0.5f * static_cast<float>(std::sin(2 * M_PI * hz * static_cast<double>(i) / sampleRate));
+        }
+
+        signalsmith::stretch::SignalsmithStretch<float> function(1), table(1);
+        signalsmith::stretch::SignalsmithStretch<float, KeyCorrection> functor(1);
+        function.setFreqMap(correction);
+        table.setFreqMap(correction, true);
+        functor.setFreqMap(correction);
+        return {
+                toneFrequency(stretchMapped(function, tone, sampleRate, 1024).output[0], 0, 1, sampleRate),
+                toneFrequency(stretchMapped(table, tone, sampleRate, 1024).output[0], 0, 1, sampleRate),
+                toneFrequency(stretchMapped(functor, tone, sampleRate, 1024).output[0], 0, 1, sampleRate)
+        };
+    }
+
+    // Largest difference between two renderings
+    double maxDifference(const std::vector<std::vector<float>> &a, const std::vector<std::vector<float>> &b) {
+        double difference = 0;
+        for (size_t c = 0; c < a.size(); ++c) {
+            for (size_t i = 0; i < a[c].size(); ++i) difference = std::max(difference, static_cast<double>(std::abs(a[c][i] - b[c][i])));
+        }
+        return difference;
+    }
+
+    double renderedTone(Sampler &sampler, CaptureSink &sink, const std::vector<float> &tone, uint32_t channels, uint32_t sampleRate) {
+        // The sink keeps everything heard, so this rendering starts where the last one ended
+        uint64_t from = sink.samples.size() / channels;
+        sampler.start();
+        sampler.play(reinterpret_cast<const uint8_t *>(tone.data()), tone.size() * sizeof(float));
+        sampler.stop();
+        return toneFrequency(sink.samples, from, channels, sampleRate);
+    }
+}
+
+int runPitch(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto seconds = options.getDouble("seconds", 10);
+    auto semitoneList = options.getDoubles("semitones", "0,3,-5,12");
+    auto tonalityLimit = options.getDouble("tonality-hz", 0);
+    int repeats = static_cast<int>(options.getDouble("repeats", 3));
+    auto signalNames = options.getList("signals", "speech,music");
+
+    bool passed = true;
+    auto frames = static_cast<uint64_t>(seconds * sampleRate);
+
+    std::cout << std::left << std::setw(10) << "signal" << std::setw(11) << "semitones" << std::setw(12) << "ns/frame"
+              << std::setw(12) << "vs unity" << "findPeaks/updateOutputMap us per hop\n";
+    for (const auto &name: signalNames) {
+        auto signal = name == "music" ? signals::music(sampleRate, channels, frames) : signals::speech(sampleRate, channels, frames);
+
+        double unity = 0;
+        for (double semitones: semitoneList) {
+            std::vector<double> nanos;
+            PitchResult result;
+            for (int r = 0; r < repeats; ++r) {
+                result = measure(signal, sampleRate, channels, chunkFrames, semitones, tonalityLimit);
+                nanos.push_back(result.nanosPerFrame);
+            }
+            double median = percentile(nanos, 0.5);
+            if (semitones == 0) unity = median;
+
+            std::ostringstream relative;
+            if (semitones != 0 && unity > 0) {
+                relative << std::showpos << std::lround((median / unity - 1) * 100) << "%";
+            } else {
+                relative << "-";
+            }
+
+            std::cout << std::setw(10) << name << std::setw(11) << semitones << std::fixed << std::setprecision(1)
+                      << std::setw(12) << median << std::setw(12) << relative.str();
+            if (result.findPeaksMicros > 0) std::cout << result.findPeaksMicros << "/" << result.outputMapMicros;
+            std::cout << std::defaultfloat << std::setprecision(6) << "\n";
+        }
+    }
+
+    /*
+     * A key-correction curve set on the stretcher three ways: as a `std::function` called for every peak of every hop,
+     * sampled once per band into a table, and as a functor type called inline
+     */
+    {
+        auto interleaved = signals::music(sampleRate, channels, frames);
+        std::vector<std::vector<float>> input(channels, std::vector<float>(frames));
+        for (uint64_t i = 0; i < frames; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) input[c][i] = interleaved[i * channels + c];
+        }
+        KeyCorrection correction{static_cast<float>(sampleRate)};
+
+        std::vector<double> functionNanos, tableNanos, functorNanos;
+        MapResult function, table, functor;
+        for (int r = 0; r < repeats; ++r) {
+            // Seeded alike, so the function and functor renderings can be compared sample for sample
+            signalsmith::stretch::SignalsmithStretch<float> functionStretch(1);
+            functionStretch.setFreqMap(correction);
+            function = stretchMapped(functionStretch, input, sampleRate, chunkFrames);
+            functionNanos.push_back(function.nanosPerFrame);
+
+            signalsmith::stretch::SignalsmithStretch<float> tableStretch(1);
+            tableStretch.setFreqMap(correction, true);
+            table = stretchMapped(tableStretch, input, sampleRate, chunkFrames);
+            tableNanos.push_back(table.nanosPerFrame);
+
+            signalsmith::stretch::SignalsmithStretch<float, KeyCorrection> functorStretch(1);
+            functorStretch.setFreqMap(correction);
+            functor = stretchMapped(functorStretch, input, sampleRate, chunkFrames);
+            functorNanos.push_back(functor.nanosPerFrame);
+        }
+
+        // 450 Hz lies between A4 and A#4, and is pulled towards A4
+        auto tones = correctedTone(correction, 450, sampleRate);
+        double expected = correction(450.0f / static_cast<float>(sampleRate)) * sampleRate;
+
+        std::cout << "\n" << std::setw(10) << "map" << std::setw(12) << "ns/frame" << std::setw(16) << "450 Hz tone"
+                  << "findPeaks us per hop\n";
+        std::vector<std::pair<const char *, const MapResult *>> rows = {{"function", &function}, {"table", &table}, {"functor", &functor}};
+        std::vector<const std::vector<double> *> rowNanos = {&functionNanos, &tableNanos, &functorNanos};
+        for (size_t i = 0; i < rows.size(); ++i) {
+            std::cout << std::setw(10) << rows[i].first << std::fixed << std::setprecision(1) << std::setw(12)
+                      << percentile(*rowNanos[i], 0.5) << std::setw(16) << tones[i];
+            if (rows[i].second->findPeaksMicros > 0) std::cout << rows[i].second->findPeaksMicros;
+            std::cout << std::defaultfloat << std::setprecision(6) << "\n";
+
+            if (std::abs(tones[i] / expected - 1) > 0.005) {
+                std::cout << "FAIL  " << rows[i].first << " map moved 450 Hz to " << tones[i] << " Hz, expected " << expected << "\n";
+                passed = false;
+            }
+        }
+        double functorDifference = maxDifference(function.output, functor.output);
+        if (functorDifference > 1e-4) {
+            std::cout << "FAIL  functor rendering differs from the std::function one by " << functorDifference << "\n";
+            passed = false;
+        }
+    }
+
+    // A 440 Hz tone comes out an octave up, and at its own pitch again once the sampler is reset
+    {
+        std::vector<float> tone(static_cast<size_t>(2 * sampleRate) * channels);
+        for (size_t i = 0; i < tone.size() / channels; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                tone[i * channels + c] = 0.5f * static_cast<float>(std::sin(2 * M_PI * 440 * static_cast<double>(i) / sampleRate));
+            }
+        }
+
+        auto *sink = new CaptureSink(channels, 0, sampleRate);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPitchSemitones(12);
+        double shifted = renderedTone(sampler, *sink, tone, channels, sampleRate);
+        sampler.reset();
+        double restored = renderedTone(sampler, *sink, tone, channels, sampleRate);
+
+        std::cout << "\n440 Hz tone: " << std::fixed << std::setprecision(1) << shifted << " Hz at +12 semitones, " << restored
+                  << " Hz after reset\n" << std::defaultfloat << std::setprecision(6);
+        if (std::abs(shifted / 880 - 1) > 0.01 || std::abs(restored / 440 - 1) > 0.01) {
+            std::cout << "FAIL  transposed tone frequency\n";
+            passed = false;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+#include "bench.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    struct PlaybackResult {
+        std::string signal;
+        std::string preset;
+        std::string memory;
+        double speed;
+        uint32_t channels;
+        uint64_t chunkFrames;
+        uint64_t calls;
+        double realTimeFactor;
+        double p50Micros;
+        double p99Micros;
+        double maxMicros;
+        double allocationsPerCall;
+        uint64_t constructionAllocations;
+    };
+
+    std::vector<float> makeSignal(const Options &options, const std::string &name, uint32_t sampleRate, uint32_t channels, uint64_t frames) {
+        if (name == "speech") return signals::speech(sampleRate, channels, frames);
+        if (name == "music") return signals::music(sampleRate, channels, frames);
+        if (name == "silence") return signals::silence(sampleRate, channels, frames);
+        if (name == "transients") return signals::transients(sampleRate, channels, frames);
+        if (name == "file") {
+            auto fileChannels = static_cast<uint32_t>(options.getDouble("input-channels", 1));
+            return signals::file(options.get("input", ""), fileChannels, channels, frames);
+        }
+        throw SamplerException("Unknown signal: " + name);
+    }
+
+    SamplerPreset parsePreset(const std::string &name) {
+        if (name == "standard") return SamplerPreset::standard;
+        if (name == "cheaper") return SamplerPreset::cheaper;
+        throw SamplerException("Unknown preset: " + name);
+    }
+
+    SamplerMemory parseMemory(const std::string &name) {
+        if (name == "heap") return SamplerMemory::heap;
+        if (name == "arena") return SamplerMemory::arena;
+        throw SamplerException("Unknown memory mode: " + name);
+    }
+
+    PlaybackResult measure(const std::vector<float> &signal, uint32_t sampleRate, uint32_t channels, SamplerPreset preset, SamplerMemory memory, double speed, uint64_t chunkFrames, uint64_t warmupFrames) {
+        auto sink = std::make_unique<NullSink>();
+        uint64_t constructionBefore = allocationCount();
+        Sampler sampler(sampleRate, channels, preset, std::move(sink), memory);
+        uint64_t constructionAllocations = allocationCount() - constructionBefore;
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        uint64_t totalFrames = signal.size() / channels;
+        std::vector<uint64_t> latencies;
+        uint64_t measuredFrames = 0, measuredNanos = 0, measuredAllocations = 0;
+
+        for (uint64_t offset = 0; offset + chunkFrames <= totalFrames; offset += chunkFrames) {
+            auto bytes = reinterpret_cast<const uint8_t *>(signal.data() + offset * channels);
+            uint64_t size = chunkFrames * channels * sizeof(float);
+
+            uint64_t allocationsBefore = allocationCount();
+            uint64_t start = nowNanos();
+            sampler.play(bytes, size);
+            uint64_t elapsed = nowNanos() - start;
+            uint64_t allocated = allocationCount() - allocationsBefore;
+
+            if (offset < warmupFrames) continue;
+            latencies.push_back(elapsed);
+            measuredFrames += chunkFrames;
+            measuredNanos += elapsed;
+            measuredAllocations += allocated;
+        }
+
+        sampler.stop();
+
+        PlaybackResult result{};
+        result.speed = speed;
+        result.channels = channels;
+        result.chunkFrames = chunkFrames;
+        result.calls = latencies.size();
+        result.realTimeFactor = measuredNanos ? (static_cast<double>(measuredFrames) / sampleRate) / (static_cast<double>(measuredNanos) * 1e-9) : 0;
+        result.p50Micros = static_cast<double>(percentile(latencies, 0.5)) * 1e-3;
+        result.p99Micros = static_cast<double>(percentile(latencies, 0.99)) * 1e-3;
+        result.maxMicros = latencies.empty() ? 0 : static_cast<double>(*std::max_element(latencies.begin(), latencies.end())) * 1e-3;
+        result.allocationsPerCall = latencies.empty() ? 0 : static_cast<double>(measuredAllocations) / static_cast<double>(latencies.size());
+        result.constructionAllocations = constructionAllocations;
+        return result;
+    }
+
+    void writeJson(std::ostream &output, uint32_t sampleRate, const std::vector<PlaybackResult> &results) {
+        JsonWriter json(output);
+        json.beginObject();
+        json.value("benchmark", "playback");
+        json.value("sampleRate", sampleRate);
+        json.value("isa", KernelDispatch::isa());
+        json.beginArray("results");
+        for (const auto &result: results) {
+            json.beginObject();
+            json.value("signal", result.signal);
+            json.value("preset", result.preset);
+            json.value("memory", result.memory);
+            json.value("speed", result.speed);
+            json.value("channels", result.channels);
+            json.value("chunkFrames", static_cast<double>(result.chunkFrames));
+            json.value("calls", static_cast<double>(result.calls));
+            json.value("realTimeFactor", result.realTimeFactor);
+            json.beginObject("latencyMicros");
+            json.value("p50", result.p50Micros);
+            json.value("p99", result.p99Micros);
+            json.value("max", result.maxMicros);
+            json.endObject();
+            json.value("allocationsPerCall", result.allocationsPerCall);
+            json.value("constructionAllocations", static_cast<double>(result.constructionAllocations));
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        output << std::endl;
+    }
+}
+
+int runPlayback(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    double seconds = options.getDouble("seconds", 4);
+    auto signalNames = options.has("input") ? std::vector<std::string>{"file"} : options.getList("signals", "speech,music,silence,transients");
+    auto speeds = options.getDoubles("speeds", "0.5,1,1.5,2,3");
+    auto channelCounts = options.getDoubles("channels", "1,2,8");
+    auto chunkSizes = options.getDoubles("chunks", "64,1024,65536");
+    auto presets = options.getList("presets", "standard,cheaper");
+    auto memoryModes = options.getList("memory", "heap");
+
+    std::vector<PlaybackResult> results;
+    std::ostream &log = options.get("json", "") == "-" ? std::cerr : std::cout;
+    log << "kernels: " << KernelDispatch::isa() << " (set KLARITY_SAMPLER_ISA to compare)\n";
+    log << std::left << std::setw(11) << "signal" << std::setw(9) << "preset" << std::setw(7) << "memory"
+        << std::setw(6) << "speed" << std::setw(4) << "ch" << std::setw(7) << "chunk" << std::setw(7) << "calls" << std::setw(9) << "rtf"
+        << std::setw(11) << "p50 us" << std::setw(11) << "p99 us" << std::setw(11) << "max us" << std::setw(13) << "allocs/call" << "setup allocs" << std::endl;
+
+    for (const auto &signalName: signalNames) {
+        for (double channelCount: channelCounts) {
+            auto channels = static_cast<uint32_t>(channelCount);
+            for (double chunkSize: chunkSizes) {
+                auto chunkFrames = static_cast<uint64_t>(chunkSize);
+                // At least a second of warm-up, then enough input for several calls
+                uint64_t warmupFrames = std::max<uint64_t>(sampleRate, chunkFrames);
+                uint64_t frames = warmupFrames + std::max<uint64_t>(static_cast<uint64_t>(seconds * sampleRate), chunkFrames * 4);
+                auto signal = makeSignal(options, signalName, sampleRate, channels, frames);
+
+                for (const auto &presetName: presets) {
+                    for (const auto &memoryName: memoryModes) {
+                        for (double speed: speeds) {
+                            auto result = measure(signal, sampleRate, channels, parsePreset(presetName), parseMemory(memoryName), speed, chunkFrames, warmupFrames);
+                            result.signal = signalName;
+                            result.preset = presetName;
+                            result.memory = memoryName;
+                            results.push_back(result);
+
+                            log << std::left << std::setw(11) << result.signal << std::setw(9) << result.preset << std::setw(7) << result.memory
+                                << std::setw(6) << result.speed << std::setw(4) << result.channels << std::setw(7) << result.chunkFrames
+                                << std::setw(7) << result.calls << std::setw(9) << std::setprecision(4) << result.realTimeFactor
+                                << std::setw(11) << result.p50Micros << std::setw(11) << result.p99Micros << std::setw(11) << result.maxMicros
+                                << std::setw(13) << result.allocationsPerCall << result.constructionAllocations << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::string jsonPath = options.get("json", "");
+    if (jsonPath == "-") {
+        writeJson(std::cout, sampleRate, results);
+    } else if (!jsonPath.empty()) {
+        std::ofstream output(jsonPath);
+        if (!output) {
+            throw SamplerException("Unable to open output file: " + jsonPath);
+        }
+        writeJson(output, sampleRate, results);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include "pool.h"
+#include "signals.h"
+
+namespace {
+    // Track request to the end of the first `play`, in microseconds per track
+    std::vector<double> constructPerTrack(const SamplerPoolKey &key, const std::vector<float> &track, uint64_t chunkFrames, int tracks) {
+        std::vector<double> micros;
+        for (int t = 0; t < tracks; ++t) {
+            uint64_t start = nowNanos();
+            Sampler sampler(key.sampleRate, key.channels, key.preset, std::make_unique<NullSink>(), key.memory, key.precision);
+            sampler.start();
+            sampler.play(reinterpret_cast<const uint8_t *>(track.data()), chunkFrames * key.channels * sizeof(float));
+            micros.push_back(static_cast<double>(nowNanos() - start) / 1e3);
+            sampler.stop();
+        }
+        return micros;
+    }
+
+    std::vector<double> pooled(SamplerPool &pool, const SamplerPoolKey &key, const std::vector<float> &track, uint64_t chunkFrames, int tracks) {
+        pool.warm(key, 1);
+        pool.resetStats();
+
+        std::vector<double> micros;
+        uint64_t frames = track.size() / key.channels;
+        for (int t = 0; t < tracks; ++t) {
+            uint64_t start = nowNanos();
+            auto sampler = pool.acquire(key);
+            sampler->start();
+            for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+                uint64_t count = std::min(chunkFrames, frames - offset);
+                sampler->play(reinterpret_cast<const uint8_t *>(track.data() + offset * key.channels), count * key.channels * sizeof(float));
+                if (offset == 0) micros.push_back(static_cast<double>(nowNanos() - start) / 1e3);
+            }
+            pool.release(std::move(sampler));
+        }
+        return micros;
+    }
+}
+
+int runPool(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    int tracks = static_cast<int>(options.getDouble("tracks", 20));
+
+    auto track = signals::music(sampleRate, channels, chunkFrames * 4);
+
+    SamplerPool pool(2, std::chrono::minutes(1), [](uint32_t, uint32_t) { return std::make_unique<NullSink>(); });
+
+    struct Configuration {
+        const char *name;
+        SamplerPreset preset;
+        SamplerMemory memory;
+    };
+    std::vector<Configuration> configurations = {
+            {"standard", SamplerPreset::standard, SamplerMemory::heap},
+            {"standard arena", SamplerPreset::standard, SamplerMemory::arena},
+            {"cheaper", SamplerPreset::cheaper, SamplerMemory::heap}
+    };
+
+    std::cout << std::left << std::setw(16) << "preset" << std::setw(14) << "construct us" << std::setw(12) << "pooled us"
+              << std::setw(14) << "acquire us" << "pool first audio us\n";
+
+    bool passed = true;
+    for (const auto &configuration: configurations) {
+        SamplerPoolKey key{sampleRate, channels, configuration.preset, configuration.memory, SamplerPrecision::full};
+        auto constructed = constructPerTrack(key, track, chunkFrames, tracks);
+        auto reused = pooled(pool, key, track, chunkFrames, tracks);
+
+        // Means of the pool's own metrics
+        auto stats = pool.getStats();
+        double acquireMicros = static_cast<double>(stats.acquire.totalNanos) / static_cast<double>(std::max<uint64_t>(1, stats.acquire.count)) / 1e3;
+        double firstAudioMicros = static_cast<double>(stats.firstAudio.totalNanos) / static_cast<double>(std::max<uint64_t>(1, stats.firstAudio.count)) / 1e3;
+
+        std::cout << std::setw(16) << configuration.name << std::fixed << std::setprecision(1) << std::setw(14)
+                  << percentile(constructed, 0.5) << std::setw(12) << percentile(reused, 0.5) << std::setw(14) << acquireMicros
+                  << firstAudioMicros << std::defaultfloat << "\n";
+
+        // Once warm, every track reuses the same sampler
+        if (stats.misses != 0 || stats.acquisitions != static_cast<uint64_t>(tracks) || stats.firstAudio.count != static_cast<uint64_t>(tracks)) {
+            std::cout << "FAIL  " << stats.misses << " of " << stats.acquisitions << " acquisitions constructed a sampler\n";
+            passed = false;
+        }
+    }
+
+    // Three keys are idle now; nothing is trimmed within the timeout, everything past it
+    auto before = pool.getStats();
+    size_t early = pool.trim();
+    pool.setIdleTimeout(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    size_t late = pool.trim();
+    std::cout << "\nidle " << before.idle << ", trimmed " << early << " within the timeout and " << late << " after it\n";
+    if (early != 0 || late != before.idle || pool.getStats().idle != 0) {
+        std::cout << "FAIL  idle trimming\n";
+        passed = false;
+    }
+
+    // Capacity bounds what a burst of releases leaves idle
+    pool.setIdleTimeout(std::chrono::minutes(1));
+    SamplerPoolKey key{sampleRate, channels};
+    std::vector<std::unique_ptr<Sampler>> leased;
+    for (int i = 0; i < 4; ++i) leased.push_back(pool.acquire(key));
+    for (auto &sampler: leased) pool.release(std::move(sampler));
+    if (pool.getStats().idle != 2) {
+        std::cout << "FAIL  " << pool.getStats().idle << " samplers idle with a capacity of 2\n";
+        passed = false;
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+#include "bench.h"
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    constexpr uint32_t sampleRate = 48000;
+    constexpr uint32_t channels = 2;
+    constexpr long goldenSeed = 12345;
+    constexpr size_t goldenSegments = 64;
+
+    // Median of the repeated measurements, with a distribution-free ~95% confidence interval
+    struct Measurement {
+        double median;
+        double low;
+        double high;
+    };
+
+    Measurement summarise(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        auto n = static_cast<double>(values.size());
+        auto lowRank = static_cast<ptrdiff_t>(std::floor(n / 2 - 0.98 * std::sqrt(n)));
+        auto highRank = static_cast<ptrdiff_t>(std::ceil(n / 2 + 0.98 * std::sqrt(n)));
+        auto last = static_cast<ptrdiff_t>(values.size()) - 1;
+        return Measurement{
+                percentile(values, 0.5),
+                values[static_cast<size_t>(std::clamp<ptrdiff_t>(lowRank, 0, last))],
+                values[static_cast<size_t>(std::clamp<ptrdiff_t>(highRank, 0, last))]
+        };
+    }
+
+    // Nanoseconds per operation, each repetition running for at least `minNanos`
+    Measurement timeOperation(const std::function<void()> &operation, int repeats, uint64_t minNanos = 20'000'000) {
+        uint64_t iterations = 1;
+        while (true) {
+            uint64_t start = nowNanos();
+            for (uint64_t i = 0; i < iterations; ++i) operation();
+            if (nowNanos() - start >= minNanos / 4) break;
+            iterations *= 2;
+        }
+        iterations *= 4;
+
+        std::vector<double> values;
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            uint64_t start = nowNanos();
+            for (uint64_t i = 0; i < iterations; ++i) operation();
+            values.push_back(static_cast<double>(nowNanos() - start) / static_cast<double>(iterations));
+        }
+        return summarise(values);
+    }
+
+    std::vector<std::vector<float>> deinterleave(const std::vector<float> &interleaved, uint32_t channelCount) {
+        std::vector<std::vector<float>> result(channelCount, std::vector<float>(interleaved.size() / channelCount));
+        for (size_t i = 0; i < interleaved.size(); ++i) {
+            result[i % channelCount][i / channelCount] = interleaved[i];
+        }
+        return result;
+    }
+
+    std::vector<std::pair<std::string, Measurement>> runBenchmarks(int repeats) {
+        std::vector<std::pair<std::string, Measurement>> results;
+
+        for (int size: {256, 1024, 4096, 6144}) {
+            signalsmith::fft::ModifiedRealFFT<float> fft(size);
+            std::vector<float> time(size);
+            std::vector<std::complex<float>> spectrum(size / 2);
+            for (int i = 0; i < size; ++i) time[i] = std::sin(static_cast<float>(i) * 0.1f);
+            results.emplace_back("fft." + std::to_string(size), timeOperation([&] {
+                fft.fft(time, spectrum);
+                fft.ifft(spectrum, time);
+            }, repeats));
+        }
+
+        auto input = deinterleave(signals::music(sampleRate, channels, sampleRate * 4), channels);
+
+        {
+            signalsmith::stretch::SignalsmithStretch<float> stretch(goldenSeed);
+            stretch.presetDefault(channels, sampleRate);
+            int interval = stretch.intervalSamples();
+            std::vector<std::vector<float>> output(channels, std::vector<float>(interval));
+            std::vector<const float *> inputs(channels);
+            std::vector<float *> outputs(channels);
+            int offset = 0;
+            results.emplace_back("stretch.hop", timeOperation([&] {
+                if (offset + interval > static_cast<int>(input[0].size())) offset = 0;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    inputs[c] = input[c].data() + offset;
+                    outputs[c] = output[c].data();
+                }
+                stretch.process(inputs, interval, outputs, interval);
+                offset += interval;
+            }, repeats));
+
+            // The spectral step of the last hop on its own, without the FFTs around it
+            results.emplace_back("stretch.processSpectrum", timeOperation([&] {
+                stretch.reprocessSpectrum(1);
+            }, repeats));
+        }
+
+        {
+            signalsmith::stretch::SignalsmithStretch<float> stretch(goldenSeed);
+            stretch.presetDefault(channels, sampleRate);
+            constexpr int chunk = 1024, outputChunk = chunk * 2 / 3;
+            std::vector<std::vector<float>> output(channels, std::vector<float>(chunk));
+            std::vector<const float *> inputs(channels);
+            std::vector<float *> outputs(channels);
+            int offset = 0;
+            results.emplace_back("stretch.process", timeOperation([&] {
+                if (offset + chunk > static_cast<int>(input[0].size())) offset = 0;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    inputs[c] = input[c].data() + offset;
+                    outputs[c] = output[c].data();
+                }
+                stretch.process(inputs, chunk, outputs, outputChunk);
+                offset += chunk;
+            }, repeats));
+        }
+
+        auto speech = signals::speech(sampleRate, channels, sampleRate * 4);
+        for (float speed: {1.0f, 2.0f}) {
+            Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+            sampler.setPlaybackSpeed(speed);
+            sampler.start();
+            constexpr uint64_t chunkFrames = 1024;
+            uint64_t offset = 0;
+            std::ostringstream name;
+            name << "playback.speech.x" << speed;
+            results.emplace_back(name.str(), timeOperation([&] {
+                if ((offset + chunkFrames) * channels > speech.size()) offset = 0;
+                sampler.play(reinterpret_cast<const uint8_t *>(speech.data() + offset * channels), chunkFrames * channels * sizeof(float));
+                offset += chunkFrames;
+            }, repeats));
+            sampler.stop();
+        }
+
+        return results;
+    }
+
+    // RMS envelope of a seeded stretch, which only changes if the processing itself changes
+    std::vector<double> goldenFingerprint(const std::string &signal, double speed, float semitones) {
+        auto interleaved = signal == "speech" ? signals::speech(sampleRate, channels, sampleRate * 2) : signals::music(sampleRate, channels, sampleRate * 2);
+        auto input = deinterleave(interleaved, channels);
+
+        signalsmith::stretch::SignalsmithStretch<float> stretch(goldenSeed);
+        stretch.presetDefault(channels, sampleRate);
+        if (semitones != 0) stretch.setTransposeSemitones(semitones);
+
+        constexpr int chunk = 1024;
+        int outputChunk = static_cast<int>(chunk / speed);
+        std::vector<std::vector<float>> output(channels, std::vector<float>(outputChunk));
+        std::vector<const float *> inputs(channels);
+        std::vector<float *> outputs(channels);
+        std::vector<float> rendered;
+
+        for (size_t offset = 0; offset + chunk <= input[0].size(); offset += chunk) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                inputs[c] = input[c].data() + offset;
+                outputs[c] = output[c].data();
+            }
+            stretch.process(inputs, chunk, outputs, outputChunk);
+            for (int i = 0; i < outputChunk; ++i) {
+                for (uint32_t c = 0; c < channels; ++c) rendered.push_back(output[c][i]);
+            }
+        }
+
+        std::vector<double> fingerprint(goldenSegments, 0);
+        size_t segmentLength = rendered.size() / goldenSegments;
+        for (size_t segment = 0; segment < goldenSegments; ++segment) {
+            double sum = 0;
+            for (size_t i = 0; i < segmentLength; ++i) {
+                double value = rendered[segment * segmentLength + i];
+                sum += value * value;
+            }
+            fingerprint[segment] = std::sqrt(sum / static_cast<double>(segmentLength));
+        }
+        return fingerprint;
+    }
+
+    std::vector<std::pair<std::string, std::vector<double>>> runGolden() {
+        std::vector<std::pair<std::string, std::vector<double>>> results;
+        for (const char *signal: {"speech", "music"}) {
+            for (double speed: {0.75, 1.5, 2.5}) {
+                std::ostringstream name;
+                name << signal << ".x" << speed;
+                results.emplace_back(name.str(), goldenFingerprint(signal, speed, 0));
+            }
+        }
+        // Pitch shifting takes the peak-finding path as well
+        results.emplace_back("music.x1.transpose3", goldenFingerprint("music", 1, 3));
+        results.emplace_back("speech.x1.5.transpose-2", goldenFingerprint("speech", 1.5, -2));
+        return results;
+    }
+
+    void writeBaseline(const std::string &path,
+                       const std::vector<std::pair<std::string, Measurement>> &benchmarks,
+                       const std::vector<std::pair<std::string, std::vector<double>>> &golden) {
+        std::ofstream output(path);
+        if (!output) {
+            throw SamplerException("Unable to open baseline file: " + path);
+        }
+        output << std::setprecision(9);
+        JsonWriter json(output);
+        json.beginObject();
+        json.value("version", 1);
+        json.beginObject("benchmarks");
+        for (const auto &[name, measurement]: benchmarks) {
+            json.beginObject(name);
+            json.value("median", measurement.median);
+            json.value("low", measurement.low);
+            json.value("high", measurement.high);
+            json.endObject();
+        }
+        json.endObject();
+        json.beginObject("golden");
+        for (const auto &[name, fingerprint]: golden) {
+            json.beginArray(name);
+            for (double value: fingerprint) json.value("", value);
+            json.endArray();
+        }
+        json.endObject();
+        json.endObject();
+        output << std::endl;
+    }
+}
+
+int runRegression(const Options &options) {
+    std::string baselinePath = options.get("baseline", "bench/baseline.json");
+    auto repeats = static_cast<int>(options.getDouble("repeats", 9));
+    double threshold = options.getDouble("threshold", 0.15);
+    double goldenTolerance = options.getDouble("golden-tolerance", 1e-3);
+
+    auto benchmarks = runBenchmarks(repeats);
+    auto golden = runGolden();
+
+    if (options.has("update")) {
+        writeBaseline(baselinePath, benchmarks, golden);
+        std::cout << "Wrote baseline " << baselinePath << std::endl;
+        return 0;
+    }
+
+    std::ifstream input(baselinePath);
+    if (!input) {
+        throw SamplerException("Unable to open baseline file: " + baselinePath + " (record one with --update)");
+    }
+    std::stringstream document;
+    document << input.rdbuf();
+    JsonValue baseline = JsonValue::parse(document.str());
+
+    bool failed = false;
+
+    std::cout << std::left << std::setw(26) << "benchmark" << std::setw(14) << "baseline ns" << std::setw(14) << "median ns"
+              << std::setw(26) << "95% CI" << std::setw(10) << "change" << "status" << std::endl;
+    const JsonValue *baselineBenchmarks = baseline.find("benchmarks");
+    for (const auto &[name, measurement]: benchmarks) {
+        const JsonValue *entry = baselineBenchmarks ? baselineBenchmarks->find(name) : nullptr;
+        const JsonValue *baselineMedian = entry ? entry->find("median") : nullptr;
+        std::ostringstream interval;
+        interval << std::fixed << std::setprecision(0) << '[' << measurement.low << ", " << measurement.high << ']';
+        std::cout << std::left << std::setw(26) << name;
+        if (!baselineMedian) {
+            std::cout << std::setw(14) << "-" << std::setw(14) << std::fixed << std::setprecision(0) << measurement.median
+                      << std::setw(26) << interval.str() << std::setw(10) << "-" << "new" << std::endl;
+            continue;
+        }
+        double change = measurement.median / baselineMedian->number - 1;
+        // Only a regression if even the optimistic end of the interval is beyond the threshold
+        bool regressed = measurement.low > baselineMedian->number * (1 + threshold);
+        failed |= regressed;
+        std::ostringstream percent;
+        percent << std::showpos << std::fixed << std::setprecision(1) << change * 100 << '%';
+        std::cout << std::setw(14) << std::fixed << std::setprecision(0) << baselineMedian->number << std::setw(14) << measurement.median
+                  << std::setw(26) << interval.str() << std::setw(10) << percent.str() << (regressed ? "REGRESSED" : "ok") << std::endl;
+    }
+
+    std::cout << std::endl << std::left << std::setw(26) << "golden output" << std::setw(14) << "max deviation" << "status" << std::endl;
+    const JsonValue *baselineGolden = baseline.find("golden");
+    for (const auto &[name, fingerprint]: golden) {
+        const JsonValue *entry = baselineGolden ? baselineGolden->find(name) : nullptr;
+        std::cout << std::left << std::setw(26) << name;
+        if (!entry || entry->array.size() != fingerprint.size()) {
+            std::cout << std::setw(14) << "-" << "new" << std::endl;
+            continue;
+        }
+        double peak = 0, deviation = 0;
+        for (const auto &value: entry->array) peak = std::max(peak, value.number);
+        for (size_t i = 0; i < fingerprint.size(); ++i) {
+            deviation = std::max(deviation, std::abs(fingerprint[i] - entry->array[i].number) / std::max(peak, 1e-12));
+        }
+        bool mismatch = !(deviation <= goldenTolerance);
+        failed |= mismatch;
+        std::cout << std::setw(14) << std::scientific << std::setprecision(2) << deviation << (mismatch ? "MISMATCH" : "ok") << std::endl;
+    }
+
+    return failed ? 1 : 0;
+}
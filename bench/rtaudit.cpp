@@ -0,0 +1,213 @@
+#include "bench.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "sampler.h"
+#include "signals.h"
+
+#ifdef KLARITY_SAMPLER_RT_AUDIT
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    // Performs one allocation, one lock and one sleep, each of which the audit must catch
+    void violate() {
+        static std::mutex mutex;
+
+        auto *value = static_cast<volatile int *>(std::malloc(sizeof(int)));
+        *value = 1;
+        std::free(const_cast<int *>(value));
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::this_thread::sleep_for(std::chrono::microseconds(1));
+    }
+
+    bool expect(bool condition, const std::string &description) {
+        std::cout << (condition ? "ok    " : "FAIL  ") << description << std::endl;
+        return condition;
+    }
+
+    bool checkOffMode() {
+        RealtimeAudit::setMode(RealtimeAudit::Mode::off);
+        RealtimeAudit::clear();
+        {
+            RealtimeSection section;
+            violate();
+        }
+        return expect(RealtimeAudit::violationCount() == 0, "off mode ignores violations");
+    }
+
+    bool checkRecordMode() {
+        RealtimeAudit::setMode(RealtimeAudit::Mode::record);
+        RealtimeAudit::clear();
+        violate();
+        bool passed = expect(RealtimeAudit::violationCount() == 0, "record mode ignores calls outside a section");
+
+        {
+            RealtimeSection section;
+            violate();
+        }
+        auto violations = RealtimeAudit::violations();
+        RealtimeAudit::clear();
+
+        bool allocation = false, lock = false, syscall = false, stacks = !violations.empty();
+        for (const auto &violation: violations) {
+            allocation |= violation.type == RealtimeViolationType::allocation;
+            lock |= violation.type == RealtimeViolationType::lock;
+            syscall |= violation.type == RealtimeViolationType::syscall;
+            stacks &= !violation.stack.empty();
+        }
+
+        passed &= expect(allocation, "record mode catches allocation");
+        passed &= expect(lock, "record mode catches mutex lock");
+        passed &= expect(syscall, "record mode catches sleep");
+        passed &= expect(stacks, "violations carry stack traces");
+        return passed;
+    }
+
+    bool checkAbortMode() {
+        std::cout.flush();
+
+        pid_t child = fork();
+        if (child == 0) {
+            RealtimeAudit::setMode(RealtimeAudit::Mode::abort);
+            RealtimeSection section;
+            violate();
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        return expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "abort mode aborts on first violation");
+    }
+
+    bool checkPlayback(const Options &options) {
+        auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+        auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+        auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+        auto speeds = options.getDoubles("speeds", "0.5,1,2");
+
+        bool passed = true;
+        for (double speed: speeds) {
+            Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+            sampler.setPlaybackSpeed(static_cast<float>(speed));
+            sampler.start();
+
+            auto input = signals::music(sampleRate, channels, sampleRate * 2);
+            auto *data = reinterpret_cast<const uint8_t *>(input.data());
+            uint64_t chunkBytes = chunkFrames * channels * sizeof(float);
+            uint64_t totalBytes = input.size() * sizeof(float);
+
+            // The first calls size the buffers, after which playback must stay within its section budget
+            sampler.play(data, chunkBytes);
+
+            RealtimeAudit::setMode(RealtimeAudit::Mode::record);
+            RealtimeAudit::clear();
+            for (uint64_t offset = chunkBytes; offset + chunkBytes <= totalBytes; offset += chunkBytes) {
+                sampler.play(data + offset, chunkBytes);
+            }
+            uint64_t count = RealtimeAudit::violationCount();
+
+            for (const auto &violation: RealtimeAudit::violations()) {
+                std::cout << "      " << violation.function << "\n";
+                for (const auto &frame: violation.stack) std::cout << "        " << frame << "\n";
+            }
+            RealtimeAudit::clear();
+
+            sampler.stop();
+
+            std::ostringstream description;
+            description << "steady-state playback at x" << speed << " is real-time safe";
+            passed &= expect(count == 0, description.str());
+        }
+        return passed;
+    }
+
+    bool checkLoop(const Options &options) {
+        auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+        auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+        uint32_t sampleRate = 48000;
+
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.setPlaybackSpeed(0.75f);
+        sampler.start();
+
+        auto segment = signals::speech(sampleRate, channels, sampleRate);
+        sampler.startLoop(reinterpret_cast<const uint8_t *>(segment.data()), segment.size() * sizeof(float), sampleRate / 50);
+        sampler.playLoop(chunkFrames);
+
+        // Several passes, so the wraparound is covered too
+        RealtimeAudit::setMode(RealtimeAudit::Mode::record);
+        RealtimeAudit::clear();
+        for (uint64_t played = 0; played < sampleRate * 3; played += chunkFrames) {
+            sampler.playLoop(chunkFrames);
+        }
+        uint64_t count = RealtimeAudit::violationCount();
+        RealtimeAudit::clear();
+
+        sampler.stop();
+
+        return expect(count == 0, "steady-state loop playback is real-time safe");
+    }
+
+    bool checkCache(const Options &options) {
+        auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+        auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+        uint32_t sampleRate = 48000;
+
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+        sampler.setCacheLimit(64 * 1024 * 1024);
+        sampler.start();
+
+        auto piece = signals::speech(sampleRate, channels, sampleRate * 2);
+        auto *data = reinterpret_cast<const uint8_t *>(piece.data());
+        uint64_t head = std::max(sampler.getPreRollFrames(), chunkFrames);
+        uint64_t frameBytes = channels * sizeof(float);
+
+        // The first replay fills the cache, the second one is served from it
+        for (int replay = 0; replay < 2; ++replay) {
+            sampler.seek(nullptr, 0, data, head * frameBytes);
+            if (replay == 1) {
+                RealtimeAudit::setMode(RealtimeAudit::Mode::record);
+                RealtimeAudit::clear();
+            }
+            for (uint64_t offset = head; offset + chunkFrames <= sampleRate * 2; offset += chunkFrames) {
+                sampler.play(data + offset * frameBytes, chunkFrames * frameBytes);
+            }
+        }
+        uint64_t count = RealtimeAudit::violationCount();
+        RealtimeAudit::clear();
+        bool served = sampler.getCacheStats().hits > 0;
+
+        sampler.stop();
+
+        return expect(served && count == 0, "playback served from the render cache is real-time safe");
+    }
+}
+
+int runRealtimeAudit(const Options &options) {
+    bool passed = checkOffMode();
+    passed &= checkRecordMode();
+    passed &= checkAbortMode();
+    passed &= checkPlayback(options);
+    passed &= checkLoop(options);
+    passed &= checkCache(options);
+
+    RealtimeAudit::setMode(RealtimeAudit::Mode::off);
+
+    return passed ? 0 : 1;
+}
+
+#else
+
+int runRealtimeAudit(const Options &) {
+    std::cerr << "klarity_bench: rt-audit requires a build with KLARITY_SAMPLER_RT_AUDIT=ON" << std::endl;
+    return 2;
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    struct ScheduleResult {
+        std::vector<float> output;
+        // Where writing each event through `play` would have put it, in frames from its target
+        std::vector<int64_t> playErrors;
+        uint64_t late = 0;
+    };
+
+    /*
+     * Plays `piece` through a simulated device and places `burst` at each of `targets`: scheduled `lead` frames ahead
+     * (every other one by stream time), or not at all, which is the reference without events
+     */
+    ScheduleResult render(bool scheduled, const std::vector<float> &piece, const std::vector<float> &burst,
+                          const std::vector<uint64_t> &targets, uint32_t sampleRate, uint32_t channels, double speed,
+                          uint64_t chunkFrames, uint64_t period, uint64_t queueFrames, uint64_t lead) {
+        auto *device = new SimulatedDevice(channels, sampleRate, period, queueFrames, sampleRate / 200);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(device));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        auto *burstData = reinterpret_cast<const uint8_t *>(burst.data());
+        uint64_t burstBytes = burst.size() * sizeof(float);
+
+        ScheduleResult result;
+        std::vector<bool> issued(targets.size()), estimated(targets.size());
+        auto *data = reinterpret_cast<const uint8_t *>(piece.data());
+        uint64_t frames = piece.size() / channels;
+        for (uint64_t offset = 0; offset < frames; offset += chunkFrames) {
+            uint64_t position = sampler.getStreamFrame();
+            for (size_t e = 0; e < targets.size(); ++e) {
+                // The usual approach writes the event when the queue's nominal latency says it would land on time
+                if (!estimated[e] && position + queueFrames >= targets[e]) {
+                    result.playErrors.push_back(static_cast<int64_t>(position + device->queue.size()) - static_cast<int64_t>(targets[e]));
+                    estimated[e] = true;
+                }
+                if (scheduled && !issued[e] && position + lead >= targets[e]) {
+                    if (e % 2 == 0) {
+                        sampler.scheduleAtFrame(burstData, burstBytes, targets[e]);
+                    } else {
+                        sampler.scheduleAtTime(burstData, burstBytes, static_cast<double>(targets[e]) / sampleRate);
+                    }
+                    issued[e] = true;
+                }
+            }
+            uint64_t count = std::min(chunkFrames, frames - offset);
+            sampler.play(data + offset * channels * sizeof(float), count * channels * sizeof(float));
+        }
+        sampler.stop();
+
+        result.output = std::move(device->output);
+        result.late = device->queue.lateEvents();
+        return result;
+    }
+
+    // The burst as the sampler renders an event, from a device-less capture
+    std::vector<float> renderBurst(const std::vector<float> &burst, uint32_t sampleRate, uint32_t channels, double speed) {
+        auto *sink = new CaptureSink(channels, 0, sampleRate);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+        sampler.scheduleAtFrame(reinterpret_cast<const uint8_t *>(burst.data()), burst.size() * sizeof(float), 0);
+        auto rendered = sink->samples;
+        sampler.stop();
+        return rendered;
+    }
+
+    // First frame louder than a thousandth of the peak
+    uint64_t onset(const std::vector<float> &samples, uint64_t from, uint64_t to, uint32_t channels) {
+        double peak = 0;
+        for (uint64_t i = from * channels; i < std::min<uint64_t>(samples.size(), to * channels); ++i) peak = std::max(peak, std::abs(static_cast<double>(samples[i])));
+        for (uint64_t i = from * channels; i < std::min<uint64_t>(samples.size(), to * channels); ++i) {
+            if (std::abs(samples[i]) > peak * 1e-3) return i / channels;
+        }
+        return to;
+    }
+
+    // Device-side cost of one period with `events` events pending further down the timeline
+    double periodNanos(uint32_t sampleRate, uint32_t channels, uint64_t period, size_t events) {
+        DeviceQueue queue(channels, sampleRate, period * 4, sampleRate / 200);
+        for (size_t e = 0; e < events; ++e) {
+            auto event = std::make_unique<TimelineEvent>();
+            event->samples.assign(period * channels, 0.1f);
+            event->frame = UINT64_MAX / 2;
+            queue.schedule(std::move(event));
+        }
+
+        std::vector<float> output(period * channels);
+        std::vector<float> input(period * channels, 0.1f);
+        uint64_t periods = 20000, elapsed = 0;
+        for (uint64_t p = 0; p < periods; ++p) {
+            queue.write(input.data(), period);
+            uint64_t start = nowNanos();
+            queue.render(output.data(), period);
+            elapsed += nowNanos() - start;
+        }
+        return static_cast<double>(elapsed) / static_cast<double>(periods);
+    }
+}
+
+int runSchedule(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto period = static_cast<uint64_t>(options.getDouble("period", 256));
+    auto queueFrames = static_cast<uint64_t>(options.getDouble("queue-ms", 100) * sampleRate / 1000);
+    auto lead = static_cast<uint64_t>(options.getDouble("lead-ms", 50) * sampleRate / 1000);
+    auto speeds = options.getDoubles("speeds", "0.75,1,1.5");
+    int count = static_cast<int>(options.getDouble("events", 8));
+
+    auto piece = signals::music(sampleRate, channels, sampleRate * 4);
+
+    // A 40 ms decaying 1 kHz burst, a typical UI sound with a sharp onset
+    std::vector<float> burst(sampleRate / 25 * channels);
+    for (uint64_t i = 0; i < burst.size() / channels; ++i) {
+        double t = static_cast<double>(i) / sampleRate;
+        for (uint32_t c = 0; c < channels; ++c) burst[i * channels + c] = static_cast<float>(0.5 * std::sin(2 * M_PI * 1000 * t) * std::exp(-t / 0.01));
+    }
+
+    // Events 300 ms apart at odd frames, plus one on top of another and one overlapping the next, which have to mix
+    std::vector<uint64_t> targets;
+    for (int e = 0; e < count; ++e) targets.push_back(sampleRate / 2 + static_cast<uint64_t>(e) * (sampleRate * 3 / 10) + 37 * e);
+    targets.push_back(targets[1]);
+    targets.push_back(targets[2] + sampleRate / 100);
+
+    std::cout << std::left << std::setw(8) << "speed" << std::setw(22) << "play() error ms" << std::setw(22)
+              << "scheduled error ms" << std::setw(14) << "mix error" << "late events\n";
+
+    bool passed = true;
+    for (double speed: speeds) {
+        auto reference = render(false, piece, burst, targets, sampleRate, channels, speed, chunkFrames, period, queueFrames, lead);
+        auto result = render(true, piece, burst, targets, sampleRate, channels, speed, chunkFrames, period, queueFrames, lead);
+        auto rendered = renderBurst(burst, sampleRate, channels, speed);
+        uint64_t renderedFrames = rendered.size() / channels;
+
+        // With the same stream underneath, the difference is exactly what the events added
+        std::vector<float> expected(result.output.size());
+        for (auto target: targets) {
+            for (uint64_t i = 0; i < rendered.size() && target * channels + i < expected.size(); ++i) expected[target * channels + i] += rendered[i];
+        }
+        double mixError = 0;
+        std::vector<float> difference(result.output.size());
+        for (size_t i = 0; i < result.output.size() && i < reference.output.size(); ++i) {
+            difference[i] = result.output[i] - reference.output[i];
+            mixError = std::max(mixError, std::abs(static_cast<double>(difference[i] - expected[i])));
+        }
+
+        // Onsets of the events that don't overlap others
+        int64_t worstScheduled = 0, worstPlay = 0;
+        uint64_t burstOnset = onset(rendered, 0, renderedFrames, channels);
+        for (size_t e = 0; e < static_cast<size_t>(count); ++e) {
+            if (e == 1 || e == 2) continue;
+            uint64_t from = targets[e] - std::min<uint64_t>(targets[e], sampleRate / 20);
+            auto error = static_cast<int64_t>(onset(difference, from, targets[e] + renderedFrames, channels)) - static_cast<int64_t>(targets[e] + burstOnset);
+            worstScheduled = std::max(worstScheduled, std::abs(error));
+        }
+        for (auto error: result.playErrors) worstPlay = std::max(worstPlay, std::abs(error));
+
+        std::cout << std::setw(8) << speed << std::fixed << std::setprecision(2) << std::setw(22)
+                  << static_cast<double>(worstPlay) * 1000 / sampleRate << std::setw(22)
+                  << static_cast<double>(worstScheduled) * 1000 / sampleRate << std::defaultfloat << std::setw(14) << mixError
+                  << result.late << "\n";
+
+        if (worstScheduled != 0 || mixError > 1e-5 || result.late != 0) {
+            std::cout << "FAIL  scheduled events at speed " << speed << "\n";
+            passed = false;
+        }
+    }
+
+    std::cout << "\n" << std::setw(16) << "pending events" << "ns per period\n";
+    for (size_t events: {size_t(0), size_t(16), DeviceQueue::maxScheduledEvents}) {
+        std::cout << std::setw(16) << events << std::fixed << std::setprecision(0) << periodNanos(sampleRate, channels, period, events)
+                  << std::defaultfloat << "\n";
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "capture.h"
+#include "sampler.h"
+#include "signals.h"
+
+namespace {
+    enum class Approach {
+        continuous, restart, seek, seekHistory
+    };
+
+    const char *approachName(Approach approach) {
+        switch (approach) {
+            case Approach::continuous:
+                return "continuous";
+            case Approach::restart:
+                return "restart";
+            case Approach::seek:
+                return "seek";
+            case Approach::seekHistory:
+                return "seek+history";
+        }
+        return "";
+    }
+
+    struct SeekResult {
+        std::vector<float> output;
+        // First frame of `output` after the seek, and frames of earlier audio still heard after it was requested
+        uint64_t seekFrame = 0;
+        uint64_t queuedFrames = 0;
+        double callMs = 0;
+        uint64_t starts = 0;
+    };
+
+    SeekResult render(Approach approach, const std::vector<float> &piece, uint64_t position, uint64_t target,
+                      uint32_t sampleRate, uint32_t channels, double speed, uint64_t chunkFrames, uint64_t queueFrames) {
+        auto *sink = new CaptureSink(channels, queueFrames);
+        Sampler sampler(sampleRate, channels, SamplerPreset::standard, std::unique_ptr<SamplerSink>(sink));
+        sampler.setPlaybackSpeed(static_cast<float>(speed));
+        sampler.start();
+
+        uint64_t head = std::max(sampler.getPreRollFrames(), chunkFrames);
+        uint64_t history = std::min(sampler.getSeekHistoryFrames(), target);
+        auto *data = reinterpret_cast<const uint8_t *>(piece.data());
+        uint64_t frameBytes = channels * sizeof(float);
+
+        SeekResult result;
+        if (approach == Approach::continuous) {
+            playRange(sampler, piece, channels, 0, chunkFrames);
+        } else {
+            playRange(sampler, piece, channels, 0, chunkFrames, position);
+
+            uint64_t written = sink->frames();
+            uint64_t start = nowNanos();
+            switch (approach) {
+                case Approach::restart:
+                    // The usual approach: stop the device (which plays out its queue), then start from a reset stretcher
+                    sampler.stop();
+                    sampler.start();
+                    sampler.play(data + target * frameBytes, head * frameBytes);
+                    result.queuedFrames = std::min(written, queueFrames);
+                    result.seekFrame = written;
+                    break;
+                case Approach::seek:
+                    sampler.seek(nullptr, 0, data + target * frameBytes, head * frameBytes);
+                    result.seekFrame = written - std::min(written, queueFrames);
+                    break;
+                case Approach::seekHistory:
+                    sampler.seek(data + (target - history) * frameBytes, history * frameBytes, data + target * frameBytes, head * frameBytes);
+                    result.seekFrame = written - std::min(written, queueFrames);
+                    break;
+                default:
+                    break;
+            }
+            result.callMs = static_cast<double>(nowNanos() - start) / 1e6;
+
+            playRange(sampler, piece, channels, target + head, chunkFrames);
+        }
+
+        result.output = std::move(sink->samples);
+        result.starts = sink->starts;
+        sampler.stop();
+        return result;
+    }
+}
+
+int runSeek(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto channels = static_cast<uint32_t>(options.getDouble("channels", 2));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto queueFrames = static_cast<uint64_t>(options.getDouble("queue-ms", 100) * sampleRate / 1000);
+    auto speeds = options.getDoubles("speeds", "0.5,1,2");
+
+    // Playing from the start of the piece, the listener jumps from 2 s to 5 s
+    auto piece = signals::music(sampleRate, channels, sampleRate * 7);
+    uint64_t position = sampleRate * 2, target = sampleRate * 5;
+    uint64_t block = sampleRate / 200, onset = sampleRate / 50;
+
+    std::cout << std::left << std::setw(8) << "speed" << std::setw(14) << "approach" << std::setw(10) << "call ms"
+              << std::setw(11) << "queued ms" << std::setw(9) << "ramp ms" << std::setw(18) << "seek-to-audio ms"
+              << std::setw(10) << "onset dB" << "device starts\n";
+
+    bool passed = true;
+    for (double speed: speeds) {
+        auto reference = render(Approach::continuous, piece, position, target, sampleRate, channels, speed, chunkFrames, queueFrames);
+
+        for (auto approach: {Approach::restart, Approach::seek, Approach::seekHistory}) {
+            auto result = render(approach, piece, position, target, sampleRate, channels, speed, chunkFrames, queueFrames);
+
+            // Where the continuous rendering plays the target, as output lags input by the pre-roll
+            Sampler probe(sampleRate, channels, SamplerPreset::standard, std::make_unique<NullSink>());
+            probe.setPlaybackSpeed(static_cast<float>(speed));
+            auto referenceFrame = static_cast<uint64_t>(std::lround(static_cast<double>(target + probe.getPreRollFrames()) / speed));
+
+            // Audible once a 5 ms block is within 6 dB of the target as the continuous rendering plays it
+            uint64_t ramp = 0;
+            while (ramp < sampleRate && blockRms(result.output, result.seekFrame + ramp, block, channels) <
+                                        0.5 * blockRms(reference.output, referenceFrame + ramp, block, channels)) {
+                ramp += block;
+            }
+            double onsetDb = 20 * std::log10(blockRms(result.output, result.seekFrame, onset, channels) /
+                                             blockRms(reference.output, referenceFrame, onset, channels));
+
+            double queuedMs = static_cast<double>(result.queuedFrames) * 1000 / sampleRate;
+            double rampMs = static_cast<double>(ramp) * 1000 / sampleRate;
+            double latencyMs = result.callMs + queuedMs + rampMs;
+
+            std::cout << std::setw(8) << speed << std::setw(14) << approachName(approach) << std::fixed << std::setprecision(2)
+                      << std::setw(10) << result.callMs << std::setw(11) << queuedMs << std::setw(9) << rampMs
+                      << std::setw(18) << latencyMs << std::setw(10) << onsetDb << std::defaultfloat << result.starts << "\n";
+
+            if (approach == Approach::seekHistory && (ramp > 0 || std::abs(onsetDb) > 6 || result.starts != 1)) {
+                std::cout << "FAIL  seek at speed " << speed << " does not start at full level\n";
+                passed = false;
+            }
+        }
+    }
+
+    return passed ? 0 : 1;
+}
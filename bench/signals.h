@@ -0,0 +1,127 @@
+#ifndef KLARITY_BENCH_SIGNALS_H
+#define KLARITY_BENCH_SIGNALS_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "exception.h"
+
+// Deterministic test material, interleaved float frames
+namespace signals {
+    constexpr double twoPi = 2 * M_PI;
+
+    // Formant-filtered glottal pulse train with syllable envelope, fricative bursts and pauses
+    inline std::vector<float> speech(uint32_t sampleRate, uint32_t channels, uint64_t frames) {
+        std::vector<float> mono(frames);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> noise(-1, 1);
+        double phase = 0;
+        for (uint64_t i = 0; i < frames; ++i) {
+            double t = static_cast<double>(i) / sampleRate;
+            double f0 = 120 + 30 * std::sin(twoPi * 0.5 * t);
+            phase += f0 / sampleRate;
+            double f1 = 650 + 150 * std::sin(twoPi * 3.1 * t), f2 = 1600 + 400 * std::sin(twoPi * 2.3 * t);
+            double voiced = 0;
+            for (int k = 1; k * f0 < 4000; ++k) {
+                double f = k * f0;
+                double gain = std::exp(-std::pow((f - f1) / 150, 2)) + 0.5 * std::exp(-std::pow((f - f2) / 250, 2)) + 0.05 / k;
+                voiced += gain * std::sin(twoPi * k * phase);
+            }
+            double syllable = std::pow(std::max(0.0, std::sin(twoPi * 4 * t)), 2);
+            bool pause = std::fmod(t, 2.0) > 1.6;
+            bool fricative = std::fmod(t, 0.25) < 0.03;
+            mono[i] = pause ? 0.0f : static_cast<float>(0.25 * syllable * voiced + (fricative ? 0.05 * noise(random) : 0.0));
+        }
+        std::vector<float> output(frames * channels);
+        for (uint64_t i = 0; i < frames; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                output[i * channels + c] = mono[i >= c ? i - c : 0];
+            }
+        }
+        return output;
+    }
+
+    // Chord progression (I-vi-IV-V in C) of harmonic tones with a kick drum on each beat and a hi-hat between them
+    inline std::vector<float> music(uint32_t sampleRate, uint32_t channels, uint64_t frames, double tempo = 120, double semitones = 0) {
+        static constexpr double chords[4][3] = {{261.63, 329.63, 392.00},
+                                                {220.00, 261.63, 329.63},
+                                                {174.61, 220.00, 261.63},
+                                                {196.00, 246.94, 293.66}};
+        std::vector<float> output(frames * channels);
+        std::mt19937 random(2);
+        std::uniform_real_distribution<float> noise(-1, 1);
+        double beatSeconds = 60 / tempo, transpose = std::exp2(semitones / 12);
+        for (uint64_t i = 0; i < frames; ++i) {
+            double t = static_cast<double>(i) / sampleRate;
+            const double *chord = chords[static_cast<uint64_t>(t / beatSeconds) % 4];
+            double beat = std::fmod(t, beatSeconds), offbeat = std::fmod(t + beatSeconds / 2, beatSeconds);
+            double kick = std::exp(-beat * 30) * std::sin(twoPi * (60 * beat + 40 * (1 - std::exp(-beat * 30)) / 30));
+            float hat = static_cast<float>(std::exp(-offbeat * 200)) * noise(random);
+            for (uint32_t c = 0; c < channels; ++c) {
+                double tones = 0;
+                for (int n = 0; n < 3; ++n) {
+                    double pan = 1 + 0.3 * std::sin(n + c);
+                    for (int k = 1; k <= 8; ++k) {
+                        tones += pan * std::sin(twoPi * chord[n] * transpose * k * t) / k;
+                    }
+                }
+                output[i * channels + c] = static_cast<float>(0.05 * tones + 0.4 * kick) + 0.1f * hat;
+            }
+        }
+        return output;
+    }
+
+    inline std::vector<float> silence(uint32_t, uint32_t channels, uint64_t frames) {
+        return std::vector<float>(frames * channels, 0.0f);
+    }
+
+    // Decaying noise bursts at irregular intervals over a quiet noise floor
+    inline std::vector<float> transients(uint32_t sampleRate, uint32_t channels, uint64_t frames) {
+        std::vector<float> output(frames * channels);
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> noise(-1, 1);
+        std::uniform_real_distribution<double> gap(0.1, 0.3);
+        double next = 0, onset = -1;
+        for (uint64_t i = 0; i < frames; ++i) {
+            double t = static_cast<double>(i) / sampleRate;
+            if (t >= next) {
+                onset = t;
+                next = t + gap(random);
+            }
+            float envelope = static_cast<float>(std::exp(-(t - onset) * 400));
+            for (uint32_t c = 0; c < channels; ++c) {
+                output[i * channels + c] = envelope * noise(random) + 0.001f * noise(random);
+            }
+        }
+        return output;
+    }
+
+    // Raw interleaved float32 recording, repeated/remapped to the requested channel count and length
+    inline std::vector<float> file(const std::string &path, uint32_t fileChannels, uint32_t channels, uint64_t frames) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw SamplerException("Unable to open input file: " + path);
+        }
+        std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        uint64_t fileFrames = bytes.size() / sizeof(float) / fileChannels;
+        if (fileFrames == 0) {
+            throw SamplerException("Input file is empty: " + path);
+        }
+        std::vector<float> data(fileFrames * fileChannels);
+        std::memcpy(data.data(), bytes.data(), data.size() * sizeof(float));
+
+        std::vector<float> output(frames * channels);
+        for (uint64_t i = 0; i < frames; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                output[i * channels + c] = data[(i % fileFrames) * fileChannels + c % fileChannels];
+            }
+        }
+        return output;
+    }
+}
+
+#endif //KLARITY_BENCH_SIGNALS_H
@@ -0,0 +1,219 @@
+#include "bench.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include "dsp/fft.h"
+#include "signals.h"
+#include "stretch/stretch.h"
+
+namespace {
+    // RMS envelope in frames of this many ms
+    constexpr double envelopeMs = 1;
+    constexpr int spectrumSize = 1024, spectrumHop = 256;
+
+    struct Rendered {
+        std::vector<float> output;
+        double nanosPerFrame = 0;
+        double latencyMs = 0;
+        uint64_t resets = 0;
+    };
+
+    // Stretches mono `input` to 1/`speed` of its length, as `Sampler::play` does chunk by chunk
+    Rendered render(const std::vector<float> &input, uint32_t sampleRate, double speed, bool cheaper, bool transientReset, uint64_t chunkFrames) {
+        signalsmith::stretch::SignalsmithStretch<float> stretch(1);
+        if (cheaper) {
+            stretch.presetCheaper(1, static_cast<float>(sampleRate));
+        } else {
+            stretch.presetDefault(1, static_cast<float>(sampleRate));
+        }
+        stretch.setTransientReset(transientReset);
+
+        Rendered result;
+        result.output.resize(static_cast<size_t>(std::ceil(static_cast<double>(input.size()) / speed)));
+        uint64_t start = nowNanos();
+        for (uint64_t offset = 0; offset < input.size(); offset += chunkFrames) {
+            uint64_t count = std::min<uint64_t>(chunkFrames, input.size() - offset);
+            auto from = static_cast<uint64_t>(std::llround(static_cast<double>(offset) / speed));
+            auto to = std::min<uint64_t>(result.output.size(), std::llround(static_cast<double>(offset + count) / speed));
+            const float *inputs[] = {input.data() + offset};
+            float *outputs[] = {result.output.data() + from};
+            stretch.process(inputs, static_cast<int>(count), outputs, static_cast<int>(to - from));
+        }
+        result.nanosPerFrame = static_cast<double>(nowNanos() - start) / static_cast<double>(input.size());
+        result.latencyMs = (stretch.inputLatency() + stretch.outputLatency()) * 1e3 / sampleRate;
+        result.resets = stretch.transientResets();
+        return result;
+    }
+
+    std::vector<float> envelope(const std::vector<float> &signal, uint32_t sampleRate) {
+        auto frame = static_cast<size_t>(sampleRate * envelopeMs / 1e3);
+        std::vector<float> result(signal.size() / frame);
+        for (size_t i = 0; i < result.size(); ++i) {
+            double sum = 0;
+            for (size_t j = 0; j < frame; ++j) sum += static_cast<double>(signal[i * frame + j]) * signal[i * frame + j];
+            result[i] = static_cast<float>(std::sqrt(sum / static_cast<double>(frame)));
+        }
+        return result;
+    }
+
+    /*
+     * Median 10-90% rise time in ms of the clear onsets: envelope peaks at least 8x above the quietest point of the 20
+     * ms before them. A smeared onset fades in over the block length instead of starting at once.
+     */
+    double riseMs(const std::vector<float> &env) {
+        float loudest = *std::max_element(env.begin(), env.end());
+        std::vector<double> rises;
+        for (size_t i = 20; i + 10 < env.size(); ++i) {
+            float peak = env[i];
+            if (peak < 0.05f * loudest || *std::max_element(env.begin() + static_cast<std::ptrdiff_t>(i) - 10, env.begin() + static_cast<std::ptrdiff_t>(i) + 11) != peak) continue;
+            if (*std::min_element(env.begin() + static_cast<std::ptrdiff_t>(i) - 20, env.begin() + static_cast<std::ptrdiff_t>(i)) * 8 > peak) continue;
+
+            size_t t90 = i, t10;
+            while (t90 > 0 && env[t90 - 1] >= 0.9f * peak) --t90;
+            t10 = t90;
+            while (t10 > 0 && env[t10 - 1] >= 0.1f * peak) --t10;
+            rises.push_back(static_cast<double>(t90 - t10) * envelopeMs);
+        }
+        return rises.empty() ? -1 : percentile(rises, 0.5);
+    }
+
+    // Output envelope frames lag the input by this many, once the input envelope is sped up to the output's time
+    int alignment(const std::vector<float> &input, const std::vector<float> &output, double speed) {
+        auto maxLag = static_cast<int>(300 / envelopeMs);
+        int best = 0;
+        double bestCorrelation = -1;
+        for (int lag = 0; lag <= maxLag; ++lag) {
+            double product = 0, inputSquares = 0, outputSquares = 0;
+            for (size_t j = static_cast<size_t>(lag); j < output.size(); ++j) {
+                auto i = static_cast<size_t>(static_cast<double>(j - lag) * speed);
+                if (i >= input.size()) break;
+                product += static_cast<double>(input[i]) * output[j];
+                inputSquares += static_cast<double>(input[i]) * input[i];
+                outputSquares += static_cast<double>(output[j]) * output[j];
+            }
+            double correlation = product / std::sqrt(inputSquares * outputSquares + 1e-30);
+            if (correlation > bestCorrelation) {
+                bestCorrelation = correlation;
+                best = lag;
+            }
+        }
+        return best;
+    }
+
+    /*
+     * Log-spectral distance in dB between the output and the input at the corresponding time, over frames within 40 dB
+     * of the loudest and bands up to 8 kHz. An ideal time-stretch keeps each moment's spectrum; smearing puts energy
+     * where the input had none yet.
+     */
+    double logSpectralDistance(const std::vector<float> &input, const std::vector<float> &output, uint32_t sampleRate, double speed, int lagFrames) {
+        signalsmith::fft::RealFFT<float> fft(spectrumSize);
+        std::vector<float> window(spectrumSize), frame(spectrumSize);
+        for (int i = 0; i < spectrumSize; ++i) window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2 * M_PI * (i + 0.5) / spectrumSize));
+        std::vector<std::complex<float>> inputSpectrum(spectrumSize / 2), outputSpectrum(spectrumSize / 2);
+        int topBand = std::min(spectrumSize / 2, static_cast<int>(8000.0 * spectrumSize / sampleRate));
+        auto lagSamples = static_cast<double>(lagFrames) * sampleRate * envelopeMs / 1e3;
+
+        auto spectrum = [&](const std::vector<float> &signal, size_t start, std::vector<std::complex<float>> &result) {
+            for (int i = 0; i < spectrumSize; ++i) frame[i] = signal[start + i] * window[i];
+            fft.fft(frame, result);
+            double energy = 0;
+            for (int b = 0; b < topBand; ++b) energy += std::norm(result[b]);
+            return energy;
+        };
+
+        std::vector<std::pair<double, double>> frames; // input energy, distance
+        for (size_t start = 0; start + spectrumSize <= output.size(); start += spectrumHop) {
+            double inputCentre = (static_cast<double>(start) + spectrumSize / 2.0 - lagSamples) * speed;
+            if (inputCentre < spectrumSize / 2.0) continue;
+            auto inputStart = static_cast<size_t>(inputCentre - spectrumSize / 2.0);
+            if (inputStart + spectrumSize > input.size()) break;
+
+            double energy = spectrum(input, inputStart, inputSpectrum);
+            spectrum(output, start, outputSpectrum);
+            double sum = 0;
+            for (int b = 1; b < topBand; ++b) {
+                double difference = 10 * std::log10(std::norm(inputSpectrum[b]) + 1e-9) - 10 * std::log10(std::norm(outputSpectrum[b]) + 1e-9);
+                sum += difference * difference;
+            }
+            frames.emplace_back(energy, std::sqrt(sum / (topBand - 1)));
+        }
+
+        double loudest = 0;
+        for (auto &f: frames) loudest = std::max(loudest, f.first);
+        double total = 0;
+        int counted = 0;
+        for (auto &f: frames) {
+            if (f.first < loudest * 1e-4) continue;
+            total += f.second;
+            ++counted;
+        }
+        return counted ? total / counted : -1;
+    }
+}
+
+int runTransients(const Options &options) {
+    auto sampleRate = static_cast<uint32_t>(options.getDouble("rate", 48000));
+    auto chunkFrames = static_cast<uint64_t>(options.getDouble("chunk", 1024));
+    auto seconds = options.getDouble("seconds", 10);
+    auto speeds = options.getDoubles("speeds", "2,3");
+    auto signalNames = options.getList("signals", "speech,transients");
+    int repeats = static_cast<int>(options.getDouble("repeats", 3));
+
+    struct Configuration {
+        const char *name;
+        bool cheaper;
+        bool transientReset;
+    };
+    std::vector<Configuration> configurations = {
+            {"default", false, false},
+            {"cheaper", true, false},
+            {"cheaper+reset", true, true},
+            {"default+reset", false, true}
+    };
+
+    bool passed = true;
+    auto frames = static_cast<uint64_t>(seconds * sampleRate);
+
+    std::cout << std::left << std::setw(11) << "signal" << std::setw(7) << "speed" << std::setw(15) << "preset"
+              << std::setw(10) << "ns/frame" << std::setw(12) << "latency ms" << std::setw(9) << "rise ms"
+              << std::setw(9) << "LSD dB" << "resets\n";
+    for (const auto &name: signalNames) {
+        auto input = name == "transients" ? signals::transients(sampleRate, 1, frames) : signals::speech(sampleRate, 1, frames);
+        auto inputEnvelope = envelope(input, sampleRate);
+
+        for (double speed: speeds) {
+            std::vector<double> rises, distances;
+            for (const auto &configuration: configurations) {
+                std::vector<double> nanos;
+                Rendered rendered;
+                for (int r = 0; r < repeats; ++r) {
+                    rendered = render(input, sampleRate, speed, configuration.cheaper, configuration.transientReset, chunkFrames);
+                    nanos.push_back(rendered.nanosPerFrame);
+                }
+
+                auto outputEnvelope = envelope(rendered.output, sampleRate);
+                double rise = riseMs(outputEnvelope);
+                double distance = logSpectralDistance(input, rendered.output, sampleRate, speed, alignment(inputEnvelope, outputEnvelope, speed));
+                rises.push_back(rise);
+                distances.push_back(distance);
+
+                std::cout << std::setw(11) << name << std::setw(7) << speed << std::setw(15) << configuration.name << std::fixed
+                          << std::setprecision(1) << std::setw(10) << percentile(nanos, 0.5) << std::setw(12) << rendered.latencyMs
+                          << std::setw(9) << rise << std::setprecision(2) << std::setw(9) << distance << rendered.resets
+                          << std::defaultfloat << std::setprecision(6) << "\n";
+            }
+
+            // The reset never slows onsets down, and on speech brings the cheaper preset's spectra as close as the default's
+            bool sharper = rises[2] <= rises[1] && rises[3] <= rises[0];
+            bool asGood = name != "speech" || distances[2] <= distances[0];
+            if (!sharper || !asGood) {
+                std::cout << "FAIL  " << name << " at " << speed << "x: rise " << rises[2] << " ms with the reset against "
+                          << rises[1] << " without (cheaper), " << rises[3] << " against " << rises[0] << " (default); LSD "
+                          << distances[2] << " dB for cheaper+reset against " << distances[0] << " for default\n";
+                passed = false;
+            }
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#ifndef KLARITY_SAMPLER_ARENA_H
+#define KLARITY_SAMPLER_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+/*
+ * Bump allocator backing all state of one stretcher, so its buffers sit in a single cache-line-aligned block instead
+ * of being scattered across the heap. Every sub-allocation is rounded up to a cache line, which keeps buffers from
+ * sharing lines. Blocks of 2 MiB and above are hugepage-aligned and advised as hugepages where the OS supports it.
+ *
+ * With a capacity of 0 the arena only measures: allocations are forwarded to the heap while `required()` adds up the
+ * capacity an arena would need to serve the same sequence. Deallocation inside the block is a no-op, so an arena is
+ * sized for one configuration; allocations past its capacity fall back to the heap and are counted.
+ */
+struct StretchArena : std::pmr::memory_resource {
+public:
+    static constexpr size_t cacheLine = 64;
+
+    static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+private:
+    std::byte *block = nullptr;
+    size_t blockSize = 0;
+    size_t blockAlignment = cacheLine;
+    size_t capacityBytes = 0;
+    size_t usedBytes = 0;
+    size_t requiredBytes = 0;
+    uint64_t overflows = 0;
+    bool hugePageBacked = false;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+    explicit StretchArena(size_t capacity = 0);
+
+    ~StretchArena() override;
+
+    StretchArena(const StretchArena &) = delete;
+
+    StretchArena &operator=(const StretchArena &) = delete;
+
+    size_t capacity() const;
+
+    size_t used() const;
+
+    // Capacity needed for everything allocated through this arena so far
+    size_t required() const;
+
+    // Allocations that didn't fit and went to the heap
+    uint64_t overflowAllocations() const;
+
+    bool hugePages() const;
+};
+
+#endif //KLARITY_SAMPLER_ARENA_H
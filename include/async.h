@@ -0,0 +1,39 @@
+#ifndef KLARITY_SAMPLER_ASYNC_H
+#define KLARITY_SAMPLER_ASYNC_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Intrusive node of an operation waiting for the device, woken on an executor thread
+struct AsyncWaiter {
+    AsyncWaiter *next = nullptr;
+    void (*wake)(AsyncWaiter *) = nullptr;
+};
+
+/*
+ * Event loop resuming the operations of `Sampler::playAsync` and `Sampler::drained` once the device has made room.
+ * `post` is lock-free and never blocks, so device callbacks use it directly; any number of threads may `run` the same
+ * executor, so a few threads can feed many samplers.
+ */
+struct SamplerExecutor {
+private:
+    std::atomic<AsyncWaiter *> ready{nullptr};
+    // Bumped on every post, the idle threads wait on it
+    std::atomic<uint32_t> signal{0};
+    std::atomic<bool> stopping{false};
+
+public:
+    // Lock-free, also from a device callback (the wake-up of an idle thread is a non-blocking futex call)
+    void post(AsyncWaiter &waiter);
+
+    // Wakes the waiters posted so far on the calling thread, returning how many
+    size_t poll();
+
+    // Wakes waiters as they are posted until `stop`
+    void run();
+
+    void stop();
+};
+
+#endif //KLARITY_SAMPLER_ASYNC_H
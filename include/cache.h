@@ -0,0 +1,69 @@
+#ifndef KLARITY_SAMPLER_CACHE_H
+#define KLARITY_SAMPLER_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct RenderCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t limitBytes = 0;
+};
+
+/*
+ * Bounded LRU map from a 64-bit key to a rendered chunk of interleaved output. Lookups don't allocate, so they can run
+ * inside a real-time section; inserts allocate and evict the least recently used chunks until the cache fits its limit.
+ * A limit of 0 disables the cache.
+ */
+struct RenderCache {
+private:
+    struct Entry {
+        uint64_t key;
+        std::vector<float> samples;
+    };
+
+    size_t limitBytes = 0;
+    size_t usedBytes = 0;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    RenderCacheStats counters;
+
+    static size_t footprint(size_t samples);
+
+    void evict(size_t targetBytes);
+
+public:
+    // Mixes `bytes` bytes of `data` into `seed`
+    static uint64_t hash(uint64_t seed, const void *data, size_t bytes);
+
+    bool enabled() const {
+        return limitBytes > 0;
+    }
+
+    void setLimit(size_t bytes);
+
+    // Cached samples for `key`, or nullptr, counting a hit or a miss
+    const std::vector<float> *find(uint64_t key);
+
+    // Storage of `samples` samples for `key` to fill, or nullptr if a chunk that size can't fit within the limit
+    float *insert(uint64_t key, size_t samples);
+
+    void clear();
+
+    RenderCacheStats stats() const;
+
+    void resetStats();
+
+    size_t memoryUsage() const {
+        return usedBytes;
+    }
+};
+
+#endif //KLARITY_SAMPLER_CACHE_H
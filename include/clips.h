@@ -0,0 +1,104 @@
+#ifndef KLARITY_SAMPLER_CLIPS_H
+#define KLARITY_SAMPLER_CLIPS_H
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sampler.h"
+
+// One short sound to stretch, read in place while `ClipRenderer::render` runs
+struct ClipRequest {
+    // Interleaved float32, `frames` frames of the renderer's channel count
+    const float *samples = nullptr;
+    uint64_t frames = 0;
+    float speed = 1.0f;
+    float pitchFactor = 1.0f;
+    // Hz, 0 to transpose the whole spectrum (see `Sampler::setPitchFactor`)
+    float tonalityLimit = 0.0f;
+    float volume = 1.0f;
+};
+
+struct RenderedClip {
+    // Interleaved, the whole clip from its first frame to the end of its tail, about `frames / speed` frames
+    std::vector<float> samples;
+};
+
+struct ClipRendererOptions {
+    uint32_t sampleRate = 48000;
+    uint32_t channels = 2;
+    SamplerPreset preset = SamplerPreset::standard;
+    SamplerPrecision precision = SamplerPrecision::full;
+    // 0 for one per hardware thread
+    size_t threads = 0;
+};
+
+struct ClipRendererStats {
+    uint64_t clips = 0;
+    uint64_t inputFrames = 0;
+    uint64_t outputFrames = 0;
+    // Runs of clips a worker took from another one's share
+    uint64_t steals = 0;
+    // NaN/Inf output samples replaced with silence
+    uint64_t nonFiniteSamples = 0;
+    // Time to render each clip, on whichever worker rendered it
+    ProfileHistogram clip;
+};
+
+/*
+ * Renders batches of independent one-shot clips, each at its own speed and pitch, offline and in parallel. Each
+ * worker thread keeps one stretcher, configured once and `reset` between clips, so a clip costs only its own
+ * processing and tail: no construction, FFT setup or allocation beyond its output. A batch is split into one run of
+ * consecutive clips per worker, and a worker that runs out takes half of what is left of the fullest run, so long
+ * and short clips even out without a shared queue.
+ */
+struct ClipRenderer {
+private:
+    struct Worker;
+
+    ClipRendererOptions options;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // One batch at a time
+    std::mutex mutex;
+    const ClipRequest *batchRequests = nullptr;
+    RenderedClip *batchResults = nullptr;
+    // Bumped to start a batch or stop, the idle workers wait on it
+    std::atomic<uint32_t> generation{0};
+    std::atomic<bool> stopping{false};
+    // Workers still busy with the current batch
+    std::atomic<uint32_t> busy{0};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    void run(Worker &worker);
+
+    bool takeClip(Worker &worker, uint64_t &index);
+
+    void renderClip(Worker &worker, const ClipRequest &request, RenderedClip &result);
+
+public:
+    explicit ClipRenderer(ClipRendererOptions options = {});
+
+    ~ClipRenderer();
+
+    ClipRenderer(const ClipRenderer &) = delete;
+
+    ClipRenderer &operator=(const ClipRenderer &) = delete;
+
+    // Renders `count` clips into `results` (resized to fit), blocking until all of them are done
+    void render(const ClipRequest *clips, size_t count, RenderedClip *results);
+
+    std::vector<RenderedClip> render(const std::vector<ClipRequest> &clips);
+
+    size_t threadCount() const;
+
+    ClipRendererStats getStats();
+
+    void resetStats();
+};
+
+#endif //KLARITY_SAMPLER_CLIPS_H
@@ -1,6 +1,7 @@
 #ifndef KLARITY_SAMPLER_DELETER_H
 #define KLARITY_SAMPLER_DELETER_H
 
+#include <memory>
 #include "portaudio.h"
 #include "stretch/stretch.h"
 
@@ -12,10 +13,17 @@ struct PaStreamDeleter {
     }
 };
 
+// Stretchers placed in a `StretchArena` are only destroyed, the arena owns their memory
 struct SignalsmithStretchDeleter {
+    bool inArena = false;
+
     void operator()(signalsmith::stretch::SignalsmithStretch<float> *stretch) const {
-        if (stretch) {
-            stretch->reset();
+        if (!stretch) return;
+
+        if (inArena) {
+            std::destroy_at(stretch);
+        } else {
+            delete stretch;
         }
     }
 };
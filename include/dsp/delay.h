@@ -4,6 +4,7 @@
 #define SIGNALSMITH_DSP_DELAY_H
 
 #include <vector>
+#include <memory_resource>
 #include <array>
 #include <cmath> // for std::ceil()
 #include <type_traits>
@@ -43,9 +44,9 @@ namespace delay {
 	class Buffer {
 		unsigned bufferIndex;
 		unsigned bufferMask;
-		std::vector<Sample> buffer;
+		std::pmr::vector<Sample> buffer;
 	public:
-		Buffer(int minCapacity=0) {
+		Buffer(int minCapacity=0, std::pmr::polymorphic_allocator<> allocator={}) : buffer(allocator) {
 			resize(minCapacity);
 		}
 		// We shouldn't accidentally copy a delay buffer
@@ -65,6 +66,10 @@ namespace delay {
 		void reset(Sample value=Sample()) {
 			buffer.assign(buffer.size(), value);
 		}
+		/// Bytes of heap storage (the capacity is rounded up to a power of two)
+		size_t memoryBytes() const {
+			return buffer.capacity()*sizeof(Sample);
+		}
 
 		/// Holds a view for a particular position in the buffer
 		template<bool isConst>
@@ -202,7 +207,7 @@ namespace delay {
 		using ConstChannel = typename Buffer<Sample>::ConstView;
 		using MutableChannel = typename Buffer<Sample>::MutableView;
 
-		MultiBuffer(int channels=0, int capacity=0) : channels(channels), stride(capacity), buffer(channels*capacity) {}
+		MultiBuffer(int channels=0, int capacity=0, std::pmr::polymorphic_allocator<> allocator={}) : channels(channels), stride(capacity), buffer(channels*capacity, allocator) {}
 
 		void resize(int nChannels, int capacity, Sample value=Sample()) {
 			channels = nChannels;
@@ -212,6 +217,9 @@ namespace delay {
 		void reset(Sample value=Sample()) {
 			buffer.reset(value);
 		}
+		size_t memoryBytes() const {
+			return buffer.memoryBytes();
+		}
 
 		/// A reference-like multi-channel result for a particular sample index
 		template<bool isConst>
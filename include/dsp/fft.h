@@ -4,10 +4,12 @@
 #define SIGNALSMITH_FFT_V5
 
 #include "./perf.h"
+#include "./kernels.h"
 
 #include <vector>
 #include <complex>
 #include <cmath>
+#include <memory_resource>
 
 namespace signalsmith { namespace fft {
 	/**	@defgroup FFT FFT (complex and real)
@@ -79,7 +81,7 @@ namespace signalsmith { namespace fft {
 	class FFT {
 		using complex = std::complex<V>;
 		size_t _size;
-		std::vector<complex> workingVector;
+		std::pmr::vector<complex> workingVector;
 		
 		enum class StepType {
 			generic, step2, step3, step4
@@ -92,12 +94,12 @@ namespace signalsmith { namespace fft {
 			size_t outerRepeats;
 			size_t twiddleIndex;
 		};
-		std::vector<size_t> factors;
-		std::vector<Step> plan;
-		std::vector<complex> twiddleVector;
+		std::pmr::vector<size_t> factors;
+		std::pmr::vector<Step> plan;
+		std::pmr::vector<complex> twiddleVector;
 		
 		struct PermutationPair {size_t from, to;};
-		std::vector<PermutationPair> permutation;
+		std::pmr::vector<PermutationPair> permutation;
 		
 		void addPlanSteps(size_t factorIndex, size_t start, size_t length, size_t repeats) {
 			if (factorIndex >= factors.size()) return;
@@ -304,20 +306,37 @@ namespace signalsmith { namespace fft {
 		template<bool inverse, typename InputIterator, typename OutputIterator>
 		void run(InputIterator &&input, OutputIterator &&data) {
 			permute(input, data);
-			
+
+			// Radix-2/4 passes can use the installed kernel table, if the data is contiguous
+			const kernels::Table *table = nullptr;
+			float *kernelData = nullptr;
+			if constexpr (std::is_same<V, float>::value) {
+				table = kernels::active();
+				if (table) kernelData = reinterpret_cast<float *>(kernels::contiguous<complex>(data));
+			}
+			const float *kernelTwiddles = reinterpret_cast<const float *>(twiddleVector.data());
+
 			for (const Step &step : plan) {
 				switch (step.type) {
 					case StepType::generic:
 						fftStepGeneric<inverse>(data + step.startIndex, step);
 						break;
 					case StepType::step2:
-						fftStep2<inverse>(data + step.startIndex, step);
+						if (kernelData) {
+							table->fftStep2[inverse](kernelData + 2*step.startIndex, kernelTwiddles + 2*step.twiddleIndex, step.innerRepeats, step.outerRepeats);
+						} else {
+							fftStep2<inverse>(data + step.startIndex, step);
+						}
 						break;
 					case StepType::step3:
 						fftStep3<inverse>(data + step.startIndex, step);
 						break;
 					case StepType::step4:
-						fftStep4<inverse>(data + step.startIndex, step);
+						if (kernelData) {
+							table->fftStep4[inverse](kernelData + 2*step.startIndex, kernelTwiddles + 2*step.twiddleIndex, step.innerRepeats, step.outerRepeats);
+						} else {
+							fftStep4<inverse>(data + step.startIndex, step);
+						}
 						break;
 				}
 			}
@@ -356,7 +375,8 @@ namespace signalsmith { namespace fft {
 			return power2*size;
 		}
 
-		FFT(size_t size, int fastDirection=0) : _size(0) {
+		/// All internal buffers are allocated through `allocator`
+		FFT(size_t size, int fastDirection=0, std::pmr::polymorphic_allocator<> allocator={}) : _size(0), workingVector(allocator), factors(allocator), plan(allocator), twiddleVector(allocator), permutation(allocator) {
 			if (fastDirection > 0) size = fastSizeAbove(size);
 			if (fastDirection < 0) size = fastSizeBelow(size);
 			this->setSize(size);
@@ -379,6 +399,11 @@ namespace signalsmith { namespace fft {
 		const size_t & size() const {
 			return _size;
 		}
+		/// Bytes of heap storage held by the plan and working buffers
+		size_t memoryBytes() const {
+			return (workingVector.capacity() + twiddleVector.capacity())*sizeof(complex) + factors.capacity()*sizeof(size_t)
+				+ plan.capacity()*sizeof(Step) + permutation.capacity()*sizeof(PermutationPair);
+		}
 
 		template<typename InputIterator, typename OutputIterator>
 		void fft(InputIterator &&input, OutputIterator &&output) {
@@ -404,9 +429,9 @@ namespace signalsmith { namespace fft {
 		static constexpr bool modified = (optionFlags&FFTOptions::halfFreqShift);
 
 		using complex = std::complex<V>;
-		std::vector<complex> complexBuffer1, complexBuffer2;
-		std::vector<complex> twiddlesMinusI;
-		std::vector<complex> modifiedRotations;
+		std::pmr::vector<complex> complexBuffer1, complexBuffer2;
+		std::pmr::vector<complex> twiddlesMinusI;
+		std::pmr::vector<complex> modifiedRotations;
 		FFT<V> complexFft;
 	public:
 		static size_t fastSizeAbove(size_t size) {
@@ -416,7 +441,7 @@ namespace signalsmith { namespace fft {
 			return FFT<V>::fastSizeBelow(size/2)*2;
 		}
 
-		RealFFT(size_t size=0, int fastDirection=0) : complexFft(0) {
+		RealFFT(size_t size=0, int fastDirection=0, std::pmr::polymorphic_allocator<> allocator={}) : complexBuffer1(allocator), complexBuffer2(allocator), twiddlesMinusI(allocator), modifiedRotations(allocator), complexFft(0, 0, allocator) {
 			if (fastDirection > 0) size = fastSizeAbove(size);
 			if (fastDirection < 0) size = fastSizeBelow(size);
 			this->setSize(std::max<size_t>(size, 2));
@@ -451,15 +476,28 @@ namespace signalsmith { namespace fft {
 		size_t size() const {
 			return complexFft.size()*2;
 		}
+		/// Bytes of heap storage held by this FFT and its complex FFT
+		size_t memoryBytes() const {
+			return (complexBuffer1.capacity() + complexBuffer2.capacity() + twiddlesMinusI.capacity() + modifiedRotations.capacity())*sizeof(complex)
+				+ complexFft.memoryBytes();
+		}
 
 		template<typename InputIterator, typename OutputIterator>
 		void fft(InputIterator &&input, OutputIterator &&output) {
 			size_t hSize = complexFft.size();
-			for (size_t i = 0; i < hSize; ++i) {
-				if (modified) {
-					complexBuffer1[i] = _fft_impl::complexMul<false>({input[2*i], input[2*i + 1]}, modifiedRotations[i]);
-				} else {
-					complexBuffer1[i] = {input[2*i], input[2*i + 1]};
+			const kernels::Table *table = nullptr;
+			if constexpr (std::is_same<V, float>::value) {
+				if (modified) table = kernels::active();
+			}
+			if (const float *inputData = table ? kernels::contiguous<const float>(input) : nullptr) {
+				table->complexMultiply[0](reinterpret_cast<float *>(complexBuffer1.data()), inputData, reinterpret_cast<const float *>(modifiedRotations.data()), hSize);
+			} else {
+				for (size_t i = 0; i < hSize; ++i) {
+					if (modified) {
+						complexBuffer1[i] = _fft_impl::complexMul<false>({input[2*i], input[2*i + 1]}, modifiedRotations[i]);
+					} else {
+						complexBuffer1[i] = {input[2*i], input[2*i + 1]};
+					}
 				}
 			}
 			
@@ -501,7 +539,15 @@ namespace signalsmith { namespace fft {
 			}
 			
 			complexFft.ifft(complexBuffer1.data(), complexBuffer2.data());
-			
+
+			const kernels::Table *table = nullptr;
+			if constexpr (std::is_same<V, float>::value) {
+				if (modified) table = kernels::active();
+			}
+			if (float *outputData = table ? kernels::contiguous<float>(output) : nullptr) {
+				table->complexMultiply[1](outputData, reinterpret_cast<const float *>(complexBuffer2.data()), reinterpret_cast<const float *>(modifiedRotations.data()), hSize);
+				return;
+			}
 			for (size_t i = 0; i < hSize; ++i) {
 				complex v = complexBuffer2[i];
 				if (modified) v = _fft_impl::complexMul<true>(v, modifiedRotations[i]);
@@ -0,0 +1,87 @@
+#include "./common.h"
+
+#ifndef SIGNALSMITH_DSP_KERNELS_H
+#define SIGNALSMITH_DSP_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+namespace signalsmith {
+namespace kernels {
+	/**	@defgroup Kernels Kernel table
+		@brief Optional replacements for the hot `float` loops, so a host can pick ISA-specific builds at runtime
+
+		The DSP code asks `active()` for a table and falls back to its own inline loops when none is installed (or the data isn't contiguous), so nothing changes unless a host calls `install()`.
+
+		Complex data is passed as interleaved real/imaginary `float` pairs, matching the layout of `std::complex<float>`.
+
+		@{
+		@file
+	*/
+
+	struct Table {
+		const char *name;
+		/// Radix-2 and radix-4 passes of `FFT<float>`, indexed by `[inverse]`, using the same twiddle layout
+		void (*fftStep2[2])(float *data, const float *twiddles, size_t stride, size_t outerRepeats);
+		void (*fftStep4[2])(float *data, const float *twiddles, size_t stride, size_t outerRepeats);
+		/// `output[i] = a[i]*b[i]`, or `a[i]*conj(b[i])` for index 1 (`output` may alias `a`)
+		void (*complexMultiply[2])(float *output, const float *a, const float *b, size_t size);
+		/// `output[i] = input[i]*window[i]*gain`
+		void (*window)(float *output, const float *input, const float *window, float gain, size_t size);
+		/// Interleaved to planar
+		void (*deinterleave)(float *const *outputs, const float *input, size_t channels, size_t frames);
+		/// Planar to interleaved, scaled by `gain`
+		void (*interleave)(float *output, const float *const *inputs, size_t channels, size_t frames, float gain);
+		/// Replaces NaN/Inf (and subnormals, if `flushSubnormals`) with zero, returning how many were NaN/Inf
+		size_t (*sanitize)(float *data, size_t size, bool flushSubnormals);
+		/// Counts the samples `sanitize` would replace, without writing (for read-only input)
+		size_t (*countInvalid)(const float *data, size_t size, bool countSubnormals);
+		/// `float` to bfloat16 bits (round to nearest-even) and back, for state stored at reduced precision
+		void (*toBf16)(uint16_t *output, const float *input, size_t size);
+		void (*fromBf16)(float *output, const uint16_t *input, size_t size);
+		/// One-pole smoothing in place, `state += (data[i] - state)*slew`, run backwards if `reverse`; returns the final state
+		float (*onePole)(float *data, size_t size, float slew, float state, bool reverse);
+		/// Bit `i%64` of `mask[i/64]` is set where `a[i] > b[i]` (bits past `size` in the last word are cleared)
+		void (*greaterMask)(uint64_t *mask, const float *a, const float *b, size_t size);
+		/// Smoothstep section of a pitch map of (input bin, frequency gradient) pairs: for `start <= b < end`, with `r = (b - origin)*rangeScale`,
+		/// `map[b] = {b + offset + r*r*(3 - 2*r)*outScale, 1 + 6*r*(1 - r)*gradScale}`
+		void (*smoothstep)(float *map, size_t start, size_t end, float origin, float rangeScale, float offset, float outScale, float gradScale);
+	};
+
+	namespace _impl {
+		inline const Table *installed = nullptr;
+	}
+
+	/// Installs a kernel table for all subsequent processing (not thread-safe with respect to running DSP code)
+	inline void install(const Table *table) {
+		_impl::installed = table;
+	}
+
+	/// The installed table, or `nullptr` if the inline loops should be used
+	inline const Table * active() {
+		return _impl::installed;
+	}
+
+	/// Returns a raw pointer if `data` is a pointer, contiguous iterator or contiguous container of `Value`, otherwise `nullptr`
+	template<typename Value, class Data>
+	Value * contiguous(Data &&data) {
+		using Type = std::remove_cvref_t<Data>;
+		if constexpr (std::contiguous_iterator<Type>) {
+			if constexpr (std::is_convertible<decltype(std::to_address(data)), Value *>::value) {
+				return std::to_address(data);
+			}
+		} else if constexpr (requires { std::data(data); }) {
+			if constexpr (std::is_convertible<decltype(std::data(data)), Value *>::value) {
+				return std::data(data);
+			}
+		}
+		return nullptr;
+	}
+
+/** @} */
+}} // signalsmith::kernels::
+
+#endif // include guard
@@ -4,6 +4,8 @@
 #define SIGNALSMITH_DSP_PERF_H
 
 #include <complex>
+#include <cstdint>
+#include <cstring>
 
 #if defined(__SSE__) || defined(_M_X64)
 #	include <xmmintrin.h>
@@ -31,6 +33,11 @@ namespace perf {
 	#endif
 	#endif
 
+	/// Scoped instrumentation hook for a named processing stage (expands to nothing unless defined before inclusion)
+	#ifndef SIGNALSMITH_PERF_SCOPE
+	#define SIGNALSMITH_PERF_SCOPE(stage)
+	#endif
+
 	/** @brief Complex-multiplication (with optional conjugate second-arg), without handling NaN/Infinity
 		The `std::complex` multiplication has edge-cases around NaNs which slow things down and prevent auto-vectorisation.  Flags like `-ffast-math` sort this out anyway, but this helps with Debug builds.
 	*/
@@ -45,10 +52,28 @@ namespace perf {
 		};
 	}
 
+	/// Rounds a `float` to the upper 16 bits (bfloat16), to nearest-even, keeping NaN as NaN
+	SIGNALSMITH_INLINE static uint16_t toBf16(float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		if ((bits&0x7fffffffu) > 0x7f800000u) return uint16_t((bits >> 16)|0x40);
+		bits += 0x7fffu + ((bits >> 16)&1);
+		return uint16_t(bits >> 16);
+	}
+	SIGNALSMITH_INLINE static float fromBf16(uint16_t value) {
+		uint32_t bits = uint32_t(value) << 16;
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
 #if defined(__SSE__) || defined(_M_X64)
 	class StopDenormals {
 		unsigned int controlStatusRegister;
 	public:
+		/// Whether this platform actually flushes denormals (otherwise callers need their own fallback)
+		static constexpr bool flushes = true;
+
 		StopDenormals() : controlStatusRegister(_mm_getcsr()) {
 			_mm_setcsr(controlStatusRegister|0x8040); // Flush-to-Zero and Denormals-Are-Zero
 		}
@@ -60,10 +85,13 @@ namespace perf {
 	class StopDenormals {
 		uintptr_t status;
 	public:
+		static constexpr bool flushes = true;
+
 		StopDenormals() {
 			uintptr_t asmStatus;
 			asm volatile("mrs %0, fpcr" : "=r"(asmStatus));
-			status = asmStatus = asmStatus|0x01000000U; // Flush to Zero
+			status = asmStatus; // The caller's state, restored as it was
+			asmStatus |= 0x01000000U; // Flush to Zero
 			asm volatile("msr fpcr, %0" : : "ri"(asmStatus));
 		}
 		~StopDenormals() {
@@ -75,7 +103,10 @@ namespace perf {
 #	if __cplusplus >= 202302L
 # 		warning "The `StopDenormals` class doesn't do anything for this architecture"
 #	endif
-	class StopDenormals {}; // FIXME: add for other architectures
+	class StopDenormals { // FIXME: add for other architectures
+	public:
+		static constexpr bool flushes = false;
+	};
 #endif
 
 /** @} */
@@ -9,6 +9,7 @@
 #include "./delay.h"
 
 #include <cmath>
+#include <memory_resource>
 
 namespace signalsmith {
 namespace spectral {
@@ -31,8 +32,8 @@ namespace spectral {
 		using Complex = std::complex<Sample>;
 		MRFFT mrfft{2};
 
-		std::vector<Sample> fftWindow;
-		std::vector<Sample> timeBuffer;
+		std::pmr::vector<Sample> fftWindow;
+		std::pmr::vector<Sample> timeBuffer;
 		int offsetSamples = 0;
 	public:
 		/// Returns a fast FFT size <= `size`
@@ -45,6 +46,7 @@ namespace spectral {
 		}
 
 		WindowedFFT() {}
+		explicit WindowedFFT(std::pmr::polymorphic_allocator<> allocator) : mrfft(2, 0, allocator), fftWindow(allocator), timeBuffer(allocator) {}
 		WindowedFFT(int size, int rotateSamples=0) {
 			setSize(size, rotateSamples);
 		}
@@ -54,7 +56,7 @@ namespace spectral {
 		}
 
 		/// Sets the size, returning the window for modification (initially all 1s)
-		std::vector<Sample> & setSizeWindow(int size, int rotateSamples=0) {
+		std::pmr::vector<Sample> & setSizeWindow(int size, int rotateSamples=0) {
 			mrfft.setSize(size);
 			fftWindow.assign(size, 1);
 			timeBuffer.resize(size);
@@ -82,17 +84,30 @@ namespace spectral {
 			}, Sample(0.5), rotateSamples);
 		}
 
-		const std::vector<Sample> & window() const {
+		const std::pmr::vector<Sample> & window() const {
 			return this->fftWindow;
 		}
 		int size() const {
 			return mrfft.size();
 		}
+		/// Bytes of heap storage held by the FFT, window and time buffer
+		size_t memoryBytes() const {
+			return mrfft.memoryBytes() + (fftWindow.capacity() + timeBuffer.capacity())*sizeof(Sample);
+		}
 		
 		/// Performs an FFT (with windowing)
 		template<class Input, class Output>
 		void fft(Input &&input, Output &&output) {
 			int fftSize = size();
+			if constexpr (std::is_same<Sample, float>::value) {
+				auto *table = signalsmith::kernels::active();
+				if (const float *inputData = table ? signalsmith::kernels::contiguous<const float>(input) : nullptr) {
+					table->window(timeBuffer.data() + fftSize - offsetSamples, inputData, fftWindow.data(), -1, offsetSamples);
+					table->window(timeBuffer.data(), inputData + offsetSamples, fftWindow.data() + offsetSamples, 1, fftSize - offsetSamples);
+					mrfft.fft(timeBuffer, output);
+					return;
+				}
+			}
 			for (int i = 0; i < offsetSamples; ++i) {
 				// Inverted polarity since we're using the MRFFT
 				timeBuffer[i + fftSize - offsetSamples] = -input[i]*fftWindow[i];
@@ -115,6 +130,14 @@ namespace spectral {
 			int fftSize = mrfft.size();
 			Sample norm = 1/(Sample)fftSize;
 
+			if constexpr (std::is_same<Sample, float>::value) {
+				auto *table = signalsmith::kernels::active();
+				if (float *outputData = table ? signalsmith::kernels::contiguous<float>(output) : nullptr) {
+					table->window(outputData, timeBuffer.data() + fftSize - offsetSamples, fftWindow.data(), -norm, offsetSamples);
+					table->window(outputData + offsetSamples, timeBuffer.data(), fftWindow.data() + offsetSamples, norm, fftSize - offsetSamples);
+					return;
+				}
+			}
 			for (int i = 0; i < offsetSamples; ++i) {
 				// Inverted polarity since we're using the MRFFT
 				output[i] = -timeBuffer[i + fftSize - offsetSamples]*norm*fftWindow[i];
@@ -177,10 +200,10 @@ namespace spectral {
 
 		class MultiSpectrum {
 			int channels, stride;
-			std::vector<Complex> buffer;
+			std::pmr::vector<Complex> buffer;
 		public:
 			MultiSpectrum() : MultiSpectrum(0, 0) {}
-			MultiSpectrum(int channels, int bands) : channels(channels), stride(bands), buffer(channels*bands, 0) {}
+			MultiSpectrum(int channels, int bands, std::pmr::polymorphic_allocator<> allocator={}) : channels(channels), stride(bands), buffer(channels*bands, 0, allocator) {}
 			
 			void resize(int nChannels, int nBands) {
 				channels = nChannels;
@@ -191,6 +214,10 @@ namespace spectral {
 			void reset() {
 				buffer.assign(buffer.size(), 0);
 			}
+
+			size_t memoryBytes() const {
+				return buffer.capacity()*sizeof(Complex);
+			}
 			
 			void swap(MultiSpectrum &other) {
 				using std::swap;
@@ -204,7 +231,7 @@ namespace spectral {
 				return buffer.data() + channel*stride;
 			}
 		};
-		std::vector<Sample> timeBuffer;
+		std::pmr::vector<Sample> timeBuffer;
 
 		void resizeInternal(int newChannels, int windowSize, int newInterval, int historyLength, int zeroPadding) {
 			Super::resize(newChannels,
@@ -267,8 +294,8 @@ namespace spectral {
 		WindowedFFT<Sample> fft;
 		
 		STFT() {}
-		/// Parameters passed straight to `.resize()`
-		STFT(int channels, int windowSize, int interval, int historyLength=0, int zeroPadding=0) {
+		/// Parameters passed straight to `.resize()`, with all buffers allocated through `allocator`
+		STFT(int channels, int windowSize, int interval, int historyLength=0, int zeroPadding=0, std::pmr::polymorphic_allocator<> allocator={}) : Super(0, 0, allocator), timeBuffer(allocator), spectrum(0, 0, allocator), fft(allocator) {
 			resize(channels, windowSize, interval, historyLength, zeroPadding);
 		}
 
@@ -304,6 +331,11 @@ namespace spectral {
 			return result;
 		}
 		
+		/// Bytes of heap storage held by the output sum, spectrum and FFT
+		size_t memoryBytes() const {
+			return Super::memoryBytes() + timeBuffer.capacity()*sizeof(Sample) + spectrum.memoryBytes() + fft.memoryBytes();
+		}
+
 		/// Resets everything - since we clear the output sum, it will take `windowSize` samples to get proper output.
 		void reset() {
 			Super::reset();
@@ -320,9 +352,11 @@ namespace spectral {
 		template<class AnalysisFn>
 		void ensureValid(int i, AnalysisFn fn) {
 			while (validUntilIndex < i) {
+				SIGNALSMITH_PERF_SCOPE(hop);
 				int blockIndex = validUntilIndex + 1;
 				fn(blockIndex);
 
+				SIGNALSMITH_PERF_SCOPE(synthesis);
 				auto output = this->view(blockIndex);
 				for (int c = 0; c < channels; ++c) {
 					auto channel = output[c];
@@ -0,0 +1,28 @@
+#ifndef KLARITY_SAMPLER_KERNELS_H
+#define KLARITY_SAMPLER_KERNELS_H
+
+#include <string>
+#include <vector>
+#include "dsp/kernels.h"
+
+/*
+ * Runtime selection between ISA-specific builds of the hot DSP loops (FFT butterflies, complex multiply, windowing,
+ * channel (de)interleaving with gain, and the energy smoothing, peak detection and pitch map of transposition). The
+ * best variant the CPU supports is installed once when the library loads; `KLARITY_SAMPLER_ISA=generic|avx2|avx512|sve`
+ * overrides the choice for A/B benchmarking. x86 variants are picked with cpuid, SVE on Linux AArch64 with
+ * `AT_HWCAP`; AArch64's generic build is already NEON, which every such CPU has.
+ */
+struct KernelDispatch {
+    // Name of the installed variant
+    static std::string isa();
+
+    // Variants that were built in and are supported by this CPU, from narrowest to widest
+    static std::vector<std::string> available();
+
+    // Installs the named variant, returns false if it isn't available (must not race with running playback)
+    static bool select(const std::string &name);
+
+    static const signalsmith::kernels::Table &table();
+};
+
+#endif //KLARITY_SAMPLER_KERNELS_H
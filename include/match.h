@@ -0,0 +1,149 @@
+#ifndef KLARITY_SAMPLER_MATCH_H
+#define KLARITY_SAMPLER_MATCH_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "sampler.h"
+
+// Tempo and key of the input a `TrackAnalyzer` has seen, before its sampler's speed and pitch are applied
+struct TrackAnalysis {
+    // Beats per minute, 0 until a few seconds of input were seen
+    float tempo = 0;
+    // Height of the autocorrelation peak of the onset envelope relative to its energy, 0 to 1
+    float tempoConfidence = 0;
+    // Pitch class of the tonic (0 is C), -1 until the first estimate
+    int keyTonic = -1;
+    bool keyMinor = false;
+    // Correlation of the pitch-class profile with that of the key, -1 to 1
+    float keyConfidence = 0;
+};
+
+/*
+ * Estimates the tempo and key of a track from the spectra its sampler's stretcher computes anyway (see
+ * `Sampler::setSpectrumObserver`), so no second STFT runs. Each block only reads the bands up to 8 kHz: summed into
+ * 20 log-spaced groups for the onset envelope, and, every other block, its spectral peaks from 110 Hz to 5 kHz
+ * folded into 12 pitch classes. Tempo (autocorrelation of the onset envelope over the last 8 s) and key (correlation
+ * with the major and minor key profiles) are re-estimated twice a second. Nothing allocates once configured.
+ */
+struct TrackAnalyzer : signalsmith::stretch::SpectrumObserver<float> {
+private:
+    uint32_t sampleRate;
+    int channels = 0;
+    int fftSize = 0;
+    int interval = 0;
+
+    // Bands read per block, and the onset group of each (-1 for none)
+    int lowBand = 0, highBand = 0;
+    std::vector<int8_t> bandGroups;
+    int chromaLowBand = 0, chromaHighBand = 0;
+    std::vector<float> energy;
+    std::vector<float> groupEnergy, previousGroupEnergy;
+    bool hasPrevious = false;
+
+    // Onset strength on a grid of `interval` input samples, whatever the playback speed
+    std::vector<float> envelope;
+    size_t envelopeWrite = 0, envelopeCount = 0;
+    double inputPosition = 0;
+    int64_t gridCell = -1;
+    float lastOnset = 0;
+    std::vector<float> ordered, autocorrelation;
+    int maxLag = 0;
+
+    std::array<float, 12> chroma{};
+    float chromaDecay = 1;
+    uint64_t blocks = 0;
+    int estimateBlocks = 1;
+
+    std::atomic<bool> resetRequested{false};
+    std::atomic<float> tempo{0}, tempoConfidence{0}, keyConfidence{0};
+    // Tonic + 12 for minor keys, -1 while unknown
+    std::atomic<int> key{-1};
+
+    void clear();
+
+    void addOnset(float onset, int inputInterval);
+
+    void addChroma();
+
+    void estimateTempo();
+
+    void estimateKey();
+
+public:
+    explicit TrackAnalyzer(uint32_t sampleRate);
+
+    void configureSpectrum(int channels, int bands, int fftSize, int interval) override;
+
+    void observeSpectrum(const std::complex<float> *const *spectra, int inputInterval) override;
+
+    // Safe from any thread while the sampler plays
+    TrackAnalysis getAnalysis() const;
+
+    // Starts over with the next block, e.g. for a new track; safe from any thread while the sampler plays
+    void reset();
+};
+
+struct TrackMatchOptions {
+    // Time constant of the glide towards the target speed and transposition
+    float glideSeconds = 2;
+    // Largest speed change applied to the follower (after doubling or halving its tempo), beyond which its tempo is left alone
+    float maxSpeedChange = 0.15f;
+    float minTempoConfidence = 0.1f;
+    float minKeyConfidence = 0.5f;
+    bool matchTempo = true;
+    bool matchKey = true;
+};
+
+struct TrackMatchState {
+    TrackAnalysis leader;
+    TrackAnalysis follower;
+    // What the follower glides towards, and where it is now
+    float targetSpeed = 1;
+    float speed = 1;
+    float targetSemitones = 0;
+    float semitones = 0;
+};
+
+/*
+ * Matches the follower's tempo and key to the leader's, as heard (the leader's own speed and pitch factor included),
+ * for crossfading one track into another. It attaches a `TrackAnalyzer` to each sampler for as long as it lives, and
+ * `update` glides the follower's playback speed and transposition towards the match. Keys are matched through their
+ * relative major, so the shift is at most 6 semitones either way; with a pitch map set on the leader its key shift is
+ * ignored. Estimates below the confidence thresholds keep the previous target.
+ */
+struct TrackMatcher {
+private:
+    Sampler &leader;
+    Sampler &follower;
+    TrackMatchOptions options;
+    TrackAnalyzer leaderAnalyzer;
+    TrackAnalyzer followerAnalyzer;
+    TrackMatchState state;
+    // Last values set on the follower, so unchanged ones aren't set again
+    float appliedSpeed;
+    float appliedSemitones;
+
+public:
+    TrackMatcher(Sampler &leader, Sampler &follower, TrackMatchOptions options = {});
+
+    ~TrackMatcher();
+
+    TrackMatcher(const TrackMatcher &) = delete;
+
+    TrackMatcher &operator=(const TrackMatcher &) = delete;
+
+    /*
+     * Re-targets from the latest estimates and moves the follower `elapsedSeconds` along its glide. Call it regularly
+     * (e.g. after each chunk played) from the thread controlling playback; it takes each sampler's lock briefly.
+     */
+    TrackMatchState update(double elapsedSeconds);
+
+    // Starts the leader's or follower's analysis over, when it moves on to another track
+    void resetLeader();
+
+    void resetFollower();
+};
+
+#endif //KLARITY_SAMPLER_MATCH_H
@@ -0,0 +1,116 @@
+#ifndef KLARITY_SAMPLER_POOL_H
+#define KLARITY_SAMPLER_POOL_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "sampler.h"
+
+// Configuration a pooled sampler is built for
+struct SamplerPoolKey {
+    uint32_t sampleRate = 48000;
+    uint32_t channels = 2;
+    SamplerPreset preset = SamplerPreset::standard;
+    SamplerMemory memory = SamplerMemory::heap;
+    SamplerPrecision precision = SamplerPrecision::full;
+
+    auto operator<=>(const SamplerPoolKey &) const = default;
+};
+
+struct SamplerPoolStats {
+    uint64_t acquisitions = 0;
+    // Acquisitions that found no idle sampler and had to construct one
+    uint64_t misses = 0;
+    uint64_t constructed = 0;
+    // Idle samplers destroyed by `trim`, or released into a full pool
+    uint64_t trimmed = 0;
+    size_t idle = 0;
+    size_t leased = 0;
+    // Time spent in `acquire`
+    ProfileHistogram acquire;
+    // From the start of `acquire` to the first frames handed to the sink, for samplers that played before release
+    ProfileHistogram firstAudio;
+};
+
+struct PooledSink;
+
+/*
+ * Keeps fully configured samplers warm: the stretcher with its FFT setup, windows and band buffers allocated, and the
+ * device stream opened, so starting a track costs a `start` instead of a construction. Up to `capacity` idle samplers
+ * are kept per configuration; those idle for longer than `idleTimeout` are destroyed by `trim`, which `acquire` and
+ * `release` also run.
+ */
+struct SamplerPool {
+    // Creates the sink of each new sampler, PortAudio if not set
+    using SinkFactory = std::function<std::unique_ptr<SamplerSink>(uint32_t sampleRate, uint32_t channels)>;
+
+private:
+    struct Idle {
+        std::unique_ptr<Sampler> sampler;
+        PooledSink *sink;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    struct Lease {
+        SamplerPoolKey key;
+        PooledSink *sink;
+        uint64_t acquiredNanos;
+    };
+
+    std::mutex mutex;
+    size_t capacity;
+    std::chrono::steady_clock::duration idleTimeout;
+    SinkFactory sinkFactory;
+    // Most recently released last, so the warmest sampler is reused first and the coldest is trimmed first
+    std::map<SamplerPoolKey, std::vector<Idle>> idle;
+    std::unordered_map<const Sampler *, Lease> leases;
+    SamplerPoolStats stats;
+
+    // Constructed outside the pool's lock, so other keys aren't held up
+    Idle construct(const SamplerPoolKey &key);
+
+    // Moves out the samplers idle for too long or beyond the capacity, to be destroyed once the lock is released
+    void trimLocked(std::chrono::steady_clock::time_point now, std::vector<std::unique_ptr<Sampler>> &expired);
+
+public:
+    explicit SamplerPool(
+            size_t capacity = 2,
+            std::chrono::steady_clock::duration idleTimeout = std::chrono::minutes(1),
+            SinkFactory sinkFactory = nullptr
+    );
+
+    ~SamplerPool();
+
+    SamplerPool(const SamplerPool &) = delete;
+
+    SamplerPool &operator=(const SamplerPool &) = delete;
+
+    // Constructs samplers for `key` until `count` of them (at most the capacity) are idle
+    void warm(const SamplerPoolKey &key, size_t count);
+
+    // An idle sampler for `key` in its constructed state, or a new one if there is none; `start` it to play
+    std::unique_ptr<Sampler> acquire(const SamplerPoolKey &key);
+
+    /*
+     * Takes back a sampler from `acquire`: stops it (letting its queued output play out, as `stop` does), resets it
+     * and keeps it for the next `acquire`, or destroys it if the pool already holds `capacity` idle ones.
+     */
+    void release(std::unique_ptr<Sampler> sampler);
+
+    // Destroys samplers idle for longer than the idle timeout, returning how many
+    size_t trim();
+
+    void setCapacity(size_t count);
+
+    void setIdleTimeout(std::chrono::steady_clock::duration timeout);
+
+    SamplerPoolStats getStats();
+
+    void resetStats();
+};
+
+#endif //KLARITY_SAMPLER_POOL_H
@@ -0,0 +1,161 @@
+#ifndef KLARITY_SAMPLER_PROFILER_H
+#define KLARITY_SAMPLER_PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "tracer.h"
+
+enum class ProfileStage : uint32_t {
+    play,
+    lockWait,
+    hop,
+    deinterleave,
+    analysis,
+    processSpectrum,
+    findPeaks,
+    updateOutputMap,
+    observeSpectrum,
+    synthesis,
+    interleave,
+    deviceWrite,
+    count
+};
+
+inline const char *profileStageName(ProfileStage stage) {
+    static constexpr const char *names[] = {
+            "play",
+            "lockWait",
+            "hop",
+            "deinterleave",
+            "analysis",
+            "processSpectrum",
+            "findPeaks",
+            "updateOutputMap",
+            "observeSpectrum",
+            "synthesis",
+            "interleave",
+            "deviceWrite"
+    };
+    return stage < ProfileStage::count ? names[static_cast<size_t>(stage)] : "unknown";
+}
+
+// Nanosecond histogram with power-of-two buckets: bucket N holds durations in [2^(N-1), 2^N)
+struct ProfileHistogram {
+    static constexpr size_t buckets = 40;
+
+    uint64_t count = 0;
+    uint64_t totalNanos = 0;
+    uint64_t maxNanos = 0;
+    std::array<uint64_t, buckets> histogram{};
+
+    void record(uint64_t nanos) {
+#ifdef __GNUC__
+        size_t bucket = nanos == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(nanos));
+#else
+        size_t bucket = 0;
+        for (uint64_t remaining = nanos; remaining != 0; remaining >>= 1) ++bucket;
+#endif
+        ++histogram[bucket < buckets ? bucket : buckets - 1];
+        ++count;
+        totalNanos += nanos;
+        if (nanos > maxNanos) maxNanos = nanos;
+    }
+
+    // Upper bound (in nanoseconds) of the bucket containing the given quantile
+    uint64_t percentile(double quantile) const {
+        if (count == 0) return 0;
+        auto target = static_cast<uint64_t>(quantile * static_cast<double>(count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < buckets; ++bucket) {
+            seen += histogram[bucket];
+            if (seen >= target) return bucket == 0 ? 0 : std::min<uint64_t>(maxNanos, (uint64_t{1} << bucket) - 1);
+        }
+        return maxNanos;
+    }
+};
+
+// Per-stage timings, accumulated by whichever thread has bound them with `ProfileBinding`
+struct ProfileStats {
+    std::array<ProfileHistogram, static_cast<size_t>(ProfileStage::count)> stages{};
+
+    ProfileHistogram &operator[](ProfileStage stage) {
+        return stages[static_cast<size_t>(stage)];
+    }
+
+    const ProfileHistogram &operator[](ProfileStage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+
+    static ProfileStats *&current() {
+        static thread_local ProfileStats *stats = nullptr;
+        return stats;
+    }
+};
+
+struct ProfileBinding {
+    ProfileStats *previous;
+
+    explicit ProfileBinding(ProfileStats &stats) : previous(ProfileStats::current()) {
+        ProfileStats::current() = &stats;
+    }
+
+    ~ProfileBinding() {
+        ProfileStats::current() = previous;
+    }
+
+    ProfileBinding(const ProfileBinding &) = delete;
+
+    ProfileBinding &operator=(const ProfileBinding &) = delete;
+};
+
+struct ProfileScope {
+    ProfileHistogram *histogram;
+    std::chrono::steady_clock::time_point start;
+
+    explicit ProfileScope(ProfileStage stage) {
+        ProfileStats *stats = ProfileStats::current();
+        histogram = stats ? &(*stats)[stage] : nullptr;
+        if (histogram) start = std::chrono::steady_clock::now();
+    }
+
+    // Into `stats` whatever is bound, for time spent before the caller can bind them
+    ProfileScope(ProfileStats &stats, ProfileStage stage) : histogram(&stats[stage]), start(std::chrono::steady_clock::now()) {}
+
+    ~ProfileScope() {
+        if (histogram) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+// Instrumentation is compiled in only with KLARITY_SAMPLER_PROFILING and/or KLARITY_SAMPLER_TRACING,
+// otherwise the hooks expand to nothing
+#if defined(KLARITY_SAMPLER_PROFILING) || defined(KLARITY_SAMPLER_TRACING)
+#ifdef SIGNALSMITH_DSP_PERF_H
+#error "profiler.h must be included before the DSP headers"
+#endif
+#define SIGNALSMITH_PERF_SCOPE(stage) KLARITY_PROFILE_SCOPE(stage)
+#endif
+
+#ifdef KLARITY_SAMPLER_PROFILING
+#define KLARITY_PROFILE_BIND(stats) ::ProfileBinding profileBinding(stats)
+#define KLARITY_PROFILE_TIMER(stage) ::ProfileScope profileScope_##stage(::ProfileStage::stage);
+#define KLARITY_PROFILE_TIMER_INTO(stats, stage) ::ProfileScope profileScope_##stage(stats, ::ProfileStage::stage);
+#else
+#define KLARITY_PROFILE_BIND(stats)
+#define KLARITY_PROFILE_TIMER(stage)
+#define KLARITY_PROFILE_TIMER_INTO(stats, stage)
+#endif
+
+#define KLARITY_PROFILE_SCOPE(stage) KLARITY_PROFILE_TIMER(stage) KLARITY_TRACE_SCOPE(stage)
+#define KLARITY_PROFILE_SCOPE_INTO(stats, stage) KLARITY_PROFILE_TIMER_INTO(stats, stage) KLARITY_TRACE_SCOPE(stage)
+
+#endif //KLARITY_SAMPLER_PROFILER_H
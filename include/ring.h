@@ -0,0 +1,120 @@
+#ifndef KLARITY_SAMPLER_RING_H
+#define KLARITY_SAMPLER_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ * Single-producer single-consumer ring of interleaved float frames, lock-free on both sides.
+ * The producer may drop everything written so far with `discard`, which the consumer applies on its next read.
+ */
+struct FrameRing {
+private:
+    uint32_t channels;
+    uint64_t capacityFrames;
+    std::vector<float> samples;
+    // Free-running frame counters, so `writeIndex - readIndex` is the fill level
+    alignas(64) std::atomic<uint64_t> writeIndex{0};
+    alignas(64) std::atomic<uint64_t> readIndex{0};
+    alignas(64) std::atomic<uint64_t> discardIndex{0};
+
+    void store(uint64_t index, const float *source, uint64_t frames) {
+        uint64_t offset = index % capacityFrames;
+        uint64_t first = std::min(frames, capacityFrames - offset);
+        std::memcpy(samples.data() + offset * channels, source, first * channels * sizeof(float));
+        std::memcpy(samples.data(), source + first * channels, (frames - first) * channels * sizeof(float));
+    }
+
+    void load(uint64_t index, float *destination, uint64_t frames) const {
+        uint64_t offset = index % capacityFrames;
+        uint64_t first = std::min(frames, capacityFrames - offset);
+        std::memcpy(destination, samples.data() + offset * channels, first * channels * sizeof(float));
+        std::memcpy(destination + first * channels, samples.data(), (frames - first) * channels * sizeof(float));
+    }
+
+public:
+    FrameRing(uint32_t channels, uint64_t capacityFrames) :
+            channels(channels),
+            capacityFrames(capacityFrames),
+            samples(static_cast<size_t>(capacityFrames) * channels) {}
+
+    uint64_t capacity() const {
+        return capacityFrames;
+    }
+
+    // Frames written and not yet read, including discarded ones the consumer hasn't skipped yet
+    uint64_t size() const {
+        return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+    }
+
+    // Producer: writes as many frames as fit, returning how many
+    uint64_t write(const float *source, uint64_t frames) {
+        uint64_t write = writeIndex.load(std::memory_order_relaxed);
+        // Discarded frames only become free once the consumer has skipped them, it may still be reading them
+        uint64_t read = readIndex.load(std::memory_order_acquire);
+        uint64_t count = std::min(frames, capacityFrames - (write - read));
+        store(write, source, count);
+        writeIndex.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    // Producer: drops every frame written so far that hasn't been read yet
+    void discard() {
+        discardIndex.store(writeIndex.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    // Consumer: applies a pending `discard` without reading anything, freeing the space for the producer
+    void skipDiscarded() {
+        uint64_t target = discardIndex.load(std::memory_order_acquire);
+        if (target > readIndex.load(std::memory_order_relaxed)) {
+            readIndex.store(target, std::memory_order_release);
+        }
+    }
+
+    // Consumer: reads up to `frames` frames, returning how many
+    uint64_t read(float *destination, uint64_t frames) {
+        uint64_t read = std::max(readIndex.load(std::memory_order_relaxed), discardIndex.load(std::memory_order_acquire));
+        uint64_t count = std::min(frames, writeIndex.load(std::memory_order_acquire) - read);
+        load(read, destination, count);
+        readIndex.store(read + count, std::memory_order_release);
+        return count;
+    }
+};
+
+/*
+ * Single-producer single-consumer queue of fixed capacity for small trivially copyable items (e.g. pointers handed
+ * between a thread and the device callback), lock-free on both sides.
+ */
+template<typename T>
+struct SpscQueue {
+private:
+    std::vector<T> items;
+    alignas(64) std::atomic<uint64_t> writeIndex{0};
+    alignas(64) std::atomic<uint64_t> readIndex{0};
+
+public:
+    explicit SpscQueue(size_t capacity) : items(capacity) {}
+
+    // Producer: false if the queue is full
+    bool push(const T &item) {
+        uint64_t write = writeIndex.load(std::memory_order_relaxed);
+        if (write - readIndex.load(std::memory_order_acquire) == items.size()) return false;
+        items[write % items.size()] = item;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false if the queue is empty
+    bool pop(T &item) {
+        uint64_t read = readIndex.load(std::memory_order_relaxed);
+        if (read == writeIndex.load(std::memory_order_acquire)) return false;
+        item = items[read % items.size()];
+        readIndex.store(read + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif //KLARITY_SAMPLER_RING_H
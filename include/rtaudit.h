@@ -0,0 +1,62 @@
+#ifndef KLARITY_SAMPLER_RTAUDIT_H
+#define KLARITY_SAMPLER_RTAUDIT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class RealtimeViolationType : uint32_t {
+    allocation,
+    lock,
+    syscall
+};
+
+struct RealtimeViolation {
+    RealtimeViolationType type;
+    std::string function;
+    std::vector<std::string> stack;
+};
+
+/*
+ * Debug mode that interposes the allocator, blocking pthread primitives and common blocking syscalls, and checks
+ * whether they are reached from a thread inside a `RealtimeSection`. Interposition only takes effect when the
+ * library is linked at startup (or preloaded), not when it is loaded later with dlopen.
+ *
+ * The mode defaults to `KLARITY_RT_AUDIT=off|record|abort` from the environment, or `record` if unset.
+ */
+struct RealtimeAudit {
+    enum class Mode {
+        off,
+        record,
+        abort
+    };
+
+    static void setMode(Mode mode);
+
+    static Mode mode();
+
+    // Violations recorded so far, with symbolized stack traces (bounded; `violationCount` keeps counting)
+    static std::vector<RealtimeViolation> violations();
+
+    static uint64_t violationCount();
+
+    static void clear();
+};
+
+struct RealtimeSection {
+    RealtimeSection();
+
+    ~RealtimeSection();
+
+    RealtimeSection(const RealtimeSection &) = delete;
+
+    RealtimeSection &operator=(const RealtimeSection &) = delete;
+};
+
+#ifdef KLARITY_SAMPLER_RT_AUDIT
+#define KLARITY_REALTIME_SECTION() ::RealtimeSection realtimeSection
+#else
+#define KLARITY_REALTIME_SECTION()
+#endif
+
+#endif //KLARITY_SAMPLER_RTAUDIT_H
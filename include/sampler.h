@@ -1,37 +1,438 @@
 #ifndef KLARITY_SAMPLER_H
 #define KLARITY_SAMPLER_H
 
+#include <coroutine>
 #include <cstring>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include "arena.h"
+#include "async.h"
+#include "cache.h"
 #include "exception.h"
+#include "profiler.h"
+#include "kernels.h"
+#include "rtaudit.h"
 #include "stretch/stretch.h"
-#include "portaudio.h"
 #include "deleter.h"
+#include "sink.h"
+#include "source.h"
+
+enum class SamplerPreset {
+    standard,
+    cheaper
+};
+
+enum class SamplerMemory {
+    // Stretcher buffers are separate heap allocations
+    heap,
+    // Stretcher and all its buffers live in one arena sized for the configuration (see arena.h)
+    arena
+};
+
+enum class SamplerPrecision {
+    full,
+    // State carried between blocks is stored as bfloat16 (see SignalsmithStretch::setCompactState)
+    compact
+};
+
+// Bytes held by a Sampler, by component (excluding the sink's device buffers)
+struct SamplerMemoryUsage {
+    signalsmith::stretch::SignalsmithStretch<float>::MemoryUsage stretch;
+    size_t sampler = 0;
+    // Planar and interleaved buffers for play()
+    size_t playbackBuffers = 0;
+    // Arena capacity not held by the stretcher (alignment padding and buffers replaced during configuration)
+    size_t arenaOverhead = 0;
+    // Rendered chunks and input history held for the render cache
+    size_t cache = 0;
+
+    size_t total() const {
+        return stretch.total() + sampler + playbackBuffers + arenaOverhead + cache;
+    }
+};
+
+// NaN/Inf samples replaced with silence by `Sampler::play`
+struct NonFiniteStats {
+    uint64_t inputSamples = 0;
+    uint64_t outputSamples = 0;
+    uint64_t affectedCalls = 0;
+    // Non-finite output means the stretcher state is poisoned, so it is reset
+    uint64_t stretchResets = 0;
+};
+
+// One packet of interleaved float frames for `Sampler::playBatch`
+struct SamplerChunk {
+    const uint8_t *samples;
+    uint64_t size;
+};
+
+struct Sampler;
+
+/*
+ * Awaitable of `Sampler::playAsync` and `Sampler::drained`. A coroutine awaiting it is resumed on a thread running the
+ * executor once the device has taken the rendered output (and, for `drained`, played all of it); it doesn't suspend
+ * if the output fit right away.
+ */
+struct SamplerAwaitable : AsyncWaiter {
+private:
+    friend struct Sampler;
+
+    Sampler *sampler;
+    SamplerExecutor *executor;
+    std::coroutine_handle<> handle;
+    bool drain;
+    bool draining = false;
+    bool done;
+
+    SamplerAwaitable(Sampler &sampler, SamplerExecutor &executor, bool drain, bool done);
+
+    static void resumeWhenDone(AsyncWaiter *waiter);
+
+public:
+    bool await_ready() const noexcept {
+        return done;
+    }
+
+    bool await_suspend(std::coroutine_handle<> coroutine);
+
+    void await_resume() const noexcept {}
+};
 
 struct Sampler {
 private:
+    using StretchPointer = std::unique_ptr<signalsmith::stretch::SignalsmithStretch<float>, SignalsmithStretchDeleter>;
+
     std::mutex mutex;
     uint32_t sampleRate;
     uint32_t channels;
-    std::unique_ptr<PaStream, PaStreamDeleter> stream;
-    std::unique_ptr<signalsmith::stretch::SignalsmithStretch<float>, SignalsmithStretchDeleter> stretch;
+    SamplerPreset preset;
+    SamplerMemory memory;
+    SamplerPrecision precision;
+    std::unique_ptr<SamplerSink> sink;
+    // Declared before the stretchers so they outlive them
+    std::unique_ptr<StretchArena> arena;
+    std::unique_ptr<StretchArena> nextArena;
+    std::unique_ptr<StretchArena> eventArena;
+    StretchPointer stretch;
+    // Spare stretcher, holding the pre-rolled start of the queued track while one is queued
+    StretchPointer nextStretch;
+    bool nextQueued = false;
+    // Interleaved output of the queued track beyond its pre-roll, written right after the transition
+    std::vector<float> nextOutput;
+    // Renders scheduled events from a reset state, so they don't disturb playback
+    StretchPointer eventStretch;
+    bool paused = false;
+    // One period of the looped input, the end of the segment crossfaded into its start
+    std::vector<std::vector<float>> loopBuffers;
+    uint64_t loopPosition = 0;
+    // Fraction of an output frame carried between `playLoop` calls, so the loop period stays exact
+    double loopOutputRemainder = 0;
+    /*
+     * Rendered chunks keyed by a chain hash of everything the stretcher was fed since its last reset, so a hit is
+     * exactly what the stretcher would render again. `cacheHistory` rings the latest input of the chain, which rebuilds
+     * the stretcher after it was bypassed.
+     */
+    RenderCache cache;
+    uint64_t cacheChain = 0;
+    uint64_t cacheEpoch = 0;
+    std::vector<std::vector<float>> cacheHistory;
+    uint64_t cacheHistoryFrames = 0;
+    // The stretcher missed the chunks served from the cache, it is rebuilt before it is used again
+    bool stretchStale = false;
+    // Chain origin and input of the queued track's head
+    uint64_t nextCacheOrigin = 0;
+    std::vector<std::vector<float>> nextHead;
     float playbackSpeedFactor = 1.0f;
+    float pitchFactor = 1.0f;
+    // Hz, 0 to transpose the whole spectrum
+    float pitchTonalityLimit = 0.0f;
+    // Hz to Hz, overrides the pitch factor while set
+    std::function<float(float)> pitchMap;
+    // Tells the maps apart in the cache key, 0 while none is set
+    uint32_t pitchMapId = 0;
+    uint32_t pitchMapCount = 0;
+    bool transientReset = false;
     float volume = 1.0f;
+    // Sees the spectra of the playing track's stretcher, not of queued tracks or scheduled events
+    signalsmith::stretch::SpectrumObserver<float> *spectrumObserver = nullptr;
+    ProfileStats profileStats;
+    NonFiniteStats nonFiniteStats;
+    std::vector<std::vector<float>> inputBuffers;
+    std::vector<std::vector<float>> outputBuffers;
+    std::vector<float> outputBuffer;
+    std::vector<float *> inputPointers;
+    // Per-packet offsets into the input buffers for `playBatch`
+    std::vector<float *> chunkPointers;
+    // Output of `playAsync` the sink has no room for yet, from frame `pendingOffset` of `outputBuffer` on
+    uint64_t pendingOffset = 0;
+    uint64_t pendingFrames = 0;
+    std::vector<const float *> outputPointers;
+
+    std::unique_lock<std::mutex> acquireLock();
+
+    // A configured stretcher at the current pitch
+    StretchPointer createStretch(std::unique_ptr<StretchArena> &stretchArena);
+
+    void applyPitch(signalsmith::stretch::SignalsmithStretch<float> &target) const;
+
+    // Grow-only, so steady-state playback doesn't allocate
+    void ensureBuffers(int inputSamples, int outputSamples);
+
+    int preRollSamples() const;
+
+    std::vector<std::vector<float>> deinterleaveInput(const uint8_t *samples, int inputSamples);
+
+    // Processes a pre-roll from a reset stretcher and keeps the interleaved output that follows its ramp-up
+    void renderHead(signalsmith::stretch::SignalsmithStretch<float> &target, const std::vector<std::vector<float>> &inputs,
+                    int inputSamples, std::vector<float> &output, float gain);
+
+    // Stretches a scheduled event in full, tail included, with its first frame at the start of the output
+    std::unique_ptr<TimelineEvent> renderEvent(const uint8_t *samples, uint64_t size);
+
+    void scheduleEvent(std::unique_ptr<TimelineEvent> event);
+
+    // Throws unless the stretcher is free to take new input: not looping, no asynchronous play pending
+    void checkRenderable();
+
+    // Throws unless new input can be played now, into the running sink
+    void checkPlayable();
+
+    // Stretches the packets into `outputBuffer`, returning the output frames
+    int renderBatch(const SamplerChunk *chunks, size_t count);
+
+    void checkFile(const PcmFile &file, uint64_t from, uint64_t frames);
+
+    // Stretches one block of `file` into `output` (`outputBuffer` if nullptr), returning the output frames
+    int renderFileBlock(const PcmFile &file, uint64_t frame, int inputSamples, float *output);
+
+    // Hands the sink as much pending output as it takes without blocking, true while some is left
+    bool flushPending();
+
+    // Moves an asynchronous operation on, true once it is done, otherwise it is woken again when the sink has room
+    bool advanceAsync(SamplerAwaitable &operation);
+
+    friend struct SamplerAwaitable;
+
+    // Stretches `inputs` into the interleaved `output`, inside the caller's real-time section
+    template<class Inputs>
+    void processBuffers(Inputs &&inputs, int inputSamples, float *output, int outputSamples, size_t nonFiniteInput);
+
+    // Chain origin of a reset stretcher at the current configuration and speed
+    uint64_t cacheSeed() const;
+
+    // Chain origin no earlier chain can reach, for stretcher states the cache can't reproduce
+    uint64_t uniqueCacheOrigin();
+
+    void restartCacheChain(uint64_t origin);
+
+    void appendCacheHistory(const float *const *inputs, int inputSamples);
+
+    // Primes a reset stretcher with the chain's latest input, so it continues where the cached chunks left off
+    void rebuildStretch();
 
 public:
-    explicit Sampler(uint32_t sampleRate, uint32_t channels);
+    explicit Sampler(
+            uint32_t sampleRate,
+            uint32_t channels,
+            SamplerPreset preset = SamplerPreset::standard,
+            std::unique_ptr<SamplerSink> sink = nullptr,
+            SamplerMemory memory = SamplerMemory::heap,
+            SamplerPrecision precision = SamplerPrecision::full
+    );
 
     void setPlaybackSpeed(float factor);
 
+    /*
+     * Transposes the pitch by `factor` (2 is an octave up) without changing the playback speed. With a tonality limit
+     * in Hz, partials below it are transposed and the spectrum above it is only shifted along, which keeps the upper
+     * formants and breath of a voice closer to where they were. A factor of 1 skips the peak analysis it needs.
+     */
+    void setPitchFactor(float factor, float tonalityLimit = 0);
+
+    void setPitchSemitones(float semitones, float tonalityLimit = 0);
+
+    uint32_t getSampleRate() const;
+
+    float getPlaybackSpeed();
+
+    // 1 while a pitch map is set
+    float getPitchFactor();
+
+    /*
+     * Moves each spectral peak from its frequency to `inputToOutput(frequency)` (Hz, monotonically increasing), for
+     * curves such as key correction. The map is sampled once per band when it is set and interpolated from then on, so
+     * playback never calls it. `setPitchFactor` and `setPitchSemitones` replace it.
+     */
+    void setPitchMap(std::function<float(float)> inputToOutput);
+
+    /*
+     * Re-anchors the phases of onsets to the input's (see `SignalsmithStretch::setTransientReset`), which keeps drums
+     * and consonants sharp when playing much faster or slower than recorded. With it, the cheaper preset smears onsets
+     * less than the standard one does without.
+     */
+    void setTransientReset(bool enabled);
+
     void setVolume(float value);
 
+    /*
+     * Shows `observer` (not owned, nullptr to detach) the input spectrum of every block the stretcher analyses for the
+     * playing track, e.g. for a `TrackAnalyzer`. It carries over to the queued track at `finishTrack` and is detached
+     * by `reset`. It is called from inside the playback calls, so it must neither block nor allocate.
+     */
+    void setSpectrumObserver(signalsmith::stretch::SpectrumObserver<float> *observer);
+
     int start();
 
     void play(const uint8_t *samples, uint64_t size);
 
+    /*
+     * Plays `count` packets as one `play` call: one lock, one stretch call and one sink write for all of them, so
+     * small packets don't each pay the per-call overhead. Packets need not be contiguous.
+     */
+    void playBatch(const SamplerChunk *chunks, size_t count);
+
+    /*
+     * `co_await sampler.playAsync(executor, samples, size)` stretches like `play` right away, then suspends instead of
+     * blocking while the device has no room for the output; the device callback posts the coroutine to `executor`.
+     * Await each call before the next one, other playback calls throw until it completes.
+     */
+    SamplerAwaitable playAsync(SamplerExecutor &executor, const uint8_t *samples, uint64_t size);
+
+    // `co_await sampler.drained(executor)` resumes once everything played so far has reached the device
+    SamplerAwaitable drained(SamplerExecutor &executor);
+
+    // Frames `playFile` and `renderFile` stretch per call of the stretcher
+    static constexpr uint64_t fileBlockFrames = 4096;
+
+    /*
+     * Plays `frames` frames of `file` from frame `from` like a series of `play` calls, with the stretcher reading the
+     * mapped pages in place instead of a deinterleaved copy. Pages are released once played, so the file's resident
+     * memory stays bounded however long it is. Blocks holding NaN/Inf, and all blocks while the render cache is on, go
+     * through `play`'s copy, which cleans up the input before the stretcher sees it.
+     */
+    void playFile(const PcmFile &file, uint64_t from, uint64_t frames);
+
+    // Output frames `renderFile` produces for `frames` input frames at the current speed
+    uint64_t getFileOutputFrames(uint64_t frames);
+
+    /*
+     * Offline `playFile`: continues from the current stretcher state like `playFile`, but writes the interleaved output
+     * straight into `output` (at least `getFileOutputFrames(frames)` frames) instead of the sink, returning the frames
+     * written. The sink needn't be started, and a paused sampler renders too.
+     */
+    uint64_t renderFile(const PcmFile &file, uint64_t from, uint64_t frames, float *output);
+
     void stop();
+
+    /*
+     * Returns a stopped sampler to the state it was constructed in: speed, pitch and volume 1, no transient reset,
+     * loop, queued track, pending output, spectrum observer, cache or statistics. The stretcher with its FFT setup and
+     * buffers, and the opened device stream are kept, so reusing a sampler for the next track (see `SamplerPool`) costs
+     * no more than `start`.
+     */
+    void reset();
+
+    /*
+     * Fades out and holds the output, keeping the device stream, the audio queued in the sink and the stretcher state.
+     * `play` and `finishTrack` throw while paused, `seek` replaces what resume will play.
+     */
+    void pause();
+
+    // Fades back in from exactly the frame where `pause` faded out
+    void resume();
+
+    bool isPaused();
+
+    /*
+     * Loops `samples` (the A-B segment) from now on, without further input. Its last `crossfadeFrames` frames are
+     * crossfaded into its first ones, so a pass lasts the segment minus the crossfade. The stretcher history is primed
+     * with the end of the loop, so the first pass starts like every other. Like `seek`, audio queued in the sink is
+     * dropped and the next frame heard is the start of the segment. `play` and `seek` throw until `stopLoop`, and so
+     * does this call while paused, already looping or with a track queued.
+     */
+    void startLoop(const uint8_t *samples, uint64_t size, uint64_t crossfadeFrames);
+
+    // Stretches the next `frames` frames of the loop into the sink
+    void playLoop(uint64_t frames);
+
+    // Releases the loop, playback continues with `play` from the current stretcher state
+    void stopLoop();
+
+    bool isLooping();
+
+    // Frames from the start of the next track that `queueNext` needs, at the current playback speed
+    uint64_t getPreRollFrames();
+
+    /*
+     * Pre-rolls the start of the next track (at least `getPreRollFrames()` frames) on a spare stretcher, so its output
+     * starts fully formed at its first frame. Call `finishTrack` when the current track's last frames have been
+     * played, then continue with `play` from the frame after `samples`.
+     */
+    void queueNext(const uint8_t *samples, uint64_t size);
+
+    /*
+     * Drains the current track's tail into the sink and splices in the queued track, if any, sample-accurately and
+     * without stopping the device. Without a queued track the stretcher is reset for a fresh start.
+     */
+    void finishTrack();
+
+    // Frames before the seek target that `seek` uses to prime the stretcher's history (one block plus one interval)
+    uint64_t getSeekHistoryFrames();
+
+    /*
+     * Jumps to a new position without restarting the device: frames already queued in the sink are dropped, the
+     * stretcher is primed with `history` (the frames just before the target, may be empty) and pre-rolled with
+     * `samples` (at least `getPreRollFrames()` frames from the target), so the first frame played is the target itself.
+     * Continue with `play` from the frame after `samples`.
+     */
+    void seek(const uint8_t *history, uint64_t historySize, const uint8_t *samples, uint64_t size);
+
+    // Frames the device has played since `start`, the timeline of `scheduleAtFrame`
+    uint64_t getStreamFrame();
+
+    /*
+     * Stretches `samples` at the current speed and volume and mixes them into the output with their first frame at
+     * stream frame `frame`, on top of whatever `play` queued and of other scheduled events. Scheduled audio follows the
+     * stream clock, not the queue: `seek`, `pause` and `stop` don't move it. An event scheduled too late to start on
+     * time is cut so its remainder still plays at its place on the timeline.
+     */
+    void scheduleAtFrame(const uint8_t *samples, uint64_t size, uint64_t frame);
+
+    // As `scheduleAtFrame`, with the first frame reaching the DAC at `time` in `Pa_GetStreamTime` units
+    void scheduleAtTime(const uint8_t *samples, uint64_t size, double time);
+
+    /*
+     * Caches rendered chunks of up to `bytes` bytes in total, evicting the least recently used; 0 (the default) turns
+     * the cache off. A `play` call whose input, speed and preset match a cached chunk and follows the same input since
+     * the last `start`, `seek` or track change (e.g. replaying a segment after seeking back to it) is served from the
+     * cache without stretching. Afterwards the stretcher is rebuilt from the input of the chain, as `seek` does.
+     */
+    void setCacheLimit(size_t bytes);
+
+    RenderCacheStats getCacheStats();
+
+    void resetCacheStats();
+
+    void clearCache();
+
+    ProfileStats getProfileStats();
+
+    void resetProfileStats();
+
+    NonFiniteStats getNonFiniteStats();
+
+    void resetNonFiniteStats();
+
+    SamplerMemoryUsage getMemoryUsage();
+
+    // Arena backing the stretcher, or nullptr with `SamplerMemory::heap`
+    const StretchArena *getArena() const;
+
+    static void dumpTrace(const std::string &path);
+
+    static void clearTrace();
 };
 
 #endif //KLARITY_SAMPLER_H
@@ -0,0 +1,208 @@
+#ifndef KLARITY_SAMPLER_SINK_H
+#define KLARITY_SAMPLER_SINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "portaudio.h"
+#include "async.h"
+#include "deleter.h"
+#include "ring.h"
+#include "timeline.h"
+
+// Destination of the rendered interleaved float frames
+struct SamplerSink {
+    virtual ~SamplerSink() = default;
+
+    virtual void start() = 0;
+
+    virtual void stop() = 0;
+
+    virtual bool isActive() = 0;
+
+    // Blocks until all frames have been accepted, throws if the stream stops first
+    virtual void write(const float *samples, uint64_t frames) = 0;
+
+    // Accepts as many frames as there is room for without blocking, returning how many
+    virtual uint64_t tryWrite(const float *samples, uint64_t frames) {
+        write(samples, frames);
+        return frames;
+    }
+
+    // Posts `waiter` to `executor` once `frames` frames fit (all of the queue, if more), at once if the sink never blocks
+    virtual void notifyWhenFree(uint64_t frames, AsyncWaiter &waiter, SamplerExecutor &executor) {
+        (void) frames;
+        executor.post(waiter);
+    }
+
+    // Drops frames that were written but not played yet, keeping the stream running
+    virtual void discard() = 0;
+
+    // Fades out and holds the output, keeping the stream running and the unplayed frames queued
+    virtual void pause() = 0;
+
+    // Fades back in, continuing with the frame after the last one faded out
+    virtual void resume() = 0;
+
+    // Output latency in seconds
+    virtual double latency() = 0;
+
+    // Frames the device has played since `start`, the timeline that scheduled events are placed on
+    virtual uint64_t position() = 0;
+
+    // Mixes `event` into the output at its place on the timeline, false if too many events are pending
+    virtual bool schedule(std::unique_ptr<TimelineEvent> event) = 0;
+};
+
+/*
+ * Frames on their way to the device: the producer side fills a ring, and the device side plays it, fading out over
+ * `fadeFrames` on pause and then taking nothing more from the ring until resumed. Scheduled events are mixed on top,
+ * on a timeline that runs on through pauses and discards.
+ */
+struct DeviceQueue {
+public:
+    static constexpr size_t maxScheduledEvents = 256;
+
+private:
+    uint32_t channels;
+    uint64_t fadeFrames;
+    FrameRing ring;
+    Timeline timeline;
+    std::atomic<bool> paused{false};
+    // Frames of fade left before silence, only touched by the device side
+    uint64_t fadeLevel;
+    // Frames rendered since the last `resetTimeline`
+    std::atomic<uint64_t> renderedFrames{0};
+    // Producer waiting for room, posted by the device side
+    std::atomic<AsyncWaiter *> waiter{nullptr};
+    SamplerExecutor *waiterExecutor = nullptr;
+    uint64_t waiterFrames = 0;
+    // Bumped whenever the device side takes frames, woken only while a blocking producer waits on it
+    std::atomic<uint32_t> freed{0};
+    std::atomic<bool> writerWaiting{false};
+
+public:
+    DeviceQueue(uint32_t channels, uint32_t sampleRate, uint64_t capacityFrames, uint64_t fadeFrames);
+
+    uint64_t capacity() const;
+
+    uint64_t size() const;
+
+    // Producer: writes as many frames as fit, returning how many
+    uint64_t write(const float *samples, uint64_t frames);
+
+    void discard();
+
+    void pause();
+
+    void resume();
+
+    bool isPaused() const;
+
+    // Producer: posts `waiter` to `executor` from the device side once `frames` frames are free (at most the capacity)
+    void notifyWhenFree(uint64_t frames, AsyncWaiter &waiter, SamplerExecutor &executor);
+
+    // Producer: posts a pending waiter right away, for when the device side stops running
+    void releaseWaiter();
+
+    // Producer: the token for `waitForRoom`, taken before the write that found the queue full
+    uint32_t freedCount() const;
+
+    // Producer: blocks until the device side has taken frames since `freedCount` returned `seen`, or `wakeWriter`
+    void waitForRoom(uint32_t seen);
+
+    // Ends a `waitForRoom` right away, for when the device side stops running
+    void wakeWriter();
+
+    uint64_t position() const;
+
+    // Producer: false if `maxScheduledEvents` events are pending
+    bool schedule(std::unique_ptr<TimelineEvent> event);
+
+    // Drops scheduled events and restarts the timeline at frame 0, only while the device side isn't running
+    void resetTimeline();
+
+    uint64_t lateEvents() const;
+
+    /*
+     * Device: fills `frames` frames of output, whose first frame reaches the DAC at stream time `outputTime`, returning
+     * how many were taken from the queue (the rest is silence plus scheduled events)
+     */
+    uint64_t render(float *output, uint64_t frames, double outputTime = 0);
+};
+
+// Default output device through a PortAudio callback stream, fed from a `DeviceQueue`
+struct PortAudioSink : SamplerSink {
+private:
+    uint32_t sampleRate;
+    uint32_t channels;
+    // Declared before the stream so it outlives the callback
+    std::unique_ptr<DeviceQueue> queue;
+    std::unique_ptr<PaStream, PaStreamDeleter> stream;
+
+    static int callback(const void *input, void *output, unsigned long frames, const PaStreamCallbackTimeInfo *timeInfo,
+                        PaStreamCallbackFlags statusFlags, void *userData);
+
+    // The stream went inactive, stopped or on a device error
+    static void finished(void *userData);
+
+public:
+    explicit PortAudioSink(uint32_t sampleRate, uint32_t channels);
+
+    void start() override;
+
+    void stop() override;
+
+    bool isActive() override;
+
+    void write(const float *samples, uint64_t frames) override;
+
+    uint64_t tryWrite(const float *samples, uint64_t frames) override;
+
+    void notifyWhenFree(uint64_t frames, AsyncWaiter &waiter, SamplerExecutor &executor) override;
+
+    void discard() override;
+
+    void pause() override;
+
+    void resume() override;
+
+    double latency() override;
+
+    uint64_t position() override;
+
+    bool schedule(std::unique_ptr<TimelineEvent> event) override;
+};
+
+// Discards all output, for headless benchmarks and offline runs
+struct NullSink : SamplerSink {
+private:
+    bool active = false;
+    uint64_t frames = 0;
+
+public:
+    void start() override;
+
+    void stop() override;
+
+    bool isActive() override;
+
+    void write(const float *samples, uint64_t frames) override;
+
+    void discard() override;
+
+    void pause() override;
+
+    void resume() override;
+
+    double latency() override;
+
+    // Frames written, as there is no device clock
+    uint64_t position() override;
+
+    bool schedule(std::unique_ptr<TimelineEvent> event) override;
+
+    uint64_t framesWritten() const;
+};
+
+#endif //KLARITY_SAMPLER_SINK_H
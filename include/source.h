@@ -0,0 +1,79 @@
+#ifndef KLARITY_SAMPLER_SOURCE_H
+#define KLARITY_SAMPLER_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One channel of interleaved frames, indexed the way the stretcher reads its input
+struct StridedChannel {
+    const float *data;
+    size_t stride;
+
+    float operator[](int frame) const {
+        return data[static_cast<size_t>(frame) * stride];
+    }
+};
+
+// Planar view of interleaved frames, so the stretcher reads them in place instead of from deinterleaved copies
+struct StridedFrames {
+    const float *data;
+    uint32_t channels;
+
+    StridedChannel operator[](int channel) const {
+        return {data + channel, channels};
+    }
+};
+
+/*
+ * File of interleaved 32-bit float PCM mapped read-only: a WAV file (IEEE float, plain or extensible format) or raw
+ * headerless samples. The mapping is advised for sequential read-ahead, so the pages are read in ahead of playback
+ * instead of being faulted in one by one, and `release` drops pages already played from the resident set (they stay in
+ * the page cache). `Sampler::playFile` and `Sampler::renderFile` stretch straight from the mapped pages.
+ */
+struct PcmFile {
+private:
+    void *mapping = nullptr;
+    size_t mappedBytes = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+    const float *samples = nullptr;
+    uint64_t frameCount = 0;
+    uint32_t channelCount = 0;
+    uint32_t rate = 0;
+
+    void map(const std::string &path);
+
+    void unmap();
+
+    void parseWav();
+
+public:
+    // Opens a WAV file, or raw samples with `channels` channels if it has no RIFF header
+    explicit PcmFile(const std::string &path, uint32_t channels = 0);
+
+    ~PcmFile();
+
+    PcmFile(const PcmFile &) = delete;
+
+    PcmFile &operator=(const PcmFile &) = delete;
+
+    // Interleaved samples of the whole file
+    const float *data() const;
+
+    uint64_t frames() const;
+
+    uint32_t channels() const;
+
+    // Sample rate of a WAV file, 0 for raw samples
+    uint32_t sampleRate() const;
+
+    StridedFrames view(uint64_t frame) const;
+
+    // Drops the pages of frames [from, to) but the last one from the resident set, they are read in again if accessed
+    void release(uint64_t from, uint64_t to) const;
+};
+
+#endif //KLARITY_SAMPLER_SOURCE_H
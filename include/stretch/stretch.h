@@ -6,17 +6,41 @@
 #include "dsp/perf.h"
 SIGNALSMITH_DSP_VERSION_CHECK(1, 6, 0); // Check version is compatible
 #include <vector>
+#include <memory_resource>
 #include <algorithm>
 #include <functional>
 #include <random>
+#include <bit>
+#include <concepts>
 
 namespace signalsmith { namespace stretch {
 
+        /// Sees the input spectrum of each block the stretcher analyses, so other analysis can reuse its STFT
         template<typename Sample=float>
+        struct SpectrumObserver {
+            virtual ~SpectrumObserver() = default;
+            /// Called when attached and on every `configure()`, outside of processing, so buffers can be sized here
+            virtual void configureSpectrum(int channels, int bands, int fftSize, int interval) = 0;
+            /** Called for each block of new input, from inside `process()`. `spectra[c]` holds the bands of channel `c`, whose
+                magnitudes are those of the windowed input (phases aren't centred). `inputInterval` is the input samples
+                since the previous block, 0 after a seek. */
+            virtual void observeSpectrum(const std::complex<Sample> *const *spectra, int inputInterval) = 0;
+        };
+
+        /// `FreqMap` optionally names a functor type for `setFreqMap()`, which is then called inline rather than through `std::function`
+        template<typename Sample=float, class FreqMap=void>
         struct SignalsmithStretch {
 
             SignalsmithStretch() : randomEngine(std::random_device{}()) {}
             SignalsmithStretch(long seed) : randomEngine(seed) {}
+            /// All state is allocated through `allocator` (e.g. an arena sized for one configuration)
+            explicit SignalsmithStretch(std::pmr::polymorphic_allocator<> allocator) : SignalsmithStretch(std::random_device{}(), allocator) {}
+            SignalsmithStretch(long seed, std::pmr::polymorphic_allocator<> allocator)
+                    : stft(0, 1, 1, 0, 0, allocator), inputBuffer(0, 0, allocator), compactInputBuffer(0, 0, allocator), timeBuffer(allocator),
+                      rotCentreSpectrum(allocator), rotPrevInterval(allocator), channelBands(allocator),
+                      prevInputs(allocator), prevOutputs(allocator), compactPrevInputs(allocator), compactPrevOutputs(allocator),
+                      peaks(allocator), energy(allocator), smoothedEnergy(allocator), peakMask(allocator), freqMapTable(allocator), outputMap(allocator), channelPredictions(allocator),
+                      risenEnergy(allocator), transientMask(allocator), observedSpectra(allocator), randomEngine(seed) {}
 
             int blockSamples() const {
                 return stft.windowSize();
@@ -34,8 +58,11 @@ namespace signalsmith { namespace stretch {
             void reset() {
                 stft.reset();
                 inputBuffer.reset();
+                compactInputBuffer.reset();
                 prevInputOffset = -1;
                 channelBands.assign(channelBands.size(), Band());
+                clearPrevious();
+                clearTransients();
                 silenceCounter = 2*stft.windowSize();
                 didSeek = false;
                 flushed = true;
@@ -54,10 +81,20 @@ namespace signalsmith { namespace stretch {
                 channels = nChannels;
                 stft.resize(channels, blockSamples, intervalSamples);
                 bands = stft.bands();
-                inputBuffer.resize(channels, blockSamples + intervalSamples + 1);
                 timeBuffer.assign(stft.fftSize(), 0);
                 channelBands.assign(bands*channels, Band());
 
+                // Only the storage for the current precision is kept
+                int historyLength = blockSamples + intervalSamples + 1;
+                inputBuffer.resize(compact ? 0 : channels, compact ? 0 : historyLength);
+                compactInputBuffer.resize(compact ? channels : 0, compact ? historyLength : 0);
+                prevInputs.assign(compact ? 0 : bands*channels, 0);
+                prevOutputs.assign(compact ? 0 : bands*channels, 0);
+                compactPrevInputs.assign(compact ? 2*bands*channels : 0, 0);
+                compactPrevOutputs.assign(compact ? 2*bands*channels : 0, 0);
+                for (auto *unused : {&prevInputs, &prevOutputs}) unused->shrink_to_fit();
+                for (auto *unused : {&compactPrevInputs, &compactPrevOutputs}) unused->shrink_to_fit();
+
                 // Various phase rotations
                 rotCentreSpectrum.resize(bands);
                 rotPrevInterval.assign(bands, 0);
@@ -66,8 +103,75 @@ namespace signalsmith { namespace stretch {
                 peaks.reserve(bands);
                 energy.resize(bands);
                 smoothedEnergy.resize(bands);
+                peakMask.assign((bands + 63)/64, 0);
+                freqMapTable.resize(bands); // always held, so setting a tabulated map doesn't allocate
+                buildFreqMapTable();
                 outputMap.resize(bands);
                 channelPredictions.resize(channels*bands);
+                risenEnergy.resize(bands);
+                transientMask.resize((bands + 63)/64);
+                clearTransients();
+                observedSpectra.resize(channels);
+                if (spectrumObserver) spectrumObserver->configureSpectrum(channels, bands, stft.fftSize(), stft.interval());
+            }
+
+            /** Stores the state carried between blocks (input history, previous band values) as bfloat16, roughly halving it.
+                Blocks are still processed at full precision; this re-configures if already configured. */
+            void setCompactState(bool compactState) {
+                compact = compactState;
+                if (channels > 0) configure(channels, stft.windowSize(), stft.interval());
+            }
+            bool compactState() const {
+                return compact;
+            }
+
+            /** Re-anchors the output phase to the input phase in the bands where a block's energy jumps (an onset), instead
+                of continuing it from the previous block, so consonants and drum hits aren't smeared over the block length.
+                The input phases are time-shifted so the onset lands where the stretched timeline puts it. */
+            void setTransientReset(bool enabled) {
+                transientReset = enabled;
+                clearTransients();
+            }
+            bool transientResetEnabled() const {
+                return transientReset;
+            }
+            /// Blocks whose phases were re-anchored since the last reset
+            uint64_t transientResets() const {
+                return transientCount;
+            }
+
+            /// Bytes of heap storage held by each part of the stretcher (vector capacities, excluding allocator overhead)
+            struct MemoryUsage {
+                size_t object = 0; // the stretcher itself
+                size_t stft = 0; // output sum, spectrum, FFT and window
+                size_t inputHistory = 0;
+                size_t bands = 0; // band values for the current block
+                size_t previousBands = 0; // band values carried from the previous block
+                size_t predictions = 0;
+                size_t rotations = 0;
+                size_t frequencyMap = 0; // peaks, energies and output map for pitch-shifting
+                size_t transients = 0; // previous energies and reset bands for the transient reset
+                size_t scratch = 0;
+
+                size_t total() const {
+                    return object + stft + inputHistory + bands + previousBands + predictions + rotations + frequencyMap + transients + scratch;
+                }
+            };
+            MemoryUsage memoryUsage() const {
+                MemoryUsage usage;
+                usage.object = sizeof(*this);
+                usage.stft = stft.memoryBytes();
+                usage.inputHistory = inputBuffer.memoryBytes() + compactInputBuffer.memoryBytes();
+                usage.bands = channelBands.capacity()*sizeof(Band);
+                usage.previousBands = (prevInputs.capacity() + prevOutputs.capacity())*sizeof(Complex)
+                        + (compactPrevInputs.capacity() + compactPrevOutputs.capacity())*sizeof(uint16_t);
+                usage.predictions = channelPredictions.capacity()*sizeof(Prediction);
+                usage.rotations = (rotCentreSpectrum.capacity() + rotPrevInterval.capacity())*sizeof(Complex);
+                usage.frequencyMap = peaks.capacity()*sizeof(Peak) + (energy.capacity() + smoothedEnergy.capacity())*sizeof(Sample)
+                        + peakMask.capacity()*sizeof(uint64_t) + freqMapTable.capacity()*sizeof(Sample) + outputMap.capacity()*sizeof(PitchMapPoint);
+                usage.transients = risenEnergy.capacity()*sizeof(Sample) + transientMask.capacity()*sizeof(uint64_t);
+                usage.scratch = timeBuffer.capacity()*sizeof(Sample) + observedSpectra.capacity()*sizeof(const Complex *);
+                return usage;
             }
 
             /// Frequency multiplier, and optional tonality limit (as multiple of sample-rate)
@@ -78,30 +182,45 @@ namespace signalsmith { namespace stretch {
                 } else {
                     freqTonalityLimit = 1;
                 }
-                customFreqMap = nullptr;
+                clearFreqMap();
             }
             void setTransposeSemitones(Sample semitones, Sample tonalityLimit=0) {
                 setTransposeFactor(std::pow(2, semitones/12), tonalityLimit);
-                customFreqMap = nullptr;
             }
-            // Sets a custom frequency map - should be monotonically increasing
-            void setFreqMap(std::function<Sample(Sample)> inputToOutput) {
+            /** Sets a custom frequency map - should be monotonically increasing.  With `tabulate`, it's sampled once per band
+                (now, and again on re-configuration) and peaks are mapped by linear interpolation in that table, instead of
+                calling it for every peak of every block. */
+            void setFreqMap(std::function<Sample(Sample)> inputToOutput, bool tabulate=false) {
+                clearFreqMap();
                 customFreqMap = inputToOutput;
+                tabulatedFreqMap = tabulate && inputToOutput;
+                buildFreqMapTable();
+            }
+            /// Sets the map as an instance of the `FreqMap` type, called inline for every peak
+            template<class Map> requires std::same_as<std::remove_cvref_t<Map>, FreqMap>
+            void setFreqMap(Map &&inputToOutput) {
+                clearFreqMap();
+                functorFreqMap = std::forward<Map>(inputToOutput);
+                hasFunctorFreqMap = true;
+            }
+
+            /// Shows `observer` (nullptr to detach) the spectrum of each new block of input; it's not owned, and must not block
+            void setSpectrumObserver(SpectrumObserver<Sample> *observer) {
+                spectrumObserver = observer;
+                if (spectrumObserver && channels > 0) spectrumObserver->configureSpectrum(channels, bands, stft.fftSize(), stft.interval());
+            }
+
+            /// Repeats the spectral processing of the latest block on its input, without analysis or synthesis, to time that step on its own
+            void reprocessSpectrum(Sample timeFactor) {
+                processSpectrum(true, timeFactor);
             }
 
             // Provide previous input ("pre-roll"), without affecting the speed calculation.  You should ideally feed it one block-length + one interval
             template<class Inputs>
             void seek(Inputs &&inputs, int inputSamples, double playbackRate) {
                 inputBuffer.reset();
-                for (int c = 0; c < channels; ++c) {
-                    auto &&inputChannel = inputs[c];
-                    auto &&bufferChannel = inputBuffer[c];
-                    int startIndex = std::max<int>(0, inputSamples - stft.windowSize() - stft.interval());
-                    for (int i = startIndex; i < inputSamples; ++i) {
-                        bufferChannel[i] = inputChannel[i];
-                    }
-                }
-                inputBuffer += inputSamples;
+                compactInputBuffer.reset();
+                writeHistory(inputs, std::max<int>(0, inputSamples - stft.windowSize() - stft.interval()), inputSamples);
                 didSeek = true;
                 seekTimeFactor = (playbackRate*stft.interval() > 1) ? 1/playbackRate : stft.interval();
             }
@@ -121,9 +240,11 @@ namespace signalsmith { namespace stretch {
                         if (silenceFirst) {
                             silenceFirst = false;
                             for (auto &b : channelBands) {
-                                b.input = b.prevInput = b.output = b.prevOutput = 0;
+                                b.input = b.output = 0;
                                 b.inputEnergy = 0;
                             }
+                            clearPrevious();
+                            clearTransients(); // so the first block after the silence counts as an onset
                         }
 
                         if (inputSamples > 0) {
@@ -144,15 +265,7 @@ namespace signalsmith { namespace stretch {
                         }
 
                         // Store input in history buffer
-                        for (int c = 0; c < channels; ++c) {
-                            auto &&inputChannel = inputs[c];
-                            auto &&bufferChannel = inputBuffer[c];
-                            int startIndex = std::max<int>(0, inputSamples - stft.windowSize() - stft.interval());
-                            for (int i = startIndex; i < inputSamples; ++i) {
-                                bufferChannel[i] = inputChannel[i];
-                            }
-                        }
-                        inputBuffer += inputSamples;
+                        writeHistory(inputs, std::max<int>(0, inputSamples - stft.windowSize() - stft.interval()), inputSamples);
                         return;
                     } else {
                         silenceCounter += inputSamples;
@@ -171,12 +284,10 @@ namespace signalsmith { namespace stretch {
 
                         bool newSpectrum = didSeek || (inputInterval > 0);
                         if (newSpectrum) {
+                            SIGNALSMITH_PERF_SCOPE(analysis);
                             for (int c = 0; c < channels; ++c) {
                                 // Copy from the history buffer, if needed
-                                auto &&bufferChannel = inputBuffer[c];
-                                for (int i = 0; i < -inputOffset; ++i) {
-                                    timeBuffer[i] = bufferChannel[i + inputOffset];
-                                }
+                                readHistory(c, inputOffset, -inputOffset);
                                 // Copy the rest from the input
                                 auto &&inputChannel = inputs[c];
                                 for (int i = std::max<int>(0, -inputOffset); i < stft.windowSize(); ++i) {
@@ -185,6 +296,11 @@ namespace signalsmith { namespace stretch {
                                 stft.analyse(c, timeBuffer);
                             }
                             flushed = false; // TODO: first block after a flush should be gain-compensated
+                            if (spectrumObserver) {
+                                SIGNALSMITH_PERF_SCOPE(observeSpectrum);
+                                for (int c = 0; c < channels; ++c) observedSpectra[c] = stft.spectrum[c];
+                                spectrumObserver->observeSpectrum(observedSpectra.data(), didSeek ? 0 : inputInterval);
+                            }
 
                             for (int c = 0; c < channels; ++c) {
                                 auto channelBands = bandsForChannel(c);
@@ -198,10 +314,7 @@ namespace signalsmith { namespace stretch {
                                 int prevIntervalOffset = inputOffset - stft.interval();
                                 for (int c = 0; c < channels; ++c) {
                                     // Copy from the history buffer, if needed
-                                    auto &&bufferChannel = inputBuffer[c];
-                                    for (int i = 0; i < std::min(-prevIntervalOffset, stft.windowSize()); ++i) {
-                                        timeBuffer[i] = bufferChannel[i + prevIntervalOffset];
-                                    }
+                                    readHistory(c, prevIntervalOffset, std::min(-prevIntervalOffset, stft.windowSize()));
                                     // Copy the rest from the input
                                     auto &&inputChannel = inputs[c];
                                     for (int i = std::max<int>(0, -prevIntervalOffset); i < stft.windowSize(); ++i) {
@@ -210,10 +323,17 @@ namespace signalsmith { namespace stretch {
                                     stft.analyse(c, timeBuffer);
                                 }
                                 for (int c = 0; c < channels; ++c) {
-                                    auto channelBands = bandsForChannel(c);
                                     auto &&spectrumBands = stft.spectrum[c];
-                                    for (int b = 0; b < bands; ++b) {
-                                        channelBands[b].prevInput = signalsmith::perf::mul(spectrumBands[b], rotCentreSpectrum[b]);
+                                    if (compact) {
+                                        uint16_t *prevInput = compactPrevInputs.data() + 2*c*bands;
+                                        for (int b = 0; b < bands; ++b) {
+                                            encodeBf16(signalsmith::perf::mul(spectrumBands[b], rotCentreSpectrum[b]), prevInput + 2*b);
+                                        }
+                                    } else {
+                                        Complex *prevInput = prevInputs.data() + c*bands;
+                                        for (int b = 0; b < bands; ++b) {
+                                            prevInput[b] = signalsmith::perf::mul(spectrumBands[b], rotCentreSpectrum[b]);
+                                        }
                                     }
                                 }
                             }
@@ -240,15 +360,7 @@ namespace signalsmith { namespace stretch {
                 }
 
                 // Store input in history buffer
-                for (int c = 0; c < channels; ++c) {
-                    auto &&inputChannel = inputs[c];
-                    auto &&bufferChannel = inputBuffer[c];
-                    int startIndex = std::max<int>(0, inputSamples - stft.windowSize());
-                    for (int i = startIndex; i < inputSamples; ++i) {
-                        bufferChannel[i] = inputChannel[i];
-                    }
-                }
-                inputBuffer += inputSamples;
+                writeHistory(inputs, std::max<int>(0, inputSamples - stft.windowSize()), inputSamples);
                 stft += outputSamples;
                 prevInputOffset -= inputSamples;
             }
@@ -275,12 +387,7 @@ namespace signalsmith { namespace stretch {
                 // Skip the output we just used/cleared
                 stft += plainOutput + foldedBackOutput;
                 // Reset the phase-vocoder stuff, so the next block gets a fresh start
-                for (int c = 0; c < channels; ++c) {
-                    auto channelBands = bandsForChannel(c);
-                    for (int b = 0; b < bands; ++b) {
-                        channelBands[b].prevInput = channelBands[b].prevOutput = 0;
-                    }
-                }
+                clearPrevious();
                 flushed = true;
             }
         private:
@@ -292,38 +399,118 @@ namespace signalsmith { namespace stretch {
 
             Sample freqMultiplier = 1, freqTonalityLimit = 0.5;
             std::function<Sample(Sample)> customFreqMap = nullptr;
+            bool tabulatedFreqMap = false;
+            struct NoFreqMap {};
+            [[no_unique_address]] std::conditional_t<std::is_void_v<FreqMap>, NoFreqMap, FreqMap> functorFreqMap{};
+            bool hasFunctorFreqMap = false;
+            void clearFreqMap() {
+                customFreqMap = nullptr;
+                tabulatedFreqMap = hasFunctorFreqMap = false;
+            }
 
             signalsmith::spectral::STFT<Sample> stft{0, 1, 1};
+            bool compact = false;
             signalsmith::delay::MultiBuffer<Sample> inputBuffer;
+            signalsmith::delay::MultiBuffer<uint16_t> compactInputBuffer; // bfloat16 history in compact mode
             int channels = 0, bands = 0;
             int prevInputOffset = -1;
-            std::vector<Sample> timeBuffer;
+            std::pmr::vector<Sample> timeBuffer;
             bool didSeek = false, flushed = true;
             Sample seekTimeFactor = 1;
 
-            std::vector<Complex> rotCentreSpectrum, rotPrevInterval;
+            std::pmr::vector<Complex> rotCentreSpectrum, rotPrevInterval;
             Sample bandToFreq(Sample b) const {
                 return (b + Sample(0.5))/stft.fftSize();
             }
             Sample freqToBand(Sample f) const {
                 return f*stft.fftSize() - Sample(0.5);
             }
-            void timeShiftPhases(Sample shiftSamples, std::vector<Complex> &output) const {
+            void timeShiftPhases(Sample shiftSamples, std::pmr::vector<Complex> &output) const {
                 for (int b = 0; b < bands; ++b) {
                     Sample phase = bandToFreq(b)*shiftSamples*Sample(-2*M_PI);
                     output[b] = {std::cos(phase), std::sin(phase)};
                 }
             }
 
+            template<class Inputs>
+            void writeHistory(Inputs &&inputs, int startIndex, int inputSamples) {
+                for (int c = 0; c < channels; ++c) {
+                    auto &&inputChannel = inputs[c];
+                    if (compact) {
+                        auto &&bufferChannel = compactInputBuffer[c];
+                        for (int i = startIndex; i < inputSamples; ++i) {
+                            bufferChannel[i] = signalsmith::perf::toBf16(float(inputChannel[i]));
+                        }
+                    } else {
+                        auto &&bufferChannel = inputBuffer[c];
+                        for (int i = startIndex; i < inputSamples; ++i) {
+                            bufferChannel[i] = inputChannel[i];
+                        }
+                    }
+                }
+                inputBuffer += inputSamples;
+                compactInputBuffer += inputSamples;
+            }
+            // Fills the start of `timeBuffer` from the history, starting `offset` samples from the current position
+            void readHistory(int channel, int offset, int length) {
+                if (compact) {
+                    auto &&bufferChannel = compactInputBuffer[channel];
+                    for (int i = 0; i < length; ++i) {
+                        timeBuffer[i] = signalsmith::perf::fromBf16(bufferChannel[i + offset]);
+                    }
+                } else {
+                    auto &&bufferChannel = inputBuffer[channel];
+                    for (int i = 0; i < length; ++i) {
+                        timeBuffer[i] = bufferChannel[i + offset];
+                    }
+                }
+            }
+
             struct Band {
-                Complex input, prevInput{0};
-                Complex output, prevOutput{0};
+                Complex input, output;
                 Sample inputEnergy;
             };
-            std::vector<Band> channelBands;
+            std::pmr::vector<Band> channelBands;
             Band * bandsForChannel(int channel) {
                 return channelBands.data() + channel*bands;
             }
+            // Band values from the previous block, kept apart from `Band` so they can be stored as bfloat16 (real, imag) pairs
+            std::pmr::vector<Complex> prevInputs, prevOutputs;
+            std::pmr::vector<uint16_t> compactPrevInputs, compactPrevOutputs;
+            static void encodeBf16(Complex value, uint16_t *output) {
+                output[0] = signalsmith::perf::toBf16(float(value.real()));
+                output[1] = signalsmith::perf::toBf16(float(value.imag()));
+            }
+            static Complex decodeBf16(const uint16_t *input) {
+                return {signalsmith::perf::fromBf16(input[0]), signalsmith::perf::fromBf16(input[1])};
+            }
+            void clearPrevious() {
+                prevInputs.assign(prevInputs.size(), 0);
+                prevOutputs.assign(prevOutputs.size(), 0);
+                compactPrevInputs.assign(compactPrevInputs.size(), 0);
+                compactPrevOutputs.assign(compactPrevOutputs.size(), 0);
+            }
+            /* Previous input bands for one channel. In compact mode they're decoded into the channel's STFT spectrum, which
+               has already been copied into `channelBands` and is only rewritten after `processSpectrum()`. */
+            Complex * loadPrevInput(int channel) {
+                if (!compact) return prevInputs.data() + channel*bands;
+
+                Complex *prevInput = stft.spectrum[channel];
+                const uint16_t *compactInput = compactPrevInputs.data() + 2*channel*bands;
+                if constexpr (std::is_same<Sample, float>::value) {
+                    if (auto *table = signalsmith::kernels::active()) {
+                        table->fromBf16(reinterpret_cast<float *>(prevInput), compactInput, 2*bands);
+                        return prevInput;
+                    }
+                }
+                for (int b = 0; b < bands; ++b) prevInput[b] = decodeBf16(compactInput + 2*b);
+                return prevInput;
+            }
+            Complex getFractional(const Complex *values, int lowIndex, Sample fractional) const {
+                Complex low = (lowIndex >= 0 && lowIndex < bands) ? values[lowIndex] : Complex(0);
+                Complex high = (lowIndex + 1 >= 0 && lowIndex + 1 < bands) ? values[lowIndex + 1] : Complex(0);
+                return low + (high - low)*fractional;
+            }
             template<Complex Band::*member>
             Complex getBand(int channel, int index) {
                 if (index < 0 || index >= bands) return 0;
@@ -362,12 +549,14 @@ namespace signalsmith { namespace stretch {
             struct Peak {
                 Sample input, output;
             };
-            std::vector<Peak> peaks;
-            std::vector<Sample> energy, smoothedEnergy;
+            std::pmr::vector<Peak> peaks;
+            std::pmr::vector<Sample> energy, smoothedEnergy;
+            std::pmr::vector<uint64_t> peakMask; // one bit per band, set where the energy is above the smoothed energy
+            std::pmr::vector<Sample> freqMapTable;
             struct PitchMapPoint {
                 Sample inputBin, freqGrad;
             };
-            std::vector<PitchMapPoint> outputMap;
+            std::pmr::vector<PitchMapPoint> outputMap;
 
             struct Prediction {
                 Sample energy = 0;
@@ -383,32 +572,105 @@ namespace signalsmith { namespace stretch {
                     return phase*std::sqrt(energy/phaseNorm);
                 }
             };
-            std::vector<Prediction> channelPredictions;
+            std::pmr::vector<Prediction> channelPredictions;
             Prediction * predictionsForChannel(int c) {
                 return channelPredictions.data() + c*bands;
             }
 
+            bool transientReset = false;
+            // Previous block's energy per band, times the rise that counts as an onset
+            std::pmr::vector<Sample> risenEnergy;
+            std::pmr::vector<uint64_t> transientMask; // one bit per band, set where this block's phases are re-anchored
+            bool onsetTracked = false, transientBlock = false;
+            Sample onsetOffset = 0; // input samples from the block's centre to the onset being reset
+            Sample transientDelay = 0; // samples by which this block's onset is moved
+            uint64_t transientCount = 0;
+            static constexpr Sample transientRise{4}; // 6dB
+            static constexpr Sample transientShare{Sample(0.3)}; // of the block's energy, in the bands that rose
+            static constexpr Sample transientTotalRise{2}; // 3dB, for the block as a whole
+            Sample previousTotal = 0; // previous block's energy
+            void clearTransients() {
+                risenEnergy.assign(risenEnergy.size(), 0);
+                transientMask.assign(transientMask.size(), 0);
+                onsetTracked = transientBlock = false;
+                previousTotal = 0;
+            }
+            bool isTransientBand(int band) const {
+                return band >= 0 && band < bands && ((transientMask[band >> 6] >> (band & 63)) & 1);
+            }
+            /* Marks the bands whose energy rose by `transientRise` since the previous block, if together they hold
+               `transientShare` of the block's energy. The onset's position comes from the phase step between
+               neighbouring marked bands. Those bands are reset from this block on, until the onset is a quarter of the
+               window behind the centre, each time moved to where the stretched timeline puts it, so the blocks agree. */
+            void detectTransients(bool newSpectrum, Sample timeFactor) {
+                transientBlock = false;
+                if (!newSpectrum) return;
+                Sample total = 0;
+                for (int b = 0; b < bands; ++b) total += energy[b];
+                if (onsetTracked) {
+                    onsetOffset -= stft.interval()/timeFactor;
+                    onsetTracked = onsetOffset > Sample(stft.windowSize())*Sample(-0.25);
+                }
+                if (!onsetTracked) {
+                    markRisenBands();
+                    Sample risen = 0;
+                    for (size_t word = 0; word < transientMask.size(); ++word) {
+                        for (uint64_t bits = transientMask[word]; bits; bits &= bits - 1) {
+                            risen += energy[word*64 + std::countr_zero(bits)];
+                        }
+                    }
+                    onsetTracked = total > noiseFloor && total > previousTotal*transientTotalRise && risen > total*transientShare;
+                    if (onsetTracked) {
+                        ++transientCount;
+                        Complex step = 0;
+                        for (int c = 0; c < channels; ++c) {
+                            const Band *bins = bandsForChannel(c);
+                            for (int b = 0; b + 1 < bands; ++b) {
+                                if (isTransientBand(b) && isTransientBand(b + 1)) step += signalsmith::perf::mul<true>(bins[b + 1].input, bins[b].input);
+                            }
+                        }
+                        onsetOffset = -std::arg(step)*stft.fftSize()/(2*Sample(M_PI));
+                    } else {
+                        transientMask.assign(transientMask.size(), 0);
+                    }
+                }
+                previousTotal = total;
+                for (int b = 0; b < bands; ++b) risenEnergy[b] = energy[b]*transientRise;
+                transientBlock = onsetTracked;
+                transientDelay = onsetOffset*(timeFactor - 1);
+            }
+            // The input phase, delayed by `transientDelay` so the onset lands where the stretched timeline puts it
+            Complex transientPhase(int band, Complex input) const {
+                return signalsmith::perf::mul(input, std::polar(Sample(1), -2*Sample(M_PI)*bandToFreq(Sample(band))*transientDelay));
+            }
+            void markRisenBands() {
+                if constexpr (std::is_same<Sample, float>::value) {
+                    if (auto *table = signalsmith::kernels::active()) {
+                        table->greaterMask(transientMask.data(), energy.data(), risenEnergy.data(), bands);
+                        return;
+                    }
+                }
+                for (int base = 0; base < bands; base += 64) {
+                    uint64_t bits = 0;
+                    for (int j = 0; j < std::min(64, bands - base); ++j) bits |= uint64_t(energy[base + j] > risenEnergy[base + j]) << j;
+                    transientMask[base/64] = bits;
+                }
+            }
+
+            SpectrumObserver<Sample> *spectrumObserver = nullptr;
+            std::pmr::vector<const Complex *> observedSpectra;
+
             std::default_random_engine randomEngine;
 
             void processSpectrum(bool newSpectrum, Sample timeFactor) {
+                SIGNALSMITH_PERF_SCOPE(processSpectrum);
                 timeFactor = std::max<Sample>(timeFactor, 1/maxCleanStretch);
                 bool randomTimeFactor = (timeFactor > maxCleanStretch);
                 std::uniform_real_distribution<Sample> timeFactorDist(maxCleanStretch*2*randomTimeFactor - timeFactor, timeFactor);
 
-                if (newSpectrum) {
-                    for (int c = 0; c < channels; ++c) {
-                        auto bins = bandsForChannel(c);
-                        for (int b = 0; b < bands; ++b) {
-                            auto &bin = bins[b];
-                            bin.prevOutput = signalsmith::perf::mul(bin.prevOutput, rotPrevInterval[b]);
-                            bin.prevInput = signalsmith::perf::mul(bin.prevInput, rotPrevInterval[b]);
-                        }
-                    }
-                }
-
                 Sample smoothingBins = Sample(stft.fftSize())/stft.interval();
                 int longVerticalStep = std::round(smoothingBins);
-                if (customFreqMap || freqMultiplier != 1) {
+                if (customFreqMap || hasFunctorFreqMap || freqMultiplier != 1) {
                     findPeaks(smoothingBins);
                     updateOutputMap();
                 } else { // we're not pitch-shifting, so no need to find peaks etc.
@@ -418,15 +680,33 @@ namespace signalsmith { namespace stretch {
                             bins[b].inputEnergy = std::norm(bins[b].input);
                         }
                     }
+                    if (transientReset) {
+                        for (int b = 0; b < bands; ++b) {
+                            Sample sum = 0;
+                            for (int c = 0; c < channels; ++c) sum += bandsForChannel(c)[b].inputEnergy;
+                            energy[b] = sum;
+                        }
+                    }
                     for (int b = 0; b < bands; ++b) {
                         outputMap[b] = {Sample(b), 1};
                     }
                 }
+                if (transientReset) detectTransients(newSpectrum, timeFactor);
 
                 // Preliminary output prediction from phase-vocoder
                 for (int c = 0; c < channels; ++c) {
                     Band *bins = bandsForChannel(c);
                     auto *predictions = predictionsForChannel(c);
+
+                    Complex *prevInputBands = loadPrevInput(c);
+                    if (newSpectrum) {
+                        for (int b = 0; b < bands; ++b) {
+                            prevInputBands[b] = signalsmith::perf::mul(prevInputBands[b], rotPrevInterval[b]);
+                        }
+                    }
+                    const Complex *prevOutputBands = compact ? nullptr : prevOutputs.data() + c*bands;
+                    const uint16_t *compactPrevOutputBands = compact ? compactPrevOutputs.data() + 2*c*bands : nullptr;
+
                     for (int b = 0; b < bands; ++b) {
                         auto mapPoint = outputMap[b];
                         int lowIndex = std::floor(mapPoint.inputBin);
@@ -439,9 +719,12 @@ namespace signalsmith { namespace stretch {
                         prediction.input = getFractional<&Band::input>(c, lowIndex, fracIndex);
 
                         auto &outputBin = bins[b];
-                        Complex prevInput = getFractional<&Band::prevInput>(c, lowIndex, fracIndex);
+                        Complex prevInput = getFractional(prevInputBands, lowIndex, fracIndex);
                         Complex freqTwist = signalsmith::perf::mul<true>(prediction.input, prevInput);
-                        Complex phase = signalsmith::perf::mul(outputBin.prevOutput, freqTwist);
+                        Complex prevOutput = compact ? decodeBf16(compactPrevOutputBands + 2*b) : prevOutputBands[b];
+                        if (newSpectrum) prevOutput = signalsmith::perf::mul(prevOutput, rotPrevInterval[b]);
+                        Complex phase = signalsmith::perf::mul(prevOutput, freqTwist);
+                        if (transientBlock && isTransientBand(lowIndex)) phase = transientPhase(b, prediction.input);
                         outputBin.output = phase/(std::max(prevEnergy, prediction.energy) + noiseFloor);
 
                         if (b > 0) {
@@ -503,6 +786,8 @@ namespace signalsmith { namespace stretch {
                         }
                     }
 
+                    // Onsets take the input phase as it is, and the other channels follow it below
+                    if (transientBlock && isTransientBand(int(std::floor(outputMap[b].inputBin)))) phase = transientPhase(b, prediction.input);
                     outputBin.output = prediction.makeOutput(phase);
 
                     // All other bins are locked in phase
@@ -518,41 +803,75 @@ namespace signalsmith { namespace stretch {
                     }
                 }
 
-                if (newSpectrum) {
-                    for (auto &bin : channelBands) {
-                        bin.prevOutput = bin.output;
-                        bin.prevInput = bin.input;
+                for (int c = 0; c < channels; ++c) {
+                    const Band *bins = bandsForChannel(c);
+                    if (compact) {
+                        uint16_t *prevOutput = compactPrevOutputs.data() + 2*c*bands;
+                        uint16_t *prevInput = compactPrevInputs.data() + 2*c*bands;
+                        for (int b = 0; b < bands; ++b) encodeBf16(bins[b].output, prevOutput + 2*b);
+                        if (newSpectrum) {
+                            for (int b = 0; b < bands; ++b) encodeBf16(bins[b].input, prevInput + 2*b);
+                        }
+                    } else {
+                        Complex *prevOutput = prevOutputs.data() + c*bands;
+                        Complex *prevInput = prevInputs.data() + c*bands;
+                        for (int b = 0; b < bands; ++b) prevOutput[b] = bins[b].output;
+                        if (newSpectrum) {
+                            for (int b = 0; b < bands; ++b) prevInput[b] = bins[b].input;
+                        }
                     }
-                } else {
-                    for (auto &bin : channelBands) bin.prevOutput = bin.output;
                 }
             }
 
             // Produces smoothed energy across all channels
             void smoothEnergy(Sample smoothingBins) {
                 Sample smoothingSlew = 1/(1 + smoothingBins*Sample(0.5));
-                for (auto &e : energy) e = 0;
-                for (int c = 0; c < channels; ++c) {
-                    Band *bins = bandsForChannel(c);
-                    for (int b = 0; b < bands; ++b) {
-                        Sample e = std::norm(bins[b].input);
-                        bins[b].inputEnergy = e; // Used for interpolating prediction energy
-                        energy[b] += e;
-                    }
-                }
                 for (int b = 0; b < bands; ++b) {
-                    smoothedEnergy[b] = energy[b];
+                    Sample sum = 0;
+                    for (int c = 0; c < channels; ++c) {
+                        Band &bin = bandsForChannel(c)[b];
+                        Sample e = std::norm(bin.input);
+                        bin.inputEnergy = e; // Used for interpolating prediction energy
+                        sum += e;
+                    }
+                    energy[b] = smoothedEnergy[b] = sum;
                 }
                 Sample e = 0;
                 for (int repeat = 0; repeat < 2; ++repeat) {
-                    for (int b = bands - 1; b >= 0; --b) {
-                        e += (smoothedEnergy[b] - e)*smoothingSlew;
-                        smoothedEnergy[b] = e;
-                    }
-                    for (int b = 0; b < bands; ++b) {
-                        e += (smoothedEnergy[b] - e)*smoothingSlew;
-                        smoothedEnergy[b] = e;
-                    }
+                    e = onePole(smoothedEnergy.data(), smoothingSlew, e, true);
+                    e = onePole(smoothedEnergy.data(), smoothingSlew, e, false);
+                }
+            }
+            // Smooths `bands` values in place (backwards if `reverse`), returning the final state
+            Sample onePole(Sample *values, Sample slew, Sample state, bool reverse) {
+                if constexpr (std::is_same<Sample, float>::value) {
+                    if (auto *table = signalsmith::kernels::active()) return table->onePole(values, bands, slew, state, reverse);
+                }
+                for (int i = 0; i < bands; ++i) {
+                    Sample &value = values[reverse ? bands - 1 - i : i];
+                    state += (value - state)*slew;
+                    value = state;
+                }
+                return state;
+            }
+
+            // Output band of a peak at (fractional) input band `band`, which is never outside the band range
+            Sample mapBand(Sample band) const {
+                if constexpr (!std::is_void_v<FreqMap>) {
+                    if (hasFunctorFreqMap) return freqToBand(functorFreqMap(bandToFreq(band)));
+                }
+                if (tabulatedFreqMap) {
+                    int low = std::clamp<int>(band, 0, bands - 2);
+                    Sample fractional = band - low;
+                    return freqMapTable[low] + (freqMapTable[low + 1] - freqMapTable[low])*fractional;
+                }
+                return freqToBand(mapFreq(bandToFreq(band)));
+            }
+            // Output band for each input band, for the tabulated map
+            void buildFreqMapTable() {
+                if (!tabulatedFreqMap) return;
+                for (int b = 0; b < bands; ++b) {
+                    freqMapTable[b] = freqToBand(customFreqMap(bandToFreq(b)));
                 }
             }
 
@@ -567,31 +886,55 @@ namespace signalsmith { namespace stretch {
 
             // Identifies spectral peaks using energy across all channels
             void findPeaks(Sample smoothingBins) {
+                SIGNALSMITH_PERF_SCOPE(findPeaks);
                 smoothEnergy(smoothingBins);
 
                 peaks.resize(0);
 
-                int start = 0;
+                // Each run of bands above the smoothed energy is a peak, found from the mask a word at a time
+                markPeakBands();
+                int start = findPeakBand(0, true);
                 while (start < bands) {
-                    if (energy[start] > smoothedEnergy[start]) {
-                        int end = start;
-                        Sample bandSum = 0, energySum = 0;
-                        while (end < bands && energy[end] > smoothedEnergy[end]) {
-                            bandSum += end*energy[end];
-                            energySum += energy[end];
-                            ++end;
-                        }
-                        Sample avgBand = bandSum/energySum;
-                        Sample avgFreq = bandToFreq(avgBand);
-                        peaks.emplace_back(Peak{avgBand, freqToBand(mapFreq(avgFreq))});
+                    int end = findPeakBand(start, false);
+                    Sample bandSum = 0, energySum = 0;
+                    for (int b = start; b < end; ++b) {
+                        bandSum += b*energy[b];
+                        energySum += energy[b];
+                    }
+                    Sample avgBand = bandSum/energySum;
+                    peaks.emplace_back(Peak{avgBand, mapBand(avgBand)});
 
-                        start = end;
+                    start = findPeakBand(end, true);
+                }
+            }
+            void markPeakBands() {
+                if constexpr (std::is_same<Sample, float>::value) {
+                    if (auto *table = signalsmith::kernels::active()) {
+                        table->greaterMask(peakMask.data(), energy.data(), smoothedEnergy.data(), bands);
+                        return;
                     }
-                    ++start;
                 }
+                for (int base = 0; base < bands; base += 64) {
+                    uint64_t bits = 0;
+                    for (int j = 0; j < std::min(64, bands - base); ++j) bits |= uint64_t(energy[base + j] > smoothedEnergy[base + j]) << j;
+                    peakMask[base/64] = bits;
+                }
+            }
+            // First band from `from` whose bit in `peakMask` is `set`, or `bands` if there isn't one
+            int findPeakBand(int from, bool set) const {
+                if (from >= bands) return bands;
+                uint64_t flip = set ? 0 : ~uint64_t(0);
+                size_t word = from/64;
+                uint64_t bits = (peakMask[word] ^ flip) & (~uint64_t(0) << (from%64));
+                while (!bits) {
+                    if (++word == peakMask.size()) return bands;
+                    bits = peakMask[word] ^ flip;
+                }
+                return std::min<int>(bands, word*64 + std::countr_zero(bits));
             }
 
             void updateOutputMap() {
+                SIGNALSMITH_PERF_SCOPE(updateOutputMap);
                 if (peaks.empty()) {
                     for (int b = 0; b < bands; ++b) {
                         outputMap[b] = {Sample(b), 1};
@@ -611,6 +954,14 @@ namespace signalsmith { namespace stretch {
                     Sample gradScale = outScale*rangeScale;
                     int startBin = std::max<int>(0, std::ceil(prev.output));
                     int endBin = std::min<int>(bands, std::ceil(next.output));
+                    if constexpr (std::is_same<Sample, float>::value) {
+                        if (auto *table = signalsmith::kernels::active()) {
+                            if (startBin < endBin) {
+                                table->smoothstep(reinterpret_cast<float *>(outputMap.data()), startBin, endBin, prev.output, rangeScale, outOffset, outScale, gradScale);
+                            }
+                            continue;
+                        }
+                    }
                     for (int b = startBin; b < endBin; ++b) {
                         Sample r = (b - prev.output)*rangeScale;
                         Sample h = r*r*(3 - 2*r);
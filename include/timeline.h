@@ -0,0 +1,61 @@
+#ifndef KLARITY_SAMPLER_TIMELINE_H
+#define KLARITY_SAMPLER_TIMELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ring.h"
+
+// Interleaved frames placed on the stream timeline at a stream frame, or at a stream time if `timed`
+struct TimelineEvent {
+    std::vector<float> samples;
+    uint64_t frame = 0;
+    // `Pa_GetStreamTime` units, resolved to a frame by the device when the event reaches it
+    double time = 0;
+    bool timed = false;
+    // Device side: the event has been mixed into a period
+    bool started = false;
+};
+
+/*
+ * Events mixed into the device output at exact frames of the stream, any number of them overlapping. The producer hands
+ * events over through a lock-free queue and gets them back the same way once played, so the device side neither
+ * allocates nor frees; each period costs O(pending events). Events due before the period they arrive in are late:
+ * their elapsed part is skipped, which keeps the rest where it belongs on the timeline.
+ */
+struct Timeline {
+private:
+    uint32_t channels;
+    uint32_t sampleRate;
+    size_t capacity;
+    SpscQueue<TimelineEvent *> incoming;
+    SpscQueue<TimelineEvent *> finished;
+    // Producer side: every event handed over and not collected yet
+    std::vector<std::unique_ptr<TimelineEvent>> pending;
+    // Device side, unordered
+    std::vector<TimelineEvent *> active;
+    std::atomic<uint64_t> lateEvents{0};
+
+public:
+    Timeline(uint32_t channels, uint32_t sampleRate, size_t capacity);
+
+    // Producer: false if `capacity` events are pending
+    bool schedule(std::unique_ptr<TimelineEvent> event);
+
+    // Producer: frees the events the device has finished playing
+    void collect();
+
+    // Drops every event, only while the device side isn't running
+    void clear();
+
+    size_t pendingEvents() const;
+
+    uint64_t late() const;
+
+    // Device: mixes the events overlapping stream frames [position, position + frames) into `output`, whose first frame
+    // reaches the DAC at stream time `outputTime`
+    void mix(float *output, uint64_t frames, uint64_t position, double outputTime);
+};
+
+#endif //KLARITY_SAMPLER_TIMELINE_H
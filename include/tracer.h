@@ -0,0 +1,103 @@
+#ifndef KLARITY_SAMPLER_TRACER_H
+#define KLARITY_SAMPLER_TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef KLARITY_TRACE_RING_EVENTS
+#define KLARITY_TRACE_RING_EVENTS (1 << 16)
+#endif
+
+// A complete ("X") event: begin timestamp plus duration, so overwritten ring entries never leave unmatched pairs
+struct TraceEvent {
+    uint64_t startNanos;
+    uint32_t durationNanos;
+    uint32_t stage;
+};
+
+// Single-producer ring owned by one thread; the dumping thread only reads entries that have been published
+struct TraceRing {
+    static constexpr uint64_t capacity = KLARITY_TRACE_RING_EVENTS;
+    static_assert((capacity & (capacity - 1)) == 0, "trace ring capacity must be a power of two");
+
+    // Renumbered when the ring passes to a new thread, read by the dumping thread
+    std::atomic<uint32_t> threadId;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[capacity]};
+
+    explicit TraceRing(uint32_t threadId) : threadId(threadId) {}
+
+    void push(const TraceEvent &event) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        events[index & (capacity - 1)] = event;
+        head.store(index + 1, std::memory_order_release);
+    }
+};
+
+struct Tracer {
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    }
+
+    // The calling thread's ring, registered on first use and handed back for reuse when the thread exits
+    static TraceRing &ring() {
+        static thread_local ThreadRing owned;
+        return *owned.ring;
+    }
+
+    static void record(uint32_t stage, uint64_t startNanos, uint64_t endNanos) {
+        ring().push(TraceEvent{startNanos, static_cast<uint32_t>(endNanos - startNanos), stage});
+    }
+
+    // Writes every buffered event from all threads in Chrome trace JSON (loadable in chrome://tracing and Perfetto)
+    static void dumpChromeTrace(std::ostream &output);
+
+    static void dumpChromeTrace(const std::string &path);
+
+    static void clear();
+
+private:
+    struct ThreadRing {
+        std::shared_ptr<TraceRing> ring;
+
+        ThreadRing();
+
+        ~ThreadRing();
+    };
+
+    static std::shared_ptr<TraceRing> registerThread();
+
+    static void releaseThread(std::shared_ptr<TraceRing> ring);
+};
+
+struct TraceScope {
+    uint32_t stage;
+    uint64_t start;
+
+    explicit TraceScope(uint32_t stage) : stage(stage), start(Tracer::now()) {}
+
+    ~TraceScope() {
+        Tracer::record(stage, start, Tracer::now());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+// Timeline events are compiled in only with KLARITY_SAMPLER_TRACING, otherwise the hooks expand to nothing
+#ifdef KLARITY_SAMPLER_TRACING
+#define KLARITY_TRACE_SCOPE(stage) ::TraceScope traceScope_##stage(static_cast<uint32_t>(::ProfileStage::stage))
+#else
+#define KLARITY_TRACE_SCOPE(stage)
+#endif
+
+#endif //KLARITY_SAMPLER_TRACER_H
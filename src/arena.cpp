@@ -0,0 +1,92 @@
+#include "arena.h"
+#include <algorithm>
+#include <new>
+#include "exception.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+    size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+StretchArena::StretchArena(size_t capacity) {
+    if (capacity == 0) return;
+
+    capacityBytes = alignUp(capacity, cacheLine);
+
+    blockSize = capacityBytes;
+    if (capacityBytes >= hugePageSize) {
+        blockAlignment = hugePageSize;
+        blockSize = alignUp(capacityBytes, hugePageSize);
+    }
+
+    block = static_cast<std::byte *>(::operator new(blockSize, std::align_val_t(blockAlignment), std::nothrow));
+    if (!block) {
+        throw SamplerException("Unable to allocate stretch arena");
+    }
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (blockAlignment == hugePageSize) {
+        hugePageBacked = madvise(block, blockSize, MADV_HUGEPAGE) == 0;
+    }
+#endif
+}
+
+StretchArena::~StretchArena() {
+    if (block) {
+        ::operator delete(block, std::align_val_t(blockAlignment));
+    }
+}
+
+void *StretchArena::do_allocate(size_t bytes, size_t alignment) {
+    alignment = std::max(alignment, cacheLine);
+    size_t size = alignUp(std::max<size_t>(bytes, 1), cacheLine);
+
+    requiredBytes = alignUp(requiredBytes, alignment) + size;
+
+    if (block) {
+        size_t offset = alignUp(usedBytes, alignment);
+        if (offset + size <= capacityBytes) {
+            usedBytes = offset + size;
+            return block + offset;
+        }
+        ++overflows;
+    }
+
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void StretchArena::do_deallocate(void *pointer, size_t bytes, size_t alignment) {
+    auto *address = static_cast<std::byte *>(pointer);
+    if (block && address >= block && address < block + capacityBytes) return;
+
+    std::pmr::new_delete_resource()->deallocate(pointer, bytes, std::max(alignment, cacheLine));
+}
+
+bool StretchArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+size_t StretchArena::capacity() const {
+    return capacityBytes;
+}
+
+size_t StretchArena::used() const {
+    return usedBytes;
+}
+
+size_t StretchArena::required() const {
+    return requiredBytes;
+}
+
+uint64_t StretchArena::overflowAllocations() const {
+    return overflows;
+}
+
+bool StretchArena::hugePages() const {
+    return hugePageBacked;
+}
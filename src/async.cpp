@@ -0,0 +1,47 @@
+#include "async.h"
+
+void SamplerExecutor::post(AsyncWaiter &waiter) {
+    waiter.next = ready.load(std::memory_order_relaxed);
+    while (!ready.compare_exchange_weak(waiter.next, &waiter, std::memory_order_release, std::memory_order_relaxed)) {}
+
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+}
+
+size_t SamplerExecutor::poll() {
+    AsyncWaiter *list = ready.exchange(nullptr, std::memory_order_acquire);
+
+    // Pushed last-in first-out, woken in posting order
+    AsyncWaiter *ordered = nullptr;
+    while (list) {
+        AsyncWaiter *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    size_t woken = 0;
+    while (ordered) {
+        // A waiter may be posted again while it is woken, which reuses `next`
+        AsyncWaiter *next = ordered->next;
+        ordered->wake(ordered);
+        ordered = next;
+        ++woken;
+    }
+    return woken;
+}
+
+void SamplerExecutor::run() {
+    while (true) {
+        uint32_t seen = signal.load(std::memory_order_acquire);
+        if (poll() > 0) continue;
+        if (stopping.load(std::memory_order_acquire)) return;
+        signal.wait(seen, std::memory_order_acquire);
+    }
+}
+
+void SamplerExecutor::stop() {
+    stopping.store(true, std::memory_order_release);
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_all();
+}
@@ -0,0 +1,97 @@
+#include "cache.h"
+#include <cstring>
+
+size_t RenderCache::footprint(size_t samples) {
+    // List and index nodes are counted too, so many small chunks can't outgrow the limit
+    return samples * sizeof(float) + sizeof(Entry) + sizeof(decltype(index)::value_type) + 4 * sizeof(void *);
+}
+
+void RenderCache::evict(size_t targetBytes) {
+    while (usedBytes > targetBytes && !entries.empty()) {
+        auto &entry = entries.back();
+        usedBytes -= footprint(entry.samples.size());
+        index.erase(entry.key);
+        entries.pop_back();
+        ++counters.evictions;
+    }
+}
+
+uint64_t RenderCache::hash(uint64_t seed, const void *data, size_t bytes) {
+    // Word-wise multiply-xorshift, several times faster than a bytewise hash on whole chunks of audio
+    constexpr uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+    auto *source = static_cast<const uint8_t *>(data);
+    uint64_t h = seed ^ (bytes * multiplier);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, source + i, sizeof(word));
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    if (i < bytes) {
+        uint64_t word = 0;
+        std::memcpy(&word, source + i, bytes - i);
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    h ^= h >> 32;
+    return h;
+}
+
+void RenderCache::setLimit(size_t bytes) {
+    limitBytes = bytes;
+    evict(limitBytes);
+}
+
+const std::vector<float> *RenderCache::find(uint64_t key) {
+    auto found = index.find(key);
+    if (found == index.end()) {
+        ++counters.misses;
+        return nullptr;
+    }
+
+    ++counters.hits;
+    entries.splice(entries.begin(), entries, found->second);
+    return &found->second->samples;
+}
+
+float *RenderCache::insert(uint64_t key, size_t samples) {
+    size_t bytes = footprint(samples);
+    if (bytes > limitBytes) {
+        return nullptr;
+    }
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+        usedBytes -= footprint(found->second->samples.size());
+        entries.erase(found->second);
+        index.erase(found);
+    }
+
+    evict(limitBytes - bytes);
+
+    entries.push_front(Entry{key, std::vector<float>(samples)});
+    index.emplace(key, entries.begin());
+    usedBytes += bytes;
+    return entries.front().samples.data();
+}
+
+void RenderCache::clear() {
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+RenderCacheStats RenderCache::stats() const {
+    RenderCacheStats result = counters;
+    result.entries = entries.size();
+    result.bytes = usedBytes;
+    result.limitBytes = limitBytes;
+    return result;
+}
+
+void RenderCache::resetStats() {
+    counters = RenderCacheStats();
+}
@@ -0,0 +1,288 @@
+#include "clips.h"
+#include <chrono>
+#include <cmath>
+#include "kernels.h"
+
+namespace {
+    using Stretch = signalsmith::stretch::SignalsmithStretch<float>;
+
+    // Longest clip, before and after stretching, so frame counts fit the stretcher's `int`s
+    constexpr uint64_t maxClipFrames = uint64_t{1} << 30;
+
+    uint64_t steadyNanos() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    }
+
+    // A worker's clips still to render, [begin, end) of the batch, in one word so its owner and thieves agree on it
+    constexpr uint64_t packRange(uint64_t begin, uint64_t end) {
+        return begin << 32 | end;
+    }
+
+    constexpr uint64_t rangeBegin(uint64_t range) {
+        return range >> 32;
+    }
+
+    constexpr uint64_t rangeEnd(uint64_t range) {
+        return range & 0xffffffffu;
+    }
+
+    void configure(Stretch &stretch, const ClipRendererOptions &options) {
+        stretch.setCompactState(options.precision == SamplerPrecision::compact);
+        switch (options.preset) {
+            case SamplerPreset::standard:
+                stretch.presetDefault(static_cast<int>(options.channels), static_cast<float>(options.sampleRate));
+                break;
+            case SamplerPreset::cheaper:
+                stretch.presetCheaper(static_cast<int>(options.channels), static_cast<float>(options.sampleRate));
+                break;
+        }
+    }
+}
+
+// Cache-line aligned, so one worker taking a clip doesn't slow down the others
+struct alignas(64) ClipRenderer::Worker {
+    std::atomic<uint64_t> range{0};
+    Stretch stretch;
+    // Grown to the longest clip so far, then reused
+    std::vector<std::vector<float>> inputs;
+    std::vector<std::vector<float>> outputs;
+    std::vector<float *> inputPointers, outputPointers, flushPointers;
+    std::vector<const float *> keptPointers;
+    ClipRendererStats stats;
+    std::thread thread;
+};
+
+ClipRenderer::ClipRenderer(ClipRendererOptions options) : options(options) {
+    if (options.sampleRate == 0 || options.channels == 0) {
+        throw SamplerException("Unable to create clip renderer with sample rate " + std::to_string(options.sampleRate) +
+                               " and " + std::to_string(options.channels) + " channels");
+    }
+
+    size_t count = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < count; ++i) {
+        auto worker = std::make_unique<Worker>();
+        configure(worker->stretch, options);
+        worker->inputs.resize(options.channels);
+        worker->outputs.resize(options.channels);
+        worker->inputPointers.resize(options.channels);
+        worker->outputPointers.resize(options.channels);
+        worker->flushPointers.resize(options.channels);
+        worker->keptPointers.resize(options.channels);
+        workers.push_back(std::move(worker));
+    }
+
+    // Only once all workers exist, as each one may steal from any other
+    for (auto &worker: workers) {
+        worker->thread = std::thread([this, target = worker.get()] { run(*target); });
+    }
+}
+
+ClipRenderer::~ClipRenderer() {
+    stopping.store(true, std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    for (auto &worker: workers) worker->thread.join();
+}
+
+void ClipRenderer::run(Worker &worker) {
+    signalsmith::perf::StopDenormals stopDenormals;
+
+    uint32_t seen = 0;
+    while (true) {
+        generation.wait(seen, std::memory_order_acquire);
+        seen = generation.load(std::memory_order_acquire);
+        if (stopping.load(std::memory_order_acquire)) return;
+
+        try {
+            uint64_t index;
+            while (takeClip(worker, index)) {
+                renderClip(worker, batchRequests[index], batchResults[index]);
+            }
+        } catch (...) {
+            // What this worker had left is taken by the others
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure) failure = std::current_exception();
+        }
+
+        if (busy.fetch_sub(1, std::memory_order_acq_rel) == 1) busy.notify_all();
+    }
+}
+
+bool ClipRenderer::takeClip(Worker &worker, uint64_t &index) {
+    // The front of its own run first
+    uint64_t range = worker.range.load(std::memory_order_relaxed);
+    while (rangeBegin(range) < rangeEnd(range)) {
+        if (worker.range.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)),
+                                               std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            index = rangeBegin(range);
+            return true;
+        }
+    }
+
+    // Then the back half of the fullest run left. Indices only move on, so a run emptied and refilled never compares equal
+    while (true) {
+        Worker *victim = nullptr;
+        uint64_t victimRange = 0, most = 0;
+        for (auto &other: workers) {
+            uint64_t otherRange = other->range.load(std::memory_order_acquire);
+            if (rangeBegin(otherRange) < rangeEnd(otherRange) && rangeEnd(otherRange) - rangeBegin(otherRange) > most) {
+                victim = other.get();
+                victimRange = otherRange;
+                most = rangeEnd(otherRange) - rangeBegin(otherRange);
+            }
+        }
+        if (!victim) return false;
+
+        uint64_t middle = rangeBegin(victimRange) + most / 2;
+        if (victim->range.compare_exchange_strong(victimRange, packRange(rangeBegin(victimRange), middle),
+                                                  std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            ++worker.stats.steals;
+            worker.range.store(packRange(middle + 1, rangeEnd(victimRange)), std::memory_order_release);
+            index = middle;
+            return true;
+        }
+    }
+}
+
+void ClipRenderer::renderClip(Worker &worker, const ClipRequest &request, RenderedClip &result) {
+    uint64_t start = steadyNanos();
+    auto &stretch = worker.stretch;
+    auto channels = options.channels;
+
+    stretch.reset();
+    stretch.setTransposeFactor(request.pitchFactor, request.tonalityLimit / static_cast<float>(options.sampleRate));
+
+    // As `Sampler::renderEvent` does: silence pushes the last `inputLatency` frames through, `flush` the overlap
+    auto inputSamples = static_cast<int>(request.frames);
+    int tailInputSamples = stretch.inputLatency();
+    int bodyOutputSamples = static_cast<int>(std::lround((inputSamples + tailInputSamples) / request.speed));
+    int flushSamples = stretch.outputLatency();
+    int outputSamples = bodyOutputSamples + flushSamples;
+
+    auto &inputs = worker.inputPointers;
+    auto &outputs = worker.outputPointers;
+    for (uint32_t c = 0; c < channels; ++c) {
+        auto &input = worker.inputs[c];
+        auto &output = worker.outputs[c];
+        if (input.size() < static_cast<size_t>(inputSamples + tailInputSamples)) input.resize(inputSamples + tailInputSamples);
+        if (output.size() < static_cast<size_t>(outputSamples)) output.resize(outputSamples);
+        std::fill_n(input.data() + inputSamples, tailInputSamples, 0.0f);
+        inputs[c] = input.data();
+        outputs[c] = output.data();
+        worker.flushPointers[c] = output.data() + bodyOutputSamples;
+    }
+
+    const auto &kernels = KernelDispatch::table();
+    kernels.deinterleave(inputs.data(), request.samples, channels, inputSamples);
+    stretch.process(inputs, inputSamples + tailInputSamples, outputs, bodyOutputSamples);
+    stretch.flush(worker.flushPointers, flushSamples);
+
+    // The output lags the input by the pre-roll, what comes before the clip's first frame is the ramp-up
+    int preRollSamples = stretch.inputLatency() + static_cast<int>(std::lround(stretch.outputLatency() * request.speed));
+    int skippedSamples = std::min(outputSamples, static_cast<int>(std::lround(preRollSamples / request.speed)));
+    int keptSamples = outputSamples - skippedSamples;
+
+    result.samples.resize(static_cast<size_t>(keptSamples) * channels);
+    for (uint32_t c = 0; c < channels; ++c) worker.keptPointers[c] = outputs[c] + skippedSamples;
+    kernels.interleave(result.samples.data(), worker.keptPointers.data(), channels, keptSamples, request.volume);
+
+    auto &stats = worker.stats;
+    stats.nonFiniteSamples += kernels.sanitize(result.samples.data(), result.samples.size(), !signalsmith::perf::StopDenormals::flushes);
+    ++stats.clips;
+    stats.inputFrames += request.frames;
+    stats.outputFrames += static_cast<uint64_t>(keptSamples);
+    stats.clip.record(steadyNanos() - start);
+}
+
+void ClipRenderer::render(const ClipRequest *clips, size_t count, RenderedClip *results) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (count > 0xffffffffu) {
+        throw SamplerException("Unable to render " + std::to_string(count) + " clips in one batch");
+    }
+
+    // Checked up front, so the workers have nothing to reject. Every worker's stretcher has the same latencies
+    const auto &stretch = workers.front()->stretch;
+    auto tailInputFrames = static_cast<double>(stretch.inputLatency());
+    auto flushFrames = static_cast<double>(stretch.outputLatency());
+    for (size_t i = 0; i < count; ++i) {
+        const auto &clip = clips[i];
+        if (!(clip.speed > 0) || !std::isfinite(clip.speed) || !(clip.pitchFactor > 0) || !std::isfinite(clip.pitchFactor) ||
+            !(clip.tonalityLimit >= 0) || !std::isfinite(clip.tonalityLimit)) {
+            throw SamplerException("Unable to render clip " + std::to_string(i) + " at speed " + std::to_string(clip.speed) +
+                                   " and pitch factor " + std::to_string(clip.pitchFactor));
+        }
+        if (!std::isfinite(clip.volume)) {
+            throw SamplerException("Unable to render clip " + std::to_string(i) + " at volume " + std::to_string(clip.volume));
+        }
+        // The tail is stretched too, so even an empty clip is too long at a small enough speed
+        if ((clip.samples == nullptr && clip.frames > 0) || clip.frames > maxClipFrames ||
+            (static_cast<double>(clip.frames) + tailInputFrames) / clip.speed + flushFrames > static_cast<double>(maxClipFrames)) {
+            throw SamplerException("Unable to render clip " + std::to_string(i) + " of " + std::to_string(clip.frames) +
+                                   " frames at speed " + std::to_string(clip.speed));
+        }
+    }
+    if (count == 0) return;
+
+    batchRequests = clips;
+    batchResults = results;
+    failure = nullptr;
+
+    // Consecutive runs of equal size, evened out by stealing once the clip lengths tell
+    size_t share = count / workers.size(), remainder = count % workers.size(), begin = 0;
+    for (size_t w = 0; w < workers.size(); ++w) {
+        size_t end = begin + share + (w < remainder ? 1 : 0);
+        workers[w]->range.store(packRange(begin, end), std::memory_order_relaxed);
+        begin = end;
+    }
+
+    busy.store(static_cast<uint32_t>(workers.size()), std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    for (uint32_t left; (left = busy.load(std::memory_order_acquire)) != 0;) {
+        busy.wait(left, std::memory_order_acquire);
+    }
+
+    batchRequests = nullptr;
+    batchResults = nullptr;
+    if (failure) std::rethrow_exception(failure);
+}
+
+std::vector<RenderedClip> ClipRenderer::render(const std::vector<ClipRequest> &clips) {
+    std::vector<RenderedClip> rendered(clips.size());
+    render(clips.data(), clips.size(), rendered.data());
+    return rendered;
+}
+
+size_t ClipRenderer::threadCount() const {
+    return workers.size();
+}
+
+ClipRendererStats ClipRenderer::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    ClipRendererStats total;
+    for (auto &worker: workers) {
+        const auto &stats = worker->stats;
+        total.clips += stats.clips;
+        total.inputFrames += stats.inputFrames;
+        total.outputFrames += stats.outputFrames;
+        total.steals += stats.steals;
+        total.nonFiniteSamples += stats.nonFiniteSamples;
+        total.clip.count += stats.clip.count;
+        total.clip.totalNanos += stats.clip.totalNanos;
+        total.clip.maxNanos = std::max(total.clip.maxNanos, stats.clip.maxNanos);
+        for (size_t bucket = 0; bucket < ProfileHistogram::buckets; ++bucket) {
+            total.clip.histogram[bucket] += stats.clip.histogram[bucket];
+        }
+    }
+    return total;
+}
+
+void ClipRenderer::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto &worker: workers) worker->stats = ClipRendererStats();
+}
@@ -0,0 +1,92 @@
+#include "kernels.h"
+#include <atomic>
+#include <cstdlib>
+#ifdef KLARITY_SAMPLER_KERNELS_SVE
+#include <sys/auxv.h>
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#endif
+
+extern const signalsmith::kernels::Table genericKernels;
+#ifdef KLARITY_SAMPLER_KERNELS_AVX2
+extern const signalsmith::kernels::Table avx2Kernels;
+#endif
+#ifdef KLARITY_SAMPLER_KERNELS_AVX512
+extern const signalsmith::kernels::Table avx512Kernels;
+#endif
+#ifdef KLARITY_SAMPLER_KERNELS_SVE
+extern const signalsmith::kernels::Table sveKernels;
+#endif
+
+namespace {
+    std::vector<const signalsmith::kernels::Table *> supportedTables() {
+        std::vector<const signalsmith::kernels::Table *> tables{&genericKernels};
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+#ifdef KLARITY_SAMPLER_KERNELS_AVX2
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            tables.push_back(&avx2Kernels);
+        }
+#endif
+#ifdef KLARITY_SAMPLER_KERNELS_AVX512
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+            __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("fma")) {
+            tables.push_back(&avx512Kernels);
+        }
+#endif
+#endif
+        // Advanced SIMD is part of AArch64, so there the generic build is already NEON code
+#ifdef KLARITY_SAMPLER_KERNELS_SVE
+        if (getauxval(AT_HWCAP) & HWCAP_SVE) {
+            tables.push_back(&sveKernels);
+        }
+#endif
+        return tables;
+    }
+
+    std::atomic<const signalsmith::kernels::Table *> &selectedTable() {
+        static std::atomic<const signalsmith::kernels::Table *> selected = [] {
+            auto tables = supportedTables();
+            const signalsmith::kernels::Table *table = tables.back();
+            if (const char *name = std::getenv("KLARITY_SAMPLER_ISA")) {
+                for (auto *candidate: tables) {
+                    if (candidate->name == std::string(name)) table = candidate;
+                }
+            }
+            signalsmith::kernels::install(table);
+            return table;
+        }();
+        return selected;
+    }
+
+    // Selects and installs the variant as soon as the library is loaded
+    const bool kernelsInstalled = selectedTable().load() != nullptr;
+}
+
+std::string KernelDispatch::isa() {
+    return table().name;
+}
+
+std::vector<std::string> KernelDispatch::available() {
+    std::vector<std::string> names;
+    for (auto *table: supportedTables()) {
+        names.emplace_back(table->name);
+    }
+    return names;
+}
+
+bool KernelDispatch::select(const std::string &name) {
+    for (auto *table: supportedTables()) {
+        if (table->name == name) {
+            selectedTable().store(table);
+            signalsmith::kernels::install(table);
+            return true;
+        }
+    }
+    return false;
+}
+
+const signalsmith::kernels::Table &KernelDispatch::table() {
+    return *selectedTable().load();
+}
@@ -0,0 +1,4 @@
+#include "kernels_impl.h"
+
+// Built with -mavx2 -mfma, only selected when the CPU reports both
+extern const signalsmith::kernels::Table avx2Kernels = KLARITY_KERNEL_TABLE("avx2");
@@ -0,0 +1,4 @@
+#include "kernels_impl.h"
+
+// Built with -mavx512f -mavx512vl -mavx512dq -mfma, only selected when the CPU reports all of them
+extern const signalsmith::kernels::Table avx512Kernels = KLARITY_KERNEL_TABLE("avx512");
@@ -0,0 +1,3 @@
+#include "kernels_impl.h"
+
+extern const signalsmith::kernels::Table genericKernels = KLARITY_KERNEL_TABLE("generic");
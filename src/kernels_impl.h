@@ -0,0 +1,257 @@
+#ifndef KLARITY_SAMPLER_KERNELS_IMPL_H
+#define KLARITY_SAMPLER_KERNELS_IMPL_H
+
+/*
+ * Kernel bodies shared by every ISA variant. Each variant includes this file once from a translation unit compiled
+ * with its own target flags, so everything here must have internal linkage and must not call inline functions from
+ * other headers: the linker could otherwise keep a copy built for a wider ISA than the CPU supports.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include "dsp/kernels.h"
+
+namespace {
+    template<bool conjugateSecond>
+    inline void multiply(float &outReal, float &outImag, float aReal, float aImag, float bReal, float bImag) {
+        if (conjugateSecond) {
+            outReal = bReal * aReal + bImag * aImag;
+            outImag = bReal * aImag - bImag * aReal;
+        } else {
+            outReal = aReal * bReal - aImag * bImag;
+            outImag = aReal * bImag + aImag * bReal;
+        }
+    }
+
+    template<bool inverse>
+    void fftStep2(float *data, const float *__restrict twiddles, size_t stride, size_t outerRepeats) {
+        for (size_t outer = 0; outer < outerRepeats; ++outer) {
+            float *__restrict a = data;
+            float *__restrict b = data + 2 * stride;
+            for (size_t i = 0; i < stride; ++i) {
+                const float *twiddle = twiddles + 4 * i;
+                float bReal, bImag;
+                multiply<inverse>(bReal, bImag, b[2 * i], b[2 * i + 1], twiddle[2], twiddle[3]);
+                float aReal = a[2 * i], aImag = a[2 * i + 1];
+                a[2 * i] = aReal + bReal;
+                a[2 * i + 1] = aImag + bImag;
+                b[2 * i] = aReal - bReal;
+                b[2 * i + 1] = aImag - bImag;
+            }
+            data += 4 * stride;
+        }
+    }
+
+    template<bool inverse>
+    void fftStep4(float *data, const float *__restrict twiddles, size_t stride, size_t outerRepeats) {
+        for (size_t outer = 0; outer < outerRepeats; ++outer) {
+            float *__restrict d0 = data;
+            float *__restrict d1 = data + 2 * stride;
+            float *__restrict d2 = data + 4 * stride;
+            float *__restrict d3 = data + 6 * stride;
+            for (size_t i = 0; i < stride; ++i) {
+                const float *twiddle = twiddles + 8 * i;
+                float aReal = d0[2 * i], aImag = d0[2 * i + 1];
+                float bReal, bImag, cReal, cImag, dReal, dImag;
+                multiply<inverse>(cReal, cImag, d1[2 * i], d1[2 * i + 1], twiddle[4], twiddle[5]);
+                multiply<inverse>(bReal, bImag, d2[2 * i], d2[2 * i + 1], twiddle[2], twiddle[3]);
+                multiply<inverse>(dReal, dImag, d3[2 * i], d3[2 * i + 1], twiddle[6], twiddle[7]);
+
+                float sumACReal = aReal + cReal, sumACImag = aImag + cImag;
+                float sumBDReal = bReal + dReal, sumBDImag = bImag + dImag;
+                float diffACReal = aReal - cReal, diffACImag = aImag - cImag;
+                float diffBDReal = bReal - dReal, diffBDImag = bImag - dImag;
+
+                d0[2 * i] = sumACReal + sumBDReal;
+                d0[2 * i + 1] = sumACImag + sumBDImag;
+                d2[2 * i] = sumACReal - sumBDReal;
+                d2[2 * i + 1] = sumACImag - sumBDImag;
+                // Forward: d1 = diffAC - i*diffBD, d3 = diffAC + i*diffBD (swapped for the inverse)
+                if (inverse) {
+                    d1[2 * i] = diffACReal - diffBDImag;
+                    d1[2 * i + 1] = diffACImag + diffBDReal;
+                    d3[2 * i] = diffACReal + diffBDImag;
+                    d3[2 * i + 1] = diffACImag - diffBDReal;
+                } else {
+                    d1[2 * i] = diffACReal + diffBDImag;
+                    d1[2 * i + 1] = diffACImag - diffBDReal;
+                    d3[2 * i] = diffACReal - diffBDImag;
+                    d3[2 * i + 1] = diffACImag + diffBDReal;
+                }
+            }
+            data += 8 * stride;
+        }
+    }
+
+    template<bool conjugateSecond>
+    void complexMultiply(float *output, const float *a, const float *__restrict b, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            float real, imag;
+            multiply<conjugateSecond>(real, imag, a[2 * i], a[2 * i + 1], b[2 * i], b[2 * i + 1]);
+            output[2 * i] = real;
+            output[2 * i + 1] = imag;
+        }
+    }
+
+    void window(float *__restrict output, const float *__restrict input, const float *__restrict window, float gain, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            output[i] = input[i] * window[i] * gain;
+        }
+    }
+
+    void deinterleave(float *const *outputs, const float *__restrict input, size_t channels, size_t frames) {
+        if (channels == 1) {
+            float *__restrict output = outputs[0];
+            for (size_t i = 0; i < frames; ++i) output[i] = input[i];
+        } else if (channels == 2) {
+            float *__restrict left = outputs[0];
+            float *__restrict right = outputs[1];
+            for (size_t i = 0; i < frames; ++i) {
+                left[i] = input[2 * i];
+                right[i] = input[2 * i + 1];
+            }
+        } else {
+            for (size_t ch = 0; ch < channels; ++ch) {
+                float *__restrict output = outputs[ch];
+                for (size_t i = 0; i < frames; ++i) output[i] = input[i * channels + ch];
+            }
+        }
+    }
+
+    void interleave(float *__restrict output, const float *const *inputs, size_t channels, size_t frames, float gain) {
+        if (channels == 1) {
+            const float *__restrict input = inputs[0];
+            for (size_t i = 0; i < frames; ++i) output[i] = input[i] * gain;
+        } else if (channels == 2) {
+            const float *__restrict left = inputs[0];
+            const float *__restrict right = inputs[1];
+            for (size_t i = 0; i < frames; ++i) {
+                output[2 * i] = left[i] * gain;
+                output[2 * i + 1] = right[i] * gain;
+            }
+        } else {
+            for (size_t ch = 0; ch < channels; ++ch) {
+                const float *__restrict input = inputs[ch];
+                for (size_t i = 0; i < frames; ++i) output[i * channels + ch] = input[i] * gain;
+            }
+        }
+    }
+
+    // Bit tests rather than std::isfinite, so the check survives fast-math and stays branch-free
+    size_t sanitize(float *data, size_t size, bool flushSubnormals) {
+        size_t nonFinite = 0;
+        for (size_t i = 0; i < size; ++i) {
+            unsigned int bits;
+            __builtin_memcpy(&bits, data + i, sizeof(bits));
+            unsigned int exponent = bits & 0x7f800000u;
+            bool invalid = exponent == 0x7f800000u;
+            bool subnormal = flushSubnormals && exponent == 0;
+            nonFinite += invalid;
+            data[i] = (invalid || subnormal) ? 0.0f : data[i];
+        }
+        return nonFinite;
+    }
+
+    size_t countInvalid(const float *data, size_t size, bool countSubnormals) {
+        size_t invalid = 0;
+        for (size_t i = 0; i < size; ++i) {
+            unsigned int bits;
+            __builtin_memcpy(&bits, data + i, sizeof(bits));
+            unsigned int exponent = bits & 0x7f800000u;
+            invalid += (exponent == 0x7f800000u) || (countSubnormals && exponent == 0 && (bits & 0x007fffffu) != 0);
+        }
+        return invalid;
+    }
+
+    void toBf16(uint16_t *__restrict output, const float *__restrict input, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            uint32_t bits;
+            __builtin_memcpy(&bits, input + i, sizeof(bits));
+            uint32_t rounded = (bits + 0x7fffu + ((bits >> 16) & 1)) >> 16;
+            bool nan = (bits & 0x7fffffffu) > 0x7f800000u;
+            output[i] = static_cast<uint16_t>(nan ? (bits >> 16) | 0x40 : rounded);
+        }
+    }
+
+    void fromBf16(float *__restrict output, const uint16_t *__restrict input, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            uint32_t bits = static_cast<uint32_t>(input[i]) << 16;
+            __builtin_memcpy(output + i, &bits, sizeof(bits));
+        }
+    }
+
+    /*
+     * Taken one band at a time the recurrence is bound by the latency of each step. Each block of 8 is scanned from
+     * zero on its own, which doesn't depend on the previous block, then joined to the running state with one
+     * multiply-add per band.
+     */
+    template<bool reverse>
+    float onePole(float *data, size_t size, float slew, float state) {
+        constexpr size_t block = 8;
+        float decay = 1 - slew;
+        float decays[block];
+        decays[0] = decay;
+        for (size_t k = 1; k < block; ++k) decays[k] = decays[k - 1] * decay;
+
+        auto at = [data, size](size_t i) -> float & { return data[reverse ? size - 1 - i : i]; };
+        size_t i = 0;
+        for (; i + block <= size; i += block) {
+            float scan[block];
+            float sum = 0;
+            for (size_t k = 0; k < block; ++k) {
+                sum = sum * decay + at(i + k) * slew;
+                scan[k] = sum;
+            }
+            for (size_t k = 0; k < block; ++k) at(i + k) = decays[k] * state + scan[k];
+            state = decays[block - 1] * state + scan[block - 1];
+        }
+        for (; i < size; ++i) {
+            state = state * decay + at(i) * slew;
+            at(i) = state;
+        }
+        return state;
+    }
+
+    float onePole(float *data, size_t size, float slew, float state, bool reverse) {
+        return reverse ? onePole<true>(data, size, slew, state) : onePole<false>(data, size, slew, state);
+    }
+
+    void greaterMask(uint64_t *__restrict mask, const float *__restrict a, const float *__restrict b, size_t size) {
+        for (size_t base = 0; base < size; base += 64) {
+            size_t count = size - base < 64 ? size - base : 64;
+            uint64_t bits = 0;
+            for (size_t j = 0; j < count; ++j) bits |= static_cast<uint64_t>(a[base + j] > b[base + j]) << j;
+            mask[base / 64] = bits;
+        }
+    }
+
+    void smoothstep(float *__restrict map, size_t start, size_t end, float origin, float rangeScale, float offset,
+                    float outScale, float gradScale) {
+        // 32-bit indices, which convert to float in one vector instruction
+        for (auto b = static_cast<int32_t>(start); b < static_cast<int32_t>(end); ++b) {
+            float position = static_cast<float>(b);
+            float r = (position - origin) * rangeScale;
+            map[2 * b] = position + offset + r * r * (3 - 2 * r) * outScale;
+            map[2 * b + 1] = 1 + 6 * r * (1 - r) * gradScale;
+        }
+    }
+}
+
+#define KLARITY_KERNEL_TABLE(name) { \
+    name, \
+    {fftStep2<false>, fftStep2<true>}, \
+    {fftStep4<false>, fftStep4<true>}, \
+    {complexMultiply<false>, complexMultiply<true>}, \
+    window, \
+    deinterleave, \
+    interleave, \
+    sanitize, \
+    countInvalid, \
+    toBf16, \
+    fromBf16, \
+    onePole, \
+    greaterMask, \
+    smoothstep \
+}
+
+#endif //KLARITY_SAMPLER_KERNELS_IMPL_H
@@ -0,0 +1,4 @@
+#include "kernels_impl.h"
+
+// Built with -march=armv8.2-a+sve, only selected when the kernel reports SVE in AT_HWCAP
+extern const signalsmith::kernels::Table sveKernels = KLARITY_KERNEL_TABLE("sve");
@@ -0,0 +1,346 @@
+#include "match.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr float onsetLowHz = 50, onsetHighHz = 8000;
+    constexpr int onsetGroups = 20;
+    constexpr float chromaLowHz = 110, chromaHighHz = 5000;
+    constexpr double tempoWindowSeconds = 8;
+    constexpr double chromaTimeConstant = 20;
+    constexpr double estimatePeriod = 0.5;
+    constexpr double minTempo = 60, maxTempo = 200, tempoStep = 0.25;
+
+    // Krumhansl-Kessler profiles, from the tonic up
+    constexpr std::array<float, 12> majorProfile = {6.35f, 2.23f, 3.48f, 2.33f, 4.38f, 4.09f, 2.52f, 5.19f, 2.39f, 3.66f, 2.29f, 2.88f};
+    constexpr std::array<float, 12> minorProfile = {6.33f, 2.68f, 3.52f, 5.38f, 2.60f, 3.53f, 2.54f, 4.75f, 3.98f, 2.69f, 3.34f, 3.17f};
+
+    // Pearson correlation of `chroma` with `profile` rotated to `tonic`
+    float correlation(const std::array<float, 12> &chroma, const std::array<float, 12> &profile, int tonic) {
+        float chromaMean = 0, profileMean = 0;
+        for (int i = 0; i < 12; ++i) {
+            chromaMean += chroma[i] / 12;
+            profileMean += profile[i] / 12;
+        }
+        float product = 0, chromaSquares = 0, profileSquares = 0;
+        for (int pitchClass = 0; pitchClass < 12; ++pitchClass) {
+            float x = chroma[pitchClass] - chromaMean;
+            float y = profile[(pitchClass - tonic + 12) % 12] - profileMean;
+            product += x * y;
+            chromaSquares += x * x;
+            profileSquares += y * y;
+        }
+        return chromaSquares > 0 ? product / std::sqrt(chromaSquares * profileSquares) : 0;
+    }
+
+    // Tonic of the relative major, so a minor key matches the major with the same notes
+    int relativeMajor(const TrackAnalysis &analysis) {
+        return (analysis.keyTonic + (analysis.keyMinor ? 3 : 0)) % 12;
+    }
+}
+
+TrackAnalyzer::TrackAnalyzer(uint32_t sampleRate) : sampleRate(sampleRate) {}
+
+void TrackAnalyzer::configureSpectrum(int channels, int bands, int fftSize, int interval) {
+    this->channels = channels;
+    this->fftSize = fftSize;
+    this->interval = interval;
+
+    // Bands are offset by half a bin, as in the stretcher
+    auto bandAt = [&](float hz) {
+        return std::clamp(static_cast<int>(std::ceil(hz / static_cast<float>(sampleRate) * static_cast<float>(fftSize) - 0.5f)), 0, bands);
+    };
+    lowBand = bandAt(onsetLowHz);
+    highBand = bandAt(onsetHighHz);
+    chromaLowBand = std::max(bandAt(chromaLowHz), lowBand + 1);
+    chromaHighBand = std::min(bandAt(chromaHighHz), highBand - 1);
+
+    bandGroups.assign(bands, -1);
+    for (int b = lowBand; b < highBand; ++b) {
+        float hz = (static_cast<float>(b) + 0.5f) * static_cast<float>(sampleRate) / static_cast<float>(fftSize);
+        auto group = static_cast<int>(std::log2(hz / onsetLowHz) / std::log2(onsetHighHz / onsetLowHz) * onsetGroups);
+        bandGroups[b] = static_cast<int8_t>(std::clamp(group, 0, onsetGroups - 1));
+    }
+    energy.assign(bands, 0);
+    groupEnergy.assign(onsetGroups, 0);
+    previousGroupEnergy.assign(onsetGroups, 0);
+
+    double blocksPerSecond = static_cast<double>(sampleRate) / interval;
+    envelope.assign(static_cast<size_t>(std::ceil(tempoWindowSeconds * blocksPerSecond)), 0);
+    ordered.assign(envelope.size(), 0);
+    maxLag = static_cast<int>(std::ceil(60 / minTempo * blocksPerSecond));
+    // Up to 4 periods, for the refinement in `estimateTempo`
+    autocorrelation.assign(std::min<size_t>(4 * maxLag + 2, envelope.size()), 0);
+
+    // Chroma is added every other block
+    chromaDecay = static_cast<float>(std::exp(-2 / (chromaTimeConstant * blocksPerSecond)));
+    estimateBlocks = std::max(1, static_cast<int>(std::lround(estimatePeriod * blocksPerSecond)));
+
+    clear();
+}
+
+void TrackAnalyzer::clear() {
+    std::fill(previousGroupEnergy.begin(), previousGroupEnergy.end(), 0.0f);
+    hasPrevious = false;
+    std::fill(envelope.begin(), envelope.end(), 0.0f);
+    envelopeWrite = envelopeCount = 0;
+    inputPosition = 0;
+    gridCell = -1;
+    lastOnset = 0;
+    chroma.fill(0);
+    blocks = 0;
+
+    tempo.store(0, std::memory_order_relaxed);
+    tempoConfidence.store(0, std::memory_order_relaxed);
+    keyConfidence.store(0, std::memory_order_relaxed);
+    key.store(-1, std::memory_order_relaxed);
+}
+
+void TrackAnalyzer::observeSpectrum(const std::complex<float> *const *spectra, int inputInterval) {
+    if (resetRequested.exchange(false, std::memory_order_acquire)) clear();
+    if (channels == 0) return;
+
+    std::fill(groupEnergy.begin(), groupEnergy.end(), 0.0f);
+    for (int b = lowBand; b < highBand; ++b) {
+        float sum = 0;
+        for (int c = 0; c < channels; ++c) sum += std::norm(spectra[c][b]);
+        energy[b] = sum;
+        groupEnergy[bandGroups[b]] += sum;
+    }
+
+    // Rectified rise in log energy per group, against a floor around -90 dB of full scale
+    if (hasPrevious && inputInterval > 0) {
+        float floor = 1e-10f * static_cast<float>(fftSize) * static_cast<float>(fftSize);
+        float onset = 0;
+        for (int g = 0; g < onsetGroups; ++g) {
+            onset += std::max(0.0f, std::log((groupEnergy[g] + floor) / (previousGroupEnergy[g] + floor)));
+        }
+        addOnset(onset, inputInterval);
+    }
+    std::swap(groupEnergy, previousGroupEnergy);
+    hasPrevious = true;
+
+    if (blocks % 2 == 0) addChroma();
+    if (++blocks % estimateBlocks == 0) {
+        estimateTempo();
+        estimateKey();
+    }
+}
+
+void TrackAnalyzer::addOnset(float onset, int inputInterval) {
+    auto push = [this](float value) {
+        envelope[envelopeWrite] = value;
+        envelopeWrite = (envelopeWrite + 1) % envelope.size();
+        envelopeCount = std::min(envelopeCount + 1, envelope.size());
+    };
+
+    // Blocks are `interval` output samples apart, so in input samples they're closer or further apart with the speed
+    inputPosition += inputInterval;
+    auto cell = static_cast<int64_t>(inputPosition / interval);
+    if (gridCell < 0) {
+        push(onset);
+    } else if (cell == gridCell) {
+        float &last = envelope[(envelopeWrite + envelope.size() - 1) % envelope.size()];
+        last = std::max(last, onset);
+        onset = last;
+    } else {
+        auto steps = std::min<int64_t>(cell - gridCell, static_cast<int64_t>(envelope.size()));
+        for (int64_t k = 1; k <= steps; ++k) {
+            push(lastOnset + (onset - lastOnset) * static_cast<float>(k) / static_cast<float>(steps));
+        }
+    }
+    gridCell = cell;
+    lastOnset = onset;
+}
+
+void TrackAnalyzer::addChroma() {
+    // Spectral peaks only, at their interpolated frequency: a partial's window spreads over several semitones below 500 Hz
+    std::array<float, 12> blockChroma{};
+    float total = 0;
+    for (int b = chromaLowBand; b < chromaHighBand; ++b) {
+        float e = energy[b], below = energy[b - 1], above = energy[b + 1];
+        if (!(e > below && e >= above)) continue;
+
+        float curvature = below - 2 * e + above;
+        float offset = curvature < 0 ? 0.5f * (below - above) / curvature : 0;
+        float hz = (static_cast<float>(b) + offset + 0.5f) * static_cast<float>(sampleRate) / static_cast<float>(fftSize);
+        auto note = static_cast<int>(std::lround(12 * std::log2(hz / 440) + 69));
+        float weight = std::sqrt(e);
+        blockChroma[(note % 12 + 12) % 12] += weight;
+        total += weight;
+    }
+    if (total <= 0) return;
+    for (int i = 0; i < 12; ++i) chroma[i] = chroma[i] * chromaDecay + blockChroma[i] / total;
+}
+
+void TrackAnalyzer::estimateTempo() {
+    size_t count = envelopeCount;
+    // Half the window, so the longest period still repeats a few times
+    if (count < envelope.size() / 2) return;
+
+    size_t start = (envelopeWrite + envelope.size() - count) % envelope.size();
+    float mean = 0;
+    for (size_t i = 0; i < count; ++i) {
+        ordered[i] = envelope[(start + i) % envelope.size()];
+        mean += ordered[i];
+    }
+    mean /= static_cast<float>(count);
+    for (size_t i = 0; i < count; ++i) ordered[i] -= mean;
+    // A [1 2 1] smoothing widens the autocorrelation peaks to a few lags, so they can be interpolated
+    float previous = ordered[0];
+    for (size_t i = 1; i + 1 < count; ++i) {
+        float current = ordered[i];
+        ordered[i] = 0.25f * previous + 0.5f * current + 0.25f * ordered[i + 1];
+        previous = current;
+    }
+
+    int lags = static_cast<int>(std::min(autocorrelation.size(), count / 2));
+    for (int lag = 0; lag < lags; ++lag) {
+        float sum = 0;
+        for (size_t i = 0; i + lag < count; ++i) sum += ordered[i] * ordered[i + lag];
+        autocorrelation[lag] = sum / static_cast<float>(count - lag);
+    }
+    if (autocorrelation[0] <= 0) return;
+
+    // Linear interpolation between lags, so periods between grid cells score as well as those on them
+    auto at = [&](double lag) {
+        auto low = static_cast<int>(lag);
+        double fraction = lag - low;
+        return autocorrelation[low] + (autocorrelation[low + 1] - autocorrelation[low]) * fraction;
+    };
+
+    // Each tempo scored with the multiples of its period, weighted towards 120 bpm within an octave or so
+    auto blocksPerMinute = 60 * static_cast<double>(sampleRate) / interval;
+    double bestPeriod = 0, bestScore = 0;
+    for (double candidate = minTempo; candidate <= maxTempo; candidate += tempoStep) {
+        double period = blocksPerMinute / candidate;
+        if (period + 1 >= lags) continue;
+        double score = at(period);
+        if (2 * period + 1 < lags) score += 0.5 * at(2 * period);
+        if (4 * period + 1 < lags) score += 0.25 * at(4 * period);
+        double octaves = std::log2(candidate / 120);
+        score *= std::exp(-0.5 * octaves * octaves);
+        if (score > bestScore) {
+            bestScore = score;
+            bestPeriod = period;
+        }
+    }
+    if (bestPeriod == 0) return;
+    auto bestLag = static_cast<int>(std::lround(bestPeriod));
+
+    // The peak at the furthest multiple that fits pins the period down more finely than the grid
+    int multiple = 4;
+    while (multiple > 1 && multiple * (bestLag + 1) + 1 >= lags) multiple /= 2;
+    int peak = multiple * bestLag;
+    for (int lag = std::max(1, peak - multiple); lag <= std::min(lags - 2, peak + multiple); ++lag) {
+        if (autocorrelation[lag] > autocorrelation[peak]) peak = lag;
+    }
+    double position = peak;
+    if (peak >= 1 && peak + 1 < lags) {
+        double below = autocorrelation[peak - 1], at = autocorrelation[peak], above = autocorrelation[peak + 1];
+        double curvature = below - 2 * at + above;
+        if (curvature < 0) position += 0.5 * (below - above) / curvature;
+    }
+
+    tempo.store(static_cast<float>(blocksPerMinute * multiple / position), std::memory_order_relaxed);
+    tempoConfidence.store(std::clamp(autocorrelation[peak] / autocorrelation[0], 0.0f, 1.0f), std::memory_order_relaxed);
+}
+
+void TrackAnalyzer::estimateKey() {
+    int bestKey = -1;
+    float best = -1;
+    for (int tonic = 0; tonic < 12; ++tonic) {
+        float major = correlation(chroma, majorProfile, tonic), minor = correlation(chroma, minorProfile, tonic);
+        if (major > best) {
+            best = major;
+            bestKey = tonic;
+        }
+        if (minor > best) {
+            best = minor;
+            bestKey = tonic + 12;
+        }
+    }
+    if (best <= 0) return;
+
+    key.store(bestKey, std::memory_order_relaxed);
+    keyConfidence.store(best, std::memory_order_relaxed);
+}
+
+TrackAnalysis TrackAnalyzer::getAnalysis() const {
+    TrackAnalysis analysis;
+    analysis.tempo = tempo.load(std::memory_order_relaxed);
+    analysis.tempoConfidence = tempoConfidence.load(std::memory_order_relaxed);
+    int current = key.load(std::memory_order_relaxed);
+    analysis.keyTonic = current < 0 ? -1 : current % 12;
+    analysis.keyMinor = current >= 12;
+    analysis.keyConfidence = keyConfidence.load(std::memory_order_relaxed);
+    return analysis;
+}
+
+void TrackAnalyzer::reset() {
+    resetRequested.store(true, std::memory_order_release);
+}
+
+TrackMatcher::TrackMatcher(Sampler &leader, Sampler &follower, TrackMatchOptions options) :
+        leader(leader), follower(follower), options(options),
+        leaderAnalyzer(leader.getSampleRate()), followerAnalyzer(follower.getSampleRate()) {
+    if (&leader == &follower) {
+        throw SamplerException("Unable to match a sampler to itself");
+    }
+
+    state.targetSpeed = state.speed = appliedSpeed = follower.getPlaybackSpeed();
+    state.targetSemitones = state.semitones = appliedSemitones = 12 * std::log2(follower.getPitchFactor());
+
+    leader.setSpectrumObserver(&leaderAnalyzer);
+    follower.setSpectrumObserver(&followerAnalyzer);
+}
+
+TrackMatcher::~TrackMatcher() {
+    leader.setSpectrumObserver(nullptr);
+    follower.setSpectrumObserver(nullptr);
+}
+
+TrackMatchState TrackMatcher::update(double elapsedSeconds) {
+    state.leader = leaderAnalyzer.getAnalysis();
+    state.follower = followerAnalyzer.getAnalysis();
+    const auto &heard = state.leader;
+    const auto &own = state.follower;
+
+    if (options.matchTempo && heard.tempo > 0 && own.tempo > 0 &&
+        heard.tempoConfidence >= options.minTempoConfidence && own.tempoConfidence >= options.minTempoConfidence) {
+        // Half or double time is as good a match, whichever needs the smallest change
+        float ratio = heard.tempo * leader.getPlaybackSpeed() / own.tempo;
+        while (ratio > static_cast<float>(M_SQRT2)) ratio /= 2;
+        while (ratio < static_cast<float>(M_SQRT1_2)) ratio *= 2;
+        state.targetSpeed = std::abs(ratio - 1) <= options.maxSpeedChange ? ratio : 1;
+    }
+
+    if (options.matchKey && heard.keyTonic >= 0 && own.keyTonic >= 0 &&
+        heard.keyConfidence >= options.minKeyConfidence && own.keyConfidence >= options.minKeyConfidence) {
+        float semitones = static_cast<float>(relativeMajor(heard) - relativeMajor(own)) + 12 * std::log2(leader.getPitchFactor());
+        state.targetSemitones = semitones - 12 * std::round(semitones / 12);
+    }
+
+    auto glide = options.glideSeconds > 0 ? static_cast<float>(1 - std::exp(-elapsedSeconds / options.glideSeconds)) : 1.0f;
+    state.speed += (state.targetSpeed - state.speed) * glide;
+    state.semitones += (state.targetSemitones - state.semitones) * glide;
+
+    if (options.matchTempo && std::abs(state.speed - appliedSpeed) > 1e-4f) {
+        follower.setPlaybackSpeed(state.speed);
+        appliedSpeed = state.speed;
+    }
+    if (options.matchKey && std::abs(state.semitones - appliedSemitones) > 1e-3f) {
+        follower.setPitchSemitones(state.semitones);
+        appliedSemitones = state.semitones;
+    }
+
+    return state;
+}
+
+void TrackMatcher::resetLeader() {
+    leaderAnalyzer.reset();
+}
+
+void TrackMatcher::resetFollower() {
+    followerAnalyzer.reset();
+}
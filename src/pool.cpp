@@ -0,0 +1,228 @@
+#include "pool.h"
+#include <algorithm>
+#include <optional>
+
+namespace {
+    uint64_t steadyNanos() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    }
+}
+
+// Forwards to the sampler's real sink, noting when the first frames of a lease arrive
+struct PooledSink : SamplerSink {
+    std::unique_ptr<SamplerSink> sink;
+    // Nanoseconds on the steady clock, 0 until the first frames since the lease began
+    std::atomic<uint64_t> firstAudioNanos{0};
+
+    explicit PooledSink(std::unique_ptr<SamplerSink> sink) : sink(std::move(sink)) {}
+
+    void noteAudio(uint64_t frames) {
+        if (frames > 0 && firstAudioNanos.load(std::memory_order_relaxed) == 0) {
+            firstAudioNanos.store(steadyNanos(), std::memory_order_relaxed);
+        }
+    }
+
+    void start() override {
+        sink->start();
+    }
+
+    void stop() override {
+        sink->stop();
+    }
+
+    bool isActive() override {
+        return sink->isActive();
+    }
+
+    void write(const float *samples, uint64_t frames) override {
+        noteAudio(frames);
+        sink->write(samples, frames);
+    }
+
+    uint64_t tryWrite(const float *samples, uint64_t frames) override {
+        uint64_t written = sink->tryWrite(samples, frames);
+        noteAudio(written);
+        return written;
+    }
+
+    void notifyWhenFree(uint64_t frames, AsyncWaiter &waiter, SamplerExecutor &executor) override {
+        sink->notifyWhenFree(frames, waiter, executor);
+    }
+
+    void discard() override {
+        sink->discard();
+    }
+
+    void pause() override {
+        sink->pause();
+    }
+
+    void resume() override {
+        sink->resume();
+    }
+
+    double latency() override {
+        return sink->latency();
+    }
+
+    uint64_t position() override {
+        return sink->position();
+    }
+
+    bool schedule(std::unique_ptr<TimelineEvent> event) override {
+        return sink->schedule(std::move(event));
+    }
+};
+
+SamplerPool::SamplerPool(size_t capacity, std::chrono::steady_clock::duration idleTimeout, SinkFactory sinkFactory) :
+        capacity(capacity), idleTimeout(idleTimeout), sinkFactory(std::move(sinkFactory)) {}
+
+SamplerPool::~SamplerPool() = default;
+
+SamplerPool::Idle SamplerPool::construct(const SamplerPoolKey &key) {
+    auto inner = sinkFactory ? sinkFactory(key.sampleRate, key.channels) : std::make_unique<PortAudioSink>(key.sampleRate, key.channels);
+    auto sink = std::make_unique<PooledSink>(std::move(inner));
+    auto *pooledSink = sink.get();
+
+    auto sampler = std::make_unique<Sampler>(key.sampleRate, key.channels, key.preset, std::move(sink), key.memory, key.precision);
+
+    return Idle{std::move(sampler), pooledSink, std::chrono::steady_clock::now()};
+}
+
+void SamplerPool::trimLocked(std::chrono::steady_clock::time_point now, std::vector<std::unique_ptr<Sampler>> &expired) {
+    for (auto entry = idle.begin(); entry != idle.end();) {
+        auto &samplers = entry->second;
+        size_t excess = samplers.size() > capacity ? samplers.size() - capacity : 0;
+        // The coldest come first, and once one is recent enough, so are the rest
+        size_t count = 0;
+        while (count < samplers.size() && (count < excess || now - samplers[count].since > idleTimeout)) ++count;
+
+        for (size_t i = 0; i < count; ++i) expired.push_back(std::move(samplers[i].sampler));
+        samplers.erase(samplers.begin(), samplers.begin() + static_cast<std::ptrdiff_t>(count));
+        stats.trimmed += count;
+        stats.idle -= count;
+
+        entry = samplers.empty() ? idle.erase(entry) : std::next(entry);
+    }
+}
+
+void SamplerPool::warm(const SamplerPoolKey &key, size_t count) {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = idle.find(key);
+            size_t ready = found == idle.end() ? 0 : found->second.size();
+            if (ready >= std::min(count, capacity)) return;
+        }
+
+        auto constructed = construct(key);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.constructed;
+        ++stats.idle;
+        idle[key].push_back(std::move(constructed));
+    }
+}
+
+std::unique_ptr<Sampler> SamplerPool::acquire(const SamplerPoolKey &key) {
+    uint64_t start = steadyNanos();
+
+    std::vector<std::unique_ptr<Sampler>> expired;
+    std::optional<Idle> reused;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        trimLocked(std::chrono::steady_clock::now(), expired);
+
+        auto found = idle.find(key);
+        if (found != idle.end()) {
+            reused = std::move(found->second.back());
+            found->second.pop_back();
+            if (found->second.empty()) idle.erase(found);
+            --stats.idle;
+        }
+    }
+
+    Idle entry = reused ? std::move(*reused) : construct(key);
+    entry.sink->firstAudioNanos.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stats.acquisitions;
+    if (!reused) {
+        ++stats.misses;
+        ++stats.constructed;
+    }
+    ++stats.leased;
+    leases[entry.sampler.get()] = Lease{key, entry.sink, start};
+    stats.acquire.record(steadyNanos() - start);
+
+    return std::move(entry.sampler);
+}
+
+void SamplerPool::release(std::unique_ptr<Sampler> sampler) {
+    if (!sampler) return;
+
+    Lease lease;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = leases.find(sampler.get());
+        if (found == leases.end()) {
+            throw SamplerException("Unable to release sampler that wasn't acquired from this pool");
+        }
+        lease = found->second;
+        leases.erase(found);
+        --stats.leased;
+    }
+
+    // Blocks while the queued output plays out, so it runs outside the lock
+    sampler->stop();
+    sampler->reset();
+
+    std::vector<std::unique_ptr<Sampler>> expired;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t firstAudio = lease.sink->firstAudioNanos.load(std::memory_order_relaxed);
+    if (firstAudio != 0) {
+        stats.firstAudio.record(firstAudio - std::min(firstAudio, lease.acquiredNanos));
+    }
+
+    idle[lease.key].push_back(Idle{std::move(sampler), lease.sink, std::chrono::steady_clock::now()});
+    ++stats.idle;
+    trimLocked(std::chrono::steady_clock::now(), expired);
+}
+
+size_t SamplerPool::trim() {
+    std::vector<std::unique_ptr<Sampler>> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        trimLocked(std::chrono::steady_clock::now(), expired);
+    }
+    return expired.size();
+}
+
+void SamplerPool::setCapacity(size_t count) {
+    std::vector<std::unique_ptr<Sampler>> expired;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = count;
+    trimLocked(std::chrono::steady_clock::now(), expired);
+}
+
+void SamplerPool::setIdleTimeout(std::chrono::steady_clock::duration timeout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    idleTimeout = timeout;
+}
+
+SamplerPoolStats SamplerPool::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void SamplerPool::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    SamplerPoolStats reset;
+    reset.idle = stats.idle;
+    reset.leased = stats.leased;
+    stats = reset;
+}
@@ -0,0 +1,274 @@
+#include "rtaudit.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#define KLARITY_RT_AUDIT_INTERPOSE 1
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr size_t maxRecords = 256;
+    constexpr int maxFrames = 32;
+
+    struct Record {
+        std::atomic<bool> ready{false};
+        RealtimeViolationType type;
+        const char *function;
+        void *frames[maxFrames];
+        int depth;
+    };
+
+    Record records[maxRecords];
+    std::atomic<uint64_t> recordCount{0};
+    std::atomic<int> currentMode{-1};
+
+    // Initial-exec TLS never allocates on access, which matters inside malloc itself
+#ifdef __GNUC__
+    __attribute__((tls_model("initial-exec")))
+#endif
+    thread_local int sectionDepth = 0;
+#ifdef __GNUC__
+    __attribute__((tls_model("initial-exec")))
+#endif
+    thread_local bool auditing = false;
+
+    RealtimeAudit::Mode resolveMode() {
+        int mode = currentMode.load(std::memory_order_relaxed);
+        if (mode < 0) {
+            const char *setting = std::getenv("KLARITY_RT_AUDIT");
+            RealtimeAudit::Mode resolved = RealtimeAudit::Mode::record;
+            if (setting && std::strcmp(setting, "off") == 0) resolved = RealtimeAudit::Mode::off;
+            if (setting && std::strcmp(setting, "abort") == 0) resolved = RealtimeAudit::Mode::abort;
+            mode = static_cast<int>(resolved);
+            currentMode.store(mode, std::memory_order_relaxed);
+        }
+        return static_cast<RealtimeAudit::Mode>(mode);
+    }
+
+    const char *typeName(RealtimeViolationType type) {
+        switch (type) {
+            case RealtimeViolationType::allocation:
+                return "allocation";
+            case RealtimeViolationType::lock:
+                return "lock";
+            case RealtimeViolationType::syscall:
+                return "syscall";
+        }
+        return "unknown";
+    }
+
+    void check(RealtimeViolationType type, const char *function) {
+        if (sectionDepth == 0 || auditing) return;
+
+        RealtimeAudit::Mode mode = resolveMode();
+        if (mode == RealtimeAudit::Mode::off) return;
+
+        // Everything below may itself allocate or write, which must not be reported again
+        auditing = true;
+
+        uint64_t index = recordCount.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef KLARITY_RT_AUDIT_INTERPOSE
+        if (mode == RealtimeAudit::Mode::abort) {
+            const char *parts[] = {"klarity: real-time violation (", typeName(type), ") in ", function, "\n"};
+            for (const char *part: parts) {
+                (void) !::write(STDERR_FILENO, part, std::strlen(part));
+            }
+            void *frames[maxFrames];
+            backtrace_symbols_fd(frames, backtrace(frames, maxFrames), STDERR_FILENO);
+            std::abort();
+        }
+
+        if (index < maxRecords) {
+            Record &record = records[index];
+            record.type = type;
+            record.function = function;
+            record.depth = backtrace(record.frames, maxFrames);
+            record.ready.store(true, std::memory_order_release);
+        }
+#else
+        (void) index;
+        (void) type;
+        (void) function;
+#endif
+
+        auditing = false;
+    }
+
+#ifdef KLARITY_RT_AUDIT_INTERPOSE
+    // backtrace() loads its unwinder on first use, so do that before any real-time section can be entered
+    const bool unwinderLoaded = [] {
+        void *frame[1];
+        return backtrace(frame, 1) >= 0;
+    }();
+
+    template<typename Function>
+    Function next(std::atomic<void *> &slot, const char *name) {
+        void *function = slot.load(std::memory_order_acquire);
+        if (!function) {
+            function = dlsym(RTLD_NEXT, name);
+            slot.store(function, std::memory_order_release);
+        }
+        return reinterpret_cast<Function>(function);
+    }
+#endif
+}
+
+void RealtimeAudit::setMode(Mode mode) {
+    currentMode.store(static_cast<int>(mode), std::memory_order_relaxed);
+}
+
+RealtimeAudit::Mode RealtimeAudit::mode() {
+    return resolveMode();
+}
+
+std::vector<RealtimeViolation> RealtimeAudit::violations() {
+    std::vector<RealtimeViolation> result;
+
+    uint64_t count = std::min<uint64_t>(recordCount.load(std::memory_order_relaxed), maxRecords);
+    for (uint64_t i = 0; i < count; ++i) {
+        Record &record = records[i];
+        if (!record.ready.load(std::memory_order_acquire)) continue;
+
+        RealtimeViolation violation{record.type, record.function, {}};
+#ifdef KLARITY_RT_AUDIT_INTERPOSE
+        if (char **symbols = backtrace_symbols(record.frames, record.depth)) {
+            violation.stack.assign(symbols, symbols + record.depth);
+            std::free(symbols);
+        }
+#endif
+        result.push_back(std::move(violation));
+    }
+
+    return result;
+}
+
+uint64_t RealtimeAudit::violationCount() {
+    return recordCount.load(std::memory_order_relaxed);
+}
+
+void RealtimeAudit::clear() {
+    for (auto &record: records) {
+        record.ready.store(false, std::memory_order_relaxed);
+    }
+    recordCount.store(0, std::memory_order_relaxed);
+}
+
+RealtimeSection::RealtimeSection() {
+    ++sectionDepth;
+}
+
+RealtimeSection::~RealtimeSection() {
+    --sectionDepth;
+}
+
+#ifdef KLARITY_RT_AUDIT_INTERPOSE
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size) noexcept {
+    check(RealtimeViolationType::allocation, "malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    check(RealtimeViolationType::allocation, "calloc");
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) noexcept {
+    check(RealtimeViolationType::allocation, "realloc");
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) noexcept {
+    if (pointer) check(RealtimeViolationType::allocation, "free");
+    __libc_free(pointer);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    check(RealtimeViolationType::allocation, "memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    check(RealtimeViolationType::allocation, "aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) noexcept {
+    check(RealtimeViolationType::allocation, "posix_memalign");
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void *pointer = __libc_memalign(alignment, size);
+    if (!pointer) return ENOMEM;
+    *result = pointer;
+    return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::lock, "pthread_mutex_lock");
+    return next<int (*)(pthread_mutex_t *)>(function, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *condition, pthread_mutex_t *mutex) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::lock, "pthread_cond_wait");
+    return next<int (*)(pthread_cond_t *, pthread_mutex_t *)>(function, "pthread_cond_wait")(condition, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *condition, pthread_mutex_t *mutex, const struct timespec *time) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::lock, "pthread_cond_timedwait");
+    return next<int (*)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *)>(function, "pthread_cond_timedwait")(condition, mutex, time);
+}
+
+ssize_t read(int descriptor, void *buffer, size_t count) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::syscall, "read");
+    return next<ssize_t (*)(int, void *, size_t)>(function, "read")(descriptor, buffer, count);
+}
+
+ssize_t write(int descriptor, const void *buffer, size_t count) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::syscall, "write");
+    return next<ssize_t (*)(int, const void *, size_t)>(function, "write")(descriptor, buffer, count);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *remaining) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::syscall, "nanosleep");
+    return next<int (*)(const struct timespec *, struct timespec *)>(function, "nanosleep")(duration, remaining);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *duration, struct timespec *remaining) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::syscall, "clock_nanosleep");
+    return next<int (*)(clockid_t, int, const struct timespec *, struct timespec *)>(function, "clock_nanosleep")(clock, flags, duration, remaining);
+}
+
+int usleep(useconds_t duration) {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::syscall, "usleep");
+    return next<int (*)(useconds_t)>(function, "usleep")(duration);
+}
+
+int sched_yield() noexcept {
+    static std::atomic<void *> function{nullptr};
+    check(RealtimeViolationType::syscall, "sched_yield");
+    return next<int (*)()>(function, "sched_yield")();
+}
+}
+#endif
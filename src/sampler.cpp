@@ -1,57 +1,262 @@
 #include "sampler.h"
+#include <limits>
+#include <map>
+#include <tuple>
 
-Sampler::Sampler(uint32_t sampleRate, uint32_t channels) {
-    this->sampleRate = sampleRate;
-    this->channels = channels;
+namespace {
+    using Stretch = signalsmith::stretch::SignalsmithStretch<float>;
 
-    PaDeviceIndex deviceIndex = Pa_GetDefaultOutputDevice();
-    if (deviceIndex == paNoDevice) {
-        throw SamplerException("Error: No default output device");
+    void configure(Stretch &stretch, SamplerPreset preset, SamplerPrecision precision, uint32_t sampleRate, uint32_t channels) {
+        stretch.setCompactState(precision == SamplerPrecision::compact);
+        switch (preset) {
+            case SamplerPreset::standard:
+                stretch.presetDefault(static_cast<int>(channels), static_cast<float>(sampleRate));
+                break;
+            case SamplerPreset::cheaper:
+                stretch.presetCheaper(static_cast<int>(channels), static_cast<float>(sampleRate));
+                break;
+        }
     }
 
-    PaStreamParameters outputParameters;
-    outputParameters.device = deviceIndex;
-    outputParameters.channelCount = static_cast<int>(channels);
-    outputParameters.sampleFormat = paFloat32;
-    outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultHighOutputLatency;
-    outputParameters.hostApiSpecificStreamInfo = nullptr;
+    // Sizes an arena by replaying construction and configuration on a measuring one, once per configuration
+    std::unique_ptr<StretchArena> makeArena(SamplerPreset preset, SamplerPrecision precision, uint32_t sampleRate, uint32_t channels) {
+        static std::mutex mutex;
+        static std::map<std::tuple<SamplerPreset, SamplerPrecision, uint32_t, uint32_t>, size_t> capacities;
 
-    PaStream *rawStream = nullptr;
-    PaError err = Pa_OpenStream(
-            &rawStream,
-            nullptr,
-            &outputParameters,
-            sampleRate,
-            paFramesPerBufferUnspecified,
-            paClipOff,
-            nullptr,
-            nullptr
-    );
-    if (err != paNoError) {
-        throw SamplerException("PortAudio error: " + std::string(Pa_GetErrorText(err)));
+        size_t capacity;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::make_tuple(preset, precision, sampleRate, channels);
+            auto found = capacities.find(key);
+            if (found == capacities.end()) {
+                StretchArena measure;
+                {
+                    Stretch probe{std::pmr::polymorphic_allocator<>(&measure)};
+                    configure(probe, preset, precision, sampleRate, channels);
+                    probe.reset();
+                }
+                found = capacities.emplace(key, measure.required() + sizeof(Stretch) + alignof(Stretch) + StretchArena::cacheLine).first;
+            }
+            capacity = found->second;
+        }
+        return std::make_unique<StretchArena>(capacity);
     }
+}
 
-    stream.reset(rawStream);
+SamplerAwaitable::SamplerAwaitable(Sampler &sampler, SamplerExecutor &executor, bool drain, bool done) :
+        sampler(&sampler), executor(&executor), drain(drain), done(done) {
+    wake = &SamplerAwaitable::resumeWhenDone;
+}
 
-    stretch.reset(new signalsmith::stretch::SignalsmithStretch<float>());
+bool SamplerAwaitable::await_suspend(std::coroutine_handle<> coroutine) {
+    handle = coroutine;
+    return !sampler->advanceAsync(*this);
+}
 
-    stretch->presetDefault(static_cast<int>(channels), static_cast<float>(sampleRate));
+void SamplerAwaitable::resumeWhenDone(AsyncWaiter *waiter) {
+    auto *operation = static_cast<SamplerAwaitable *>(waiter);
+    if (operation->sampler->advanceAsync(*operation)) {
+        operation->handle.resume();
+    }
 }
 
-void Sampler::setPlaybackSpeed(float factor) {
+std::unique_lock<std::mutex> Sampler::acquireLock() {
+    // Callers bind `profileStats` only once they hold the lock, so the wait is recorded into them directly, and only
+    // after the lock is taken
+    KLARITY_PROFILE_SCOPE_INTO(profileStats, lockWait);
+
     std::unique_lock<std::mutex> lock(mutex);
+    return lock;
+}
+
+Sampler::StretchPointer Sampler::createStretch(std::unique_ptr<StretchArena> &stretchArena) {
+    StretchPointer result;
+    switch (memory) {
+        case SamplerMemory::heap:
+            result.reset(new Stretch());
+            break;
+        case SamplerMemory::arena: {
+            stretchArena = makeArena(preset, precision, sampleRate, channels);
+            std::pmr::polymorphic_allocator<> allocator(stretchArena.get());
+            auto *storage = allocator.allocate_object<Stretch>();
+            result = StretchPointer(new(storage) Stretch(allocator), SignalsmithStretchDeleter{true});
+            break;
+        }
+    }
+
+    configure(*result, preset, precision, sampleRate, channels);
+    applyPitch(*result);
+    result->setTransientReset(transientReset);
+
+    return result;
+}
+
+void Sampler::applyPitch(signalsmith::stretch::SignalsmithStretch<float> &target) const {
+    if (!pitchMap) {
+        target.setTransposeFactor(pitchFactor, pitchTonalityLimit / static_cast<float>(sampleRate));
+        return;
+    }
+
+    // The stretcher's frequencies are in cycles per sample
+    auto rate = static_cast<float>(sampleRate);
+    target.setFreqMap([map = pitchMap, rate](float frequency) { return map(frequency * rate) / rate; }, true);
+}
+
+void Sampler::ensureBuffers(int inputSamples, int outputSamples) {
+    if (inputBuffers.empty() || inputBuffers[0].size() < static_cast<size_t>(inputSamples)) {
+        inputBuffers.assign(channels, std::vector<float>(inputSamples));
+        inputPointers.clear();
+        for (auto &buffer: inputBuffers) inputPointers.push_back(buffer.data());
+    }
+
+    if (outputBuffers.empty() || outputBuffers[0].size() < static_cast<size_t>(outputSamples)) {
+        outputBuffers.assign(channels, std::vector<float>(outputSamples));
+        outputBuffer.resize(static_cast<size_t>(outputSamples) * channels);
+        outputPointers.clear();
+        for (auto &buffer: outputBuffers) outputPointers.push_back(buffer.data());
+    }
+}
+
+Sampler::Sampler(
+        uint32_t sampleRate,
+        uint32_t channels,
+        SamplerPreset preset,
+        std::unique_ptr<SamplerSink> sink,
+        SamplerMemory memory,
+        SamplerPrecision precision
+) {
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    this->preset = preset;
+    this->memory = memory;
+    this->precision = precision;
+
+    if (sink) {
+        this->sink = std::move(sink);
+    } else {
+        this->sink = std::make_unique<PortAudioSink>(sampleRate, channels);
+    }
+
+    stretch = createStretch(arena);
+}
+
+void Sampler::setPlaybackSpeed(float factor) {
+    auto lock = acquireLock();
 
-    if (!stretch || stream == nullptr) {
+    if (!stretch || sink == nullptr) {
         throw SamplerException("Unable to set playback speed on uninitialized sampler");
     }
 
+    if (cache.enabled() && factor != playbackSpeedFactor) {
+        cacheChain = RenderCache::hash(cacheChain, &factor, sizeof(factor));
+    }
+
     playbackSpeedFactor = factor;
 }
 
+void Sampler::setPitchFactor(float factor, float tonalityLimit) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to set pitch on uninitialized sampler");
+    }
+
+    if (!(factor > 0) || !std::isfinite(factor) || !(tonalityLimit >= 0)) {
+        throw SamplerException("Unable to set pitch factor " + std::to_string(factor) + " with tonality limit " + std::to_string(tonalityLimit));
+    }
+
+    if (cache.enabled() && (factor != pitchFactor || tonalityLimit != pitchTonalityLimit || pitchMapId != 0)) {
+        float pitch[] = {factor, tonalityLimit};
+        cacheChain = RenderCache::hash(cacheChain, pitch, sizeof(pitch));
+    }
+
+    pitchFactor = factor;
+    pitchTonalityLimit = tonalityLimit;
+    pitchMap = nullptr;
+    pitchMapId = 0;
+
+    // Takes effect from the next hop, a queued track and scheduled events follow it too
+    for (auto *target: {&stretch, &nextStretch, &eventStretch}) {
+        if (*target) applyPitch(**target);
+    }
+}
+
+void Sampler::setPitchMap(std::function<float(float)> inputToOutput) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to set pitch map on uninitialized sampler");
+    }
+
+    if (!inputToOutput) {
+        throw SamplerException("Unable to set empty pitch map");
+    }
+
+    // No two maps share an id, as maps can't be compared
+    pitchMap = std::move(inputToOutput);
+    pitchMapId = ++pitchMapCount;
+    if (cache.enabled()) {
+        cacheChain = RenderCache::hash(cacheChain, &pitchMapId, sizeof(pitchMapId));
+    }
+
+    for (auto *target: {&stretch, &nextStretch, &eventStretch}) {
+        if (*target) applyPitch(**target);
+    }
+}
+
+void Sampler::setPitchSemitones(float semitones, float tonalityLimit) {
+    setPitchFactor(std::exp2(semitones / 12.0f), tonalityLimit);
+}
+
+uint32_t Sampler::getSampleRate() const {
+    return sampleRate;
+}
+
+float Sampler::getPlaybackSpeed() {
+    auto lock = acquireLock();
+
+    return playbackSpeedFactor;
+}
+
+float Sampler::getPitchFactor() {
+    auto lock = acquireLock();
+
+    return pitchMap ? 1.0f : pitchFactor;
+}
+
+void Sampler::setSpectrumObserver(signalsmith::stretch::SpectrumObserver<float> *observer) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to set spectrum observer on uninitialized sampler");
+    }
+
+    spectrumObserver = observer;
+    stretch->setSpectrumObserver(observer);
+}
+
+void Sampler::setTransientReset(bool enabled) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to set transient reset on uninitialized sampler");
+    }
+
+    if (cache.enabled() && enabled != transientReset) {
+        uint8_t flag = enabled;
+        cacheChain = RenderCache::hash(cacheChain, &flag, sizeof(flag));
+    }
+
+    transientReset = enabled;
+    for (auto *target: {&stretch, &nextStretch, &eventStretch}) {
+        if (*target) (*target)->setTransientReset(enabled);
+    }
+}
+
 void Sampler::setVolume(float value) {
-    std::unique_lock<std::mutex> lock(mutex);
+    auto lock = acquireLock();
 
-    if (!stretch || stream == nullptr) {
+    if (!stretch || sink == nullptr) {
         throw SamplerException("Unable to setVolume on uninitialized sampler");
     }
 
@@ -59,24 +264,22 @@ void Sampler::setVolume(float value) {
 }
 
 int Sampler::start() {
-    std::unique_lock<std::mutex> lock(mutex);
+    auto lock = acquireLock();
 
-    if (!stretch || stream == nullptr) {
+    if (!stretch || sink == nullptr) {
         throw SamplerException("Unable to start uninitialized sampler");
     }
 
-    if (Pa_IsStreamActive(stream.get()) == 1) {
+    if (sink->isActive()) {
         throw SamplerException("Unable to start active sampler");
     }
 
     stretch->reset();
+    restartCacheChain(cacheSeed());
 
-    PaError err = Pa_StartStream(stream.get());
-    if (err != paNoError) {
-        throw SamplerException("Failed to start PortAudio stream: " + std::string(Pa_GetErrorText(err)));
-    }
+    sink->start();
 
-    double outputLatency = Pa_GetStreamInfo(stream.get())->outputLatency;
+    double outputLatency = sink->latency();
 
     double stretchLatency = (stretch->inputLatency() + stretch->outputLatency()) / static_cast<double>(this->sampleRate);
 
@@ -84,52 +287,1093 @@ int Sampler::start() {
 }
 
 void Sampler::play(const uint8_t *samples, uint64_t size) {
-    std::unique_lock<std::mutex> lock(mutex);
+    SamplerChunk chunk{samples, size};
+    playBatch(&chunk, 1);
+}
+
+void Sampler::playBatch(const SamplerChunk *chunks, size_t count) {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+    KLARITY_PROFILE_SCOPE(play);
+
+    checkPlayable();
+
+    int outputSamples = renderBatch(chunks, count);
+
+    {
+        KLARITY_PROFILE_SCOPE(deviceWrite);
+        sink->write(outputBuffer.data(), outputSamples);
+    }
+}
+
+SamplerAwaitable Sampler::playAsync(SamplerExecutor &executor, const uint8_t *samples, uint64_t size) {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+    KLARITY_PROFILE_SCOPE(play);
+
+    checkPlayable();
+
+    SamplerChunk chunk{samples, size};
+    pendingFrames = static_cast<uint64_t>(renderBatch(&chunk, 1));
+    pendingOffset = 0;
+
+    return SamplerAwaitable(*this, executor, false, !flushPending());
+}
+
+SamplerAwaitable Sampler::drained(SamplerExecutor &executor) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to drain uninitialized sampler");
+    }
+
+    return SamplerAwaitable(*this, executor, true, false);
+}
+
+bool Sampler::flushPending() {
+    // A stopped stream takes nothing anymore
+    if (!sink->isActive()) {
+        pendingFrames = 0;
+    }
+
+    KLARITY_PROFILE_SCOPE(deviceWrite);
+    uint64_t written = sink->tryWrite(outputBuffer.data() + pendingOffset * channels, pendingFrames);
+    pendingOffset += written;
+    pendingFrames -= written;
+
+    return pendingFrames > 0;
+}
+
+bool Sampler::advanceAsync(SamplerAwaitable &operation) {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+
+    // The waiter is handed to the sink last, it may be woken on another thread before this returns
+    if (flushPending()) {
+        sink->notifyWhenFree(pendingFrames, operation, *operation.executor);
+        return false;
+    }
+
+    if (operation.drain && !operation.draining && sink->isActive()) {
+        operation.draining = true;
+        sink->notifyWhenFree(UINT64_MAX, operation, *operation.executor);
+        return false;
+    }
+
+    return true;
+}
+
+template<class Inputs>
+void Sampler::processBuffers(Inputs &&inputs, int inputSamples, float *output, int outputSamples, size_t nonFiniteInput) {
+    const auto &kernels = KernelDispatch::table();
+
+    stretch->process(inputs, inputSamples, outputBuffers, outputSamples);
+
+    size_t nonFiniteOutput = 0;
 
-    if (!stretch || stream == nullptr || Pa_IsStreamActive(stream.get()) <= 0) {
+    {
+        KLARITY_PROFILE_SCOPE(interleave);
+        kernels.interleave(output, outputPointers.data(), channels, outputSamples, volume);
+        nonFiniteOutput = kernels.sanitize(output, static_cast<size_t>(outputSamples) * channels, !signalsmith::perf::StopDenormals::flushes);
+    }
+
+    if (nonFiniteInput > 0 || nonFiniteOutput > 0) {
+        nonFiniteStats.inputSamples += nonFiniteInput;
+        nonFiniteStats.outputSamples += nonFiniteOutput;
+        ++nonFiniteStats.affectedCalls;
+        if (nonFiniteOutput > 0) {
+            stretch->reset();
+            ++nonFiniteStats.stretchResets;
+        }
+    }
+}
+
+void Sampler::checkRenderable() {
+    if (!stretch) {
+        throw SamplerException("Unable to render with uninitialized sampler");
+    }
+
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to render before the previous asynchronous play completes");
+    }
+
+    if (!loopBuffers.empty()) {
+        throw SamplerException("Unable to render while looping");
+    }
+}
+
+void Sampler::checkPlayable() {
+    if (!stretch || sink == nullptr || !sink->isActive()) {
         throw SamplerException("Unable to play uninitialized sampler");
     }
 
-    if (size <= 0) {
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to play before the previous asynchronous play completes");
+    }
+
+    if (paused) {
+        throw SamplerException("Unable to play paused sampler");
+    }
+
+    if (!loopBuffers.empty()) {
+        throw SamplerException("Unable to play while looping");
+    }
+}
+
+int Sampler::renderBatch(const SamplerChunk *chunks, size_t count) {
+    uint64_t frameBytes = sizeof(float) * channels;
+    uint64_t totalFrames = 0;
+    for (size_t i = 0; i < count; ++i) totalFrames += chunks[i].size / frameBytes;
+
+    if (totalFrames == 0) {
         throw SamplerException("Unable to play empty samples");
     }
 
-    int inputSamples = static_cast<int>((float) size / sizeof(float) / (float) channels);
+    int inputSamples = static_cast<int>(totalFrames);
+
+    int outputSamples = static_cast<int>((float) inputSamples / playbackSpeedFactor);
+
+    ensureBuffers(inputSamples, outputSamples);
+
+    const auto &kernels = KernelDispatch::table();
+
+    // Without hardware flush-to-zero, subnormals are flushed at the boundaries instead
+    constexpr bool flushSubnormals = !signalsmith::perf::StopDenormals::flushes;
+
+    uint64_t cacheKey = 0;
+    const std::vector<float> *cached = nullptr;
+    if (cache.enabled()) {
+        cacheKey = cacheChain;
+        for (size_t i = 0; i < count; ++i) cacheKey = RenderCache::hash(cacheKey, chunks[i].samples, chunks[i].size);
+        cached = cache.find(cacheKey);
+        if (cached && cached->size() != static_cast<size_t>(outputSamples) * channels) {
+            cached = nullptr;
+        }
+        if (!cached) {
+            rebuildStretch();
+        }
+    }
+
+    uint64_t stretchResets = nonFiniteStats.stretchResets;
+
+    chunkPointers.resize(channels);
+
+    {
+        KLARITY_REALTIME_SECTION();
+
+        signalsmith::perf::StopDenormals stopDenormals;
+
+        size_t nonFiniteInput = 0;
+
+        {
+            KLARITY_PROFILE_SCOPE(deinterleave);
+            // Gathered back to back, so the packets are stretched as one block
+            uint64_t offset = 0;
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t frames = chunks[i].size / frameBytes;
+                for (uint32_t c = 0; c < channels; ++c) chunkPointers[c] = inputPointers[c] + offset;
+                kernels.deinterleave(chunkPointers.data(), reinterpret_cast<const float *>(chunks[i].samples), channels, frames);
+                offset += frames;
+            }
+            for (auto *input: inputPointers) {
+                nonFiniteInput += kernels.sanitize(input, inputSamples, flushSubnormals);
+            }
+        }
+
+        if (cached) {
+            KLARITY_PROFILE_SCOPE(interleave);
+            std::transform(cached->begin(), cached->end(), outputBuffer.begin(), [this](float sample) { return sample * volume; });
+        } else {
+            processBuffers(inputBuffers, inputSamples, outputBuffer.data(), outputSamples, nonFiniteInput);
+        }
+    }
+
+    if (cache.enabled()) {
+        appendCacheHistory(inputPointers.data(), inputSamples);
+        if (cached) {
+            stretchStale = true;
+            cacheChain = cacheKey;
+        } else if (nonFiniteStats.stretchResets != stretchResets) {
+            restartCacheChain(uniqueCacheOrigin());
+        } else {
+            // Kept before the volume, which may change by the time the chunk is replayed
+            size_t outputSize = static_cast<size_t>(outputSamples) * channels;
+            if (float *entry = cache.insert(cacheKey, outputSize)) {
+                kernels.interleave(entry, outputPointers.data(), channels, outputSamples, 1.0f);
+                kernels.sanitize(entry, outputSize, flushSubnormals);
+            }
+            cacheChain = cacheKey;
+        }
+    }
+
+    return outputSamples;
+}
+
+void Sampler::checkFile(const PcmFile &file, uint64_t from, uint64_t frames) {
+    if (file.channels() != channels) {
+        throw SamplerException("Unable to play file with a different channel count");
+    }
+
+    if (file.sampleRate() != 0 && file.sampleRate() != sampleRate) {
+        throw SamplerException("Unable to play file at a different sample rate");
+    }
+
+    if (frames == 0 || from > file.frames() || frames > file.frames() - from) {
+        throw SamplerException("Unable to play frames outside the file");
+    }
+}
+
+int Sampler::renderFileBlock(const PcmFile &file, uint64_t frame, int inputSamples, float *output) {
+    const float *block = file.data() + frame * channels;
+    size_t blockSize = static_cast<size_t>(inputSamples) * channels;
+
+    const auto &kernels = KernelDispatch::table();
+
+    // The mapped pages are read-only, so input that needs cleaning up (or keeping for the cache) is copied like `play`'s
+    if (cache.enabled() || kernels.countInvalid(block, blockSize, !signalsmith::perf::StopDenormals::flushes) > 0) {
+        SamplerChunk chunk{reinterpret_cast<const uint8_t *>(block), blockSize * sizeof(float)};
+        int outputSamples = renderBatch(&chunk, 1);
+        if (output) {
+            std::copy_n(outputBuffer.data(), static_cast<size_t>(outputSamples) * channels, output);
+        }
+        return outputSamples;
+    }
 
     int outputSamples = static_cast<int>((float) inputSamples / playbackSpeedFactor);
 
-    std::vector<std::vector<float>> inputBuffers(channels, std::vector<float>(inputSamples));
+    ensureBuffers(0, outputSamples);
+
+    {
+        KLARITY_REALTIME_SECTION();
+
+        signalsmith::perf::StopDenormals stopDenormals;
+
+        processBuffers(file.view(frame), inputSamples, output ? output : outputBuffer.data(), outputSamples, 0);
+    }
+
+    return outputSamples;
+}
+
+void Sampler::playFile(const PcmFile &file, uint64_t from, uint64_t frames) {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+    KLARITY_PROFILE_SCOPE(play);
+
+    checkPlayable();
+    checkFile(file, from, frames);
+
+    for (uint64_t offset = 0; offset < frames; offset += fileBlockFrames) {
+        auto inputSamples = static_cast<int>(std::min(fileBlockFrames, frames - offset));
+        int outputSamples = renderFileBlock(file, from + offset, inputSamples, nullptr);
+
+        {
+            KLARITY_PROFILE_SCOPE(deviceWrite);
+            sink->write(outputBuffer.data(), outputSamples);
+        }
+
+        // The stretcher keeps its own copy of the history it needs
+        file.release(from + offset, from + offset + inputSamples);
+    }
+}
+
+uint64_t Sampler::getFileOutputFrames(uint64_t frames) {
+    auto lock = acquireLock();
+
+    uint64_t blocks = frames / fileBlockFrames;
+    auto remainder = static_cast<int>(frames % fileBlockFrames);
+    uint64_t blockOutput = static_cast<uint64_t>((float) fileBlockFrames / playbackSpeedFactor);
+    uint64_t remainderOutput = remainder > 0 ? static_cast<uint64_t>((float) remainder / playbackSpeedFactor) : 0;
+    return blocks * blockOutput + remainderOutput;
+}
+
+uint64_t Sampler::renderFile(const PcmFile &file, uint64_t from, uint64_t frames, float *output) {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+    KLARITY_PROFILE_SCOPE(play);
+
+    checkRenderable();
+    checkFile(file, from, frames);
+
+    uint64_t written = 0;
+    for (uint64_t offset = 0; offset < frames; offset += fileBlockFrames) {
+        auto inputSamples = static_cast<int>(std::min(fileBlockFrames, frames - offset));
+        written += renderFileBlock(file, from + offset, inputSamples, output + written * channels);
+
+        file.release(from + offset, from + offset + inputSamples);
+    }
+
+    return written;
+}
+
+uint64_t Sampler::cacheSeed() const {
+    struct {
+        SamplerPreset preset;
+        SamplerPrecision precision;
+        uint32_t sampleRate;
+        uint32_t channels;
+        float speed;
+        float pitch;
+        float tonalityLimit;
+        uint32_t pitchMap;
+        uint32_t transientReset;
+    } configuration{preset, precision, sampleRate, channels, playbackSpeedFactor, pitchFactor, pitchTonalityLimit, pitchMapId, transientReset};
+
+    return RenderCache::hash(0, &configuration, sizeof(configuration));
+}
+
+uint64_t Sampler::uniqueCacheOrigin() {
+    ++cacheEpoch;
+    return RenderCache::hash(~cacheSeed(), &cacheEpoch, sizeof(cacheEpoch));
+}
+
+void Sampler::restartCacheChain(uint64_t origin) {
+    cacheChain = origin;
+    cacheHistoryFrames = 0;
+    stretchStale = false;
+}
+
+void Sampler::appendCacheHistory(const float *const *inputs, int inputSamples) {
+    auto capacity = static_cast<uint64_t>(cacheHistory[0].size());
+    // Only the latest `capacity` frames survive
+    uint64_t skipped = static_cast<uint64_t>(inputSamples) > capacity ? inputSamples - capacity : 0;
+    for (uint32_t c = 0; c < channels; ++c) {
+        uint64_t position = cacheHistoryFrames + skipped;
+        for (uint64_t done = skipped; done < static_cast<uint64_t>(inputSamples);) {
+            uint64_t offset = position % capacity;
+            uint64_t count = std::min<uint64_t>(inputSamples - done, capacity - offset);
+            std::copy_n(inputs[c] + done, count, cacheHistory[c].data() + offset);
+            done += count;
+            position += count;
+        }
+    }
+    cacheHistoryFrames += inputSamples;
+}
+
+void Sampler::rebuildStretch() {
+    if (!stretchStale) return;
+
+    stretch->reset();
+    // The observer has already seen this input
+    stretch->setSpectrumObserver(nullptr);
+
+    // The end of the history is pre-rolled like a seek's head, what comes before it primes the stretcher's history
+    auto capacity = static_cast<uint64_t>(cacheHistory[0].size());
+    auto available = static_cast<int>(std::min(cacheHistoryFrames, capacity));
+    int headSamples = std::min(available, preRollSamples());
+    int primeSamples = std::min(available - headSamples, stretch->blockSamples() + stretch->intervalSamples());
+
+    auto historyInput = [&](int samplesCount, int back) {
+        std::vector<std::vector<float>> inputs(channels, std::vector<float>(samplesCount));
+        for (uint32_t c = 0; c < channels; ++c) {
+            for (int i = 0; i < samplesCount; ++i) {
+                inputs[c][i] = cacheHistory[c][(cacheHistoryFrames - back + i) % capacity];
+            }
+        }
+        return inputs;
+    };
+
+    if (primeSamples > 0) {
+        stretch->seek(historyInput(primeSamples, headSamples + primeSamples), primeSamples, playbackSpeedFactor);
+    }
+
+    // Near the start of a chain this replays it from the reset, either way the head's output was already played
+    std::vector<float> output;
+    if (headSamples > 0) {
+        renderHead(*stretch, historyInput(headSamples, headSamples), headSamples, output, volume);
+    }
+
+    stretch->setSpectrumObserver(spectrumObserver);
+    stretchStale = false;
+}
+
+int Sampler::preRollSamples() const {
+    // Output lags input by `inputLatency` input frames plus `outputLatency` output frames
+    return stretch->inputLatency() + static_cast<int>(std::lround(stretch->outputLatency() * playbackSpeedFactor));
+}
+
+std::vector<std::vector<float>> Sampler::deinterleaveInput(const uint8_t *samples, int inputSamples) {
+    std::vector<std::vector<float>> inputs(channels, std::vector<float>(inputSamples));
+    std::vector<float *> pointers;
+    for (auto &input: inputs) pointers.push_back(input.data());
+
+    const auto &kernels = KernelDispatch::table();
+    kernels.deinterleave(pointers.data(), reinterpret_cast<const float *>(samples), channels, inputSamples);
+    for (auto *input: pointers) {
+        nonFiniteStats.inputSamples += kernels.sanitize(input, inputSamples, !signalsmith::perf::StopDenormals::flushes);
+    }
+
+    return inputs;
+}
+
+void Sampler::renderHead(signalsmith::stretch::SignalsmithStretch<float> &target, const std::vector<std::vector<float>> &inputs,
+                         int inputSamples, std::vector<float> &output, float gain) {
+    // The output covering the pre-roll is the ramp-up from silence, so only what follows it is kept
+    int outputSamples = static_cast<int>(std::lround(inputSamples / playbackSpeedFactor));
+    int skippedSamples = std::min(outputSamples, static_cast<int>(std::lround(preRollSamples() / playbackSpeedFactor)));
+
+    std::vector<std::vector<float>> outputs(channels, std::vector<float>(outputSamples));
+    {
+        signalsmith::perf::StopDenormals stopDenormals;
+        target.process(inputs, inputSamples, outputs, outputSamples);
+    }
+
+    int keptSamples = outputSamples - skippedSamples;
+    output.resize(static_cast<size_t>(keptSamples) * channels);
+    std::vector<const float *> kept;
+    for (auto &channel: outputs) kept.push_back(channel.data() + skippedSamples);
+    KernelDispatch::table().interleave(output.data(), kept.data(), channels, keptSamples, gain);
+}
+
+std::unique_ptr<TimelineEvent> Sampler::renderEvent(const uint8_t *samples, uint64_t size) {
+    int inputSamples = static_cast<int>(size / sizeof(float) / channels);
+
+    if (!eventStretch) {
+        eventStretch = createStretch(eventArena);
+    } else {
+        eventStretch->reset();
+    }
+
+    // As `finishTrack` drains a track: silence pushes the last `inputLatency` frames through, `flush` the overlap
+    int tailInputSamples = eventStretch->inputLatency();
+    int bodyOutputSamples = static_cast<int>(std::lround((inputSamples + tailInputSamples) / playbackSpeedFactor));
+    int flushSamples = eventStretch->outputLatency();
+    int outputSamples = bodyOutputSamples + flushSamples;
+
+    auto inputs = deinterleaveInput(samples, inputSamples);
+    for (auto &input: inputs) input.resize(inputSamples + tailInputSamples, 0.0f);
+
+    std::vector<std::vector<float>> outputs(channels, std::vector<float>(outputSamples));
+    std::vector<float *> flushPointers;
+    for (auto &output: outputs) flushPointers.push_back(output.data() + bodyOutputSamples);
+    {
+        signalsmith::perf::StopDenormals stopDenormals;
+        eventStretch->process(inputs, inputSamples + tailInputSamples, outputs, bodyOutputSamples);
+        eventStretch->flush(flushPointers, flushSamples);
+    }
+
+    // The output lags the input by the pre-roll, what comes before the event's first frame is the ramp-up
+    int skippedSamples = std::min(outputSamples, static_cast<int>(std::lround(preRollSamples() / playbackSpeedFactor)));
+    int keptSamples = outputSamples - skippedSamples;
+
+    auto event = std::make_unique<TimelineEvent>();
+    event->samples.resize(static_cast<size_t>(keptSamples) * channels);
+    std::vector<const float *> kept;
+    for (auto &output: outputs) kept.push_back(output.data() + skippedSamples);
+    const auto &kernels = KernelDispatch::table();
+    kernels.interleave(event->samples.data(), kept.data(), channels, keptSamples, volume);
+    nonFiniteStats.outputSamples += kernels.sanitize(event->samples.data(), event->samples.size(), !signalsmith::perf::StopDenormals::flushes);
+
+    return event;
+}
+
+void Sampler::scheduleEvent(std::unique_ptr<TimelineEvent> event) {
+    if (!sink->schedule(std::move(event))) {
+        throw SamplerException("Unable to schedule more than " + std::to_string(DeviceQueue::maxScheduledEvents) + " pending events");
+    }
+}
+
+uint64_t Sampler::getStreamFrame() {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to get stream frame of uninitialized sampler");
+    }
+
+    return sink->position();
+}
+
+void Sampler::scheduleAtFrame(const uint8_t *samples, uint64_t size, uint64_t frame) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to schedule on uninitialized sampler");
+    }
+
+    if (size < sizeof(float) * channels) {
+        throw SamplerException("Unable to schedule empty samples");
+    }
+
+    auto event = renderEvent(samples, size);
+    event->frame = frame;
+    scheduleEvent(std::move(event));
+}
+
+void Sampler::scheduleAtTime(const uint8_t *samples, uint64_t size, double time) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to schedule on uninitialized sampler");
+    }
+
+    if (size < sizeof(float) * channels) {
+        throw SamplerException("Unable to schedule empty samples");
+    }
+
+    auto event = renderEvent(samples, size);
+    event->time = time;
+    event->timed = true;
+    scheduleEvent(std::move(event));
+}
+
+uint64_t Sampler::getPreRollFrames() {
+    auto lock = acquireLock();
+
+    if (!stretch) {
+        throw SamplerException("Unable to get pre-roll of uninitialized sampler");
+    }
+
+    return static_cast<uint64_t>(preRollSamples());
+}
+
+uint64_t Sampler::getSeekHistoryFrames() {
+    auto lock = acquireLock();
+
+    if (!stretch) {
+        throw SamplerException("Unable to get seek history of uninitialized sampler");
+    }
+
+    return static_cast<uint64_t>(stretch->blockSamples() + stretch->intervalSamples());
+}
+
+void Sampler::queueNext(const uint8_t *samples, uint64_t size) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to queue next track on uninitialized sampler");
+    }
+
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to queue next track before the previous asynchronous play completes");
+    }
+
+    int inputSamples = static_cast<int>(size / sizeof(float) / channels);
+
+    if (inputSamples < preRollSamples()) {
+        throw SamplerException("Unable to queue next track with less than " + std::to_string(preRollSamples()) + " frames of pre-roll");
+    }
+
+    if (!nextStretch) {
+        nextStretch = createStretch(nextArena);
+    } else {
+        nextStretch->reset();
+    }
+
+    auto inputs = deinterleaveInput(samples, inputSamples);
+    renderHead(*nextStretch, inputs, inputSamples, nextOutput, 1.0f);
+
+    if (cache.enabled()) {
+        nextCacheOrigin = RenderCache::hash(cacheSeed(), samples, size);
+        nextHead = std::move(inputs);
+    }
+
+    nextQueued = true;
+}
+
+void Sampler::seek(const uint8_t *history, uint64_t historySize, const uint8_t *samples, uint64_t size) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to seek uninitialized sampler");
+    }
+
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to seek before the previous asynchronous play completes");
+    }
+
+    if (!loopBuffers.empty()) {
+        throw SamplerException("Unable to seek while looping");
+    }
 
-    std::vector<std::vector<float>> outputBuffers(channels, std::vector<float>(outputSamples));
+    int inputSamples = static_cast<int>(size / sizeof(float) / channels);
 
-    for (int i = 0; i < inputSamples * channels; ++i) {
-        inputBuffers[i % channels][i / channels] = reinterpret_cast<const float *>(samples)[i];
+    if (inputSamples < preRollSamples()) {
+        throw SamplerException("Unable to seek with less than " + std::to_string(preRollSamples()) + " frames of pre-roll");
     }
 
-    stretch->process(inputBuffers, inputSamples, outputBuffers, outputSamples);
+    stretch->reset();
+
+    int historySamples = static_cast<int>(historySize / sizeof(float) / channels);
+    std::vector<std::vector<float>> historyInputs;
+    if (historySamples > 0) {
+        historyInputs = deinterleaveInput(history, historySamples);
+        stretch->seek(historyInputs, historySamples, playbackSpeedFactor);
+    }
 
+    auto inputs = deinterleaveInput(samples, inputSamples);
     std::vector<float> output;
-    output.reserve(outputSamples * channels);
-    for (int i = 0; i < outputSamples; ++i) {
-        for (int ch = 0; ch < channels; ++ch) {
-            output.push_back(outputBuffers[ch][i] * volume);
+    renderHead(*stretch, inputs, inputSamples, output, volume);
+
+    if (cache.enabled()) {
+        // Seeking back to the same target with the same history starts the same chain again
+        uint64_t origin = historySamples > 0 ? RenderCache::hash(cacheSeed(), history, historySize) : cacheSeed();
+        restartCacheChain(RenderCache::hash(origin, samples, size));
+        std::vector<const float *> pointers;
+        if (historySamples > 0) {
+            for (auto &input: historyInputs) pointers.push_back(input.data());
+            appendCacheHistory(pointers.data(), historySamples);
+            pointers.clear();
+        }
+        for (auto &input: inputs) pointers.push_back(input.data());
+        appendCacheHistory(pointers.data(), inputSamples);
+    }
+
+    // Dropped only now, so the device doesn't run dry while the pre-roll is processed
+    sink->discard();
+
+    {
+        KLARITY_PROFILE_SCOPE(deviceWrite);
+        sink->write(output.data(), output.size() / channels);
+    }
+}
+
+void Sampler::finishTrack() {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to finish track on uninitialized sampler");
+    }
+
+    if (paused) {
+        throw SamplerException("Unable to finish track on paused sampler");
+    }
+
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to finish track before the previous asynchronous play completes");
+    }
+
+    // Silence pushes the last `inputLatency` frames through, then `flush` drains the remaining overlap
+    int tailInputSamples = stretch->inputLatency();
+    int tailOutputSamples = static_cast<int>(std::lround(tailInputSamples / playbackSpeedFactor));
+    int flushSamples = stretch->outputLatency();
+    int outputSamples = tailOutputSamples + flushSamples;
+
+    ensureBuffers(tailInputSamples, outputSamples);
+
+    rebuildStretch();
+
+    std::vector<float *> flushPointers;
+    for (auto &buffer: outputBuffers) flushPointers.push_back(buffer.data() + tailOutputSamples);
+
+    const auto &kernels = KernelDispatch::table();
+
+    {
+        KLARITY_REALTIME_SECTION();
+
+        signalsmith::perf::StopDenormals stopDenormals;
+
+        for (auto *input: inputPointers) std::fill(input, input + tailInputSamples, 0.0f);
+
+        stretch->process(inputBuffers, tailInputSamples, outputBuffers, tailOutputSamples);
+        stretch->flush(flushPointers, flushSamples);
+
+        KLARITY_PROFILE_SCOPE(interleave);
+        kernels.interleave(outputBuffer.data(), outputPointers.data(), channels, outputSamples, volume);
+        nonFiniteStats.outputSamples += kernels.sanitize(outputBuffer.data(), static_cast<size_t>(outputSamples) * channels, !signalsmith::perf::StopDenormals::flushes);
+    }
+
+    {
+        KLARITY_PROFILE_SCOPE(deviceWrite);
+        sink->write(outputBuffer.data(), outputSamples);
+    }
+
+    if (!nextQueued) {
+        stretch->reset();
+        if (cache.enabled()) {
+            restartCacheChain(cacheSeed());
         }
+        return;
     }
 
-    Pa_WriteStream(stream.get(), output.data(), outputSamples);
+    std::swap(arena, nextArena);
+    std::swap(stretch, nextStretch);
+    nextQueued = false;
+    nextStretch->setSpectrumObserver(nullptr);
+    stretch->setSpectrumObserver(spectrumObserver);
+
+    if (cache.enabled()) {
+        restartCacheChain(nextHead.empty() ? uniqueCacheOrigin() : nextCacheOrigin);
+        if (!nextHead.empty()) {
+            std::vector<const float *> pointers;
+            for (auto &input: nextHead) pointers.push_back(input.data());
+            appendCacheHistory(pointers.data(), static_cast<int>(nextHead[0].size()));
+        }
+        nextHead.clear();
+    }
+
+    for (auto &sample: nextOutput) sample *= volume;
+
+    {
+        KLARITY_PROFILE_SCOPE(deviceWrite);
+        sink->write(nextOutput.data(), nextOutput.size() / channels);
+    }
 }
 
 void Sampler::stop() {
-    std::unique_lock<std::mutex> lock(mutex);
+    auto lock = acquireLock();
 
-    if (!stretch || stream == nullptr) {
+    if (!stretch || sink == nullptr) {
         throw SamplerException("Unable to stop uninitialized sampler");
     }
 
-    if (Pa_IsStreamActive(stream.get()) == 1) {
-        PaError err = Pa_StopStream(stream.get());
-        if (err != paNoError) {
-            throw SamplerException("Failed to stop PortAudio stream: " + std::string(Pa_GetErrorText(err)));
+    if (sink->isActive()) {
+        sink->stop();
+    }
+
+    paused = false;
+    pendingFrames = 0;
+}
+
+void Sampler::reset() {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr) {
+        throw SamplerException("Unable to reset uninitialized sampler");
+    }
+
+    if (sink->isActive()) {
+        throw SamplerException("Unable to reset active sampler");
+    }
+
+    stretch->reset();
+    stretchStale = false;
+
+    nextQueued = false;
+    nextOutput.clear();
+    nextHead.clear();
+
+    paused = false;
+    loopBuffers.clear();
+    loopPosition = 0;
+    loopOutputRemainder = 0;
+    pendingOffset = 0;
+    pendingFrames = 0;
+
+    playbackSpeedFactor = 1.0f;
+    pitchFactor = 1.0f;
+    pitchTonalityLimit = 0.0f;
+    pitchMap = nullptr;
+    pitchMapId = 0;
+    transientReset = false;
+    for (auto *target: {&stretch, &nextStretch, &eventStretch}) {
+        if (*target) {
+            applyPitch(**target);
+            (*target)->setTransientReset(false);
         }
     }
+    volume = 1.0f;
+    spectrumObserver = nullptr;
+    stretch->setSpectrumObserver(nullptr);
+
+    cache.clear();
+    cache.setLimit(0);
+    cache.resetStats();
+    cacheHistory.clear();
+    cacheHistory.shrink_to_fit();
+    cacheHistoryFrames = 0;
+
+    profileStats = ProfileStats();
+    nonFiniteStats = NonFiniteStats();
+}
+
+void Sampler::pause() {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to pause uninitialized sampler");
+    }
+
+    if (!paused) {
+        sink->pause();
+        paused = true;
+    }
+}
+
+void Sampler::resume() {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to resume uninitialized sampler");
+    }
+
+    if (paused) {
+        sink->resume();
+        paused = false;
+    }
+}
+
+bool Sampler::isPaused() {
+    auto lock = acquireLock();
+
+    return paused;
+}
+
+void Sampler::startLoop(const uint8_t *samples, uint64_t size, uint64_t crossfadeFrames) {
+    auto lock = acquireLock();
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to loop uninitialized sampler");
+    }
+
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to loop before the previous asynchronous play completes");
+    }
+
+    if (paused) {
+        throw SamplerException("Unable to loop paused sampler");
+    }
+
+    if (!loopBuffers.empty()) {
+        throw SamplerException("Unable to loop while already looping");
+    }
+
+    if (nextQueued) {
+        throw SamplerException("Unable to loop with a queued next track");
+    }
+
+    uint64_t segmentFrames = size / sizeof(float) / channels;
+
+    if (segmentFrames > static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+        throw SamplerException("Unable to loop a segment of " + std::to_string(segmentFrames) + " frames");
+    }
+
+    // Compared before narrowing, so a huge crossfade can't wrap into a negative one
+    if (crossfadeFrames >= (segmentFrames + 1) / 2) {
+        throw SamplerException("Unable to loop a segment shorter than twice its crossfade");
+    }
+
+    auto segmentSamples = static_cast<int>(segmentFrames);
+    auto crossfadeSamples = static_cast<int>(crossfadeFrames);
+
+    // The end of the segment fades out over its start, so the period starts with the crossfade
+    int periodSamples = segmentSamples - crossfadeSamples;
+    auto segment = deinterleaveInput(samples, segmentSamples);
+    loopBuffers.assign(channels, std::vector<float>(periodSamples));
+    for (uint32_t c = 0; c < channels; ++c) {
+        std::copy(segment[c].begin(), segment[c].begin() + periodSamples, loopBuffers[c].begin());
+        for (int i = 0; i < crossfadeSamples; ++i) {
+            // Equal-power, as the two ends are generally uncorrelated
+            double phase = (i + 0.5) / crossfadeSamples * M_PI / 2;
+            loopBuffers[c][i] = static_cast<float>(segment[c][i] * std::sin(phase) + segment[c][periodSamples + i] * std::cos(phase));
+        }
+    }
+
+    auto loopInput = [&](int samplesCount, int64_t offset) {
+        std::vector<std::vector<float>> inputs(channels, std::vector<float>(samplesCount));
+        for (uint32_t c = 0; c < channels; ++c) {
+            for (int i = 0; i < samplesCount; ++i) {
+                inputs[c][i] = loopBuffers[c][((offset + i) % periodSamples + periodSamples) % periodSamples];
+            }
+        }
+        return inputs;
+    };
+
+    stretch->reset();
+    if (cache.enabled()) {
+        // The loop isn't cached, and `play` after `stopLoop` continues from wherever the loop left the stretcher
+        restartCacheChain(uniqueCacheOrigin());
+    }
+
+    int historySamples = stretch->blockSamples() + stretch->intervalSamples();
+    stretch->seek(loopInput(historySamples, -historySamples), historySamples, playbackSpeedFactor);
+
+    int headSamples = preRollSamples();
+    std::vector<float> output;
+    renderHead(*stretch, loopInput(headSamples, 0), headSamples, output, volume);
+
+    double headOutput = headSamples / playbackSpeedFactor;
+    loopPosition = static_cast<uint64_t>(headSamples % periodSamples);
+    loopOutputRemainder = headOutput - std::lround(headOutput);
+
+    sink->discard();
+
+    {
+        KLARITY_PROFILE_SCOPE(deviceWrite);
+        sink->write(output.data(), output.size() / channels);
+    }
+}
+
+void Sampler::playLoop(uint64_t frames) {
+    auto lock = acquireLock();
+
+    KLARITY_PROFILE_BIND(profileStats);
+    KLARITY_PROFILE_SCOPE(play);
+
+    if (!stretch || sink == nullptr || !sink->isActive()) {
+        throw SamplerException("Unable to play loop on uninitialized sampler");
+    }
+
+    if (paused) {
+        throw SamplerException("Unable to play paused sampler");
+    }
+
+    if (loopBuffers.empty()) {
+        throw SamplerException("Unable to play loop without a loop region");
+    }
+
+    if (pendingFrames > 0) {
+        throw SamplerException("Unable to play loop before the previous asynchronous play completes");
+    }
+
+    auto inputSamples = static_cast<int>(frames);
+    double exactOutput = inputSamples / playbackSpeedFactor + loopOutputRemainder;
+    auto outputSamples = static_cast<int>(std::floor(exactOutput));
+    loopOutputRemainder = exactOutput - outputSamples;
+
+    ensureBuffers(inputSamples, outputSamples);
+
+    {
+        KLARITY_REALTIME_SECTION();
+
+        signalsmith::perf::StopDenormals stopDenormals;
+
+        {
+            KLARITY_PROFILE_SCOPE(deinterleave);
+            uint64_t periodSamples = loopBuffers[0].size();
+            for (uint32_t c = 0; c < channels; ++c) {
+                uint64_t position = loopPosition;
+                for (int done = 0; done < inputSamples;) {
+                    auto count = static_cast<int>(std::min<uint64_t>(inputSamples - done, periodSamples - position));
+                    std::copy_n(loopBuffers[c].data() + position, count, inputPointers[c] + done);
+                    done += count;
+                    position = (position + count) % periodSamples;
+                }
+            }
+            loopPosition = (loopPosition + inputSamples) % periodSamples;
+        }
+
+        processBuffers(inputBuffers, inputSamples, outputBuffer.data(), outputSamples, 0);
+    }
+
+    {
+        KLARITY_PROFILE_SCOPE(deviceWrite);
+        sink->write(outputBuffer.data(), outputSamples);
+    }
+}
+
+void Sampler::stopLoop() {
+    auto lock = acquireLock();
+
+    loopBuffers.clear();
+}
+
+bool Sampler::isLooping() {
+    auto lock = acquireLock();
+
+    return !loopBuffers.empty();
+}
+
+void Sampler::setCacheLimit(size_t bytes) {
+    auto lock = acquireLock();
+
+    if (!stretch) {
+        throw SamplerException("Unable to set cache limit of uninitialized sampler");
+    }
+
+    bool wasEnabled = cache.enabled();
+    if (bytes == 0 && wasEnabled) {
+        rebuildStretch();
+        cache.clear();
+        cacheHistory.clear();
+        cacheHistory.shrink_to_fit();
+        nextHead.clear();
+    }
+
+    cache.setLimit(bytes);
+
+    if (bytes > 0 && !wasEnabled) {
+        // Enough for a seek's history plus the pre-roll at up to 4x, faster speeds rebuild with a shorter history
+        int historySamples = stretch->blockSamples() + stretch->intervalSamples() + stretch->inputLatency() + 4 * stretch->outputLatency();
+        cacheHistory.assign(channels, std::vector<float>(historySamples));
+        // The stretcher state so far is unknown to the cache
+        restartCacheChain(uniqueCacheOrigin());
+    }
+}
+
+RenderCacheStats Sampler::getCacheStats() {
+    auto lock = acquireLock();
+
+    return cache.stats();
+}
+
+void Sampler::resetCacheStats() {
+    auto lock = acquireLock();
+
+    cache.resetStats();
+}
+
+void Sampler::clearCache() {
+    auto lock = acquireLock();
+
+    cache.clear();
+}
+
+ProfileStats Sampler::getProfileStats() {
+    auto lock = acquireLock();
+
+    return profileStats;
+}
+
+void Sampler::resetProfileStats() {
+    auto lock = acquireLock();
+
+    profileStats = ProfileStats();
+}
+
+NonFiniteStats Sampler::getNonFiniteStats() {
+    auto lock = acquireLock();
+
+    return nonFiniteStats;
+}
+
+void Sampler::resetNonFiniteStats() {
+    auto lock = acquireLock();
+
+    nonFiniteStats = NonFiniteStats();
+}
+
+SamplerMemoryUsage Sampler::getMemoryUsage() {
+    auto lock = acquireLock();
+
+    SamplerMemoryUsage usage;
+    usage.sampler = sizeof(Sampler);
+    if (stretch) {
+        usage.stretch = stretch->memoryUsage();
+    }
+
+    usage.playbackBuffers = (inputBuffers.capacity() + outputBuffers.capacity()) * sizeof(std::vector<float>)
+                            + outputBuffer.capacity() * sizeof(float)
+                            + inputPointers.capacity() * sizeof(float *)
+                            + chunkPointers.capacity() * sizeof(float *)
+                            + outputPointers.capacity() * sizeof(const float *);
+    for (const auto &buffer: inputBuffers) usage.playbackBuffers += buffer.capacity() * sizeof(float);
+    for (const auto &buffer: outputBuffers) usage.playbackBuffers += buffer.capacity() * sizeof(float);
+
+    usage.cache = cache.memoryUsage();
+    for (const auto &buffer: cacheHistory) usage.cache += buffer.capacity() * sizeof(float);
+    for (const auto &buffer: nextHead) usage.cache += buffer.capacity() * sizeof(float);
+
+    if (arena) {
+        usage.arenaOverhead = arena->capacity() - std::min(arena->capacity(), usage.stretch.total());
+    }
+
+    return usage;
+}
+
+const StretchArena *Sampler::getArena() const {
+    return arena.get();
+}
+
+void Sampler::dumpTrace(const std::string &path) {
+    Tracer::dumpChromeTrace(path);
+}
+
+void Sampler::clearTrace() {
+    Tracer::clear();
 }
\ No newline at end of file
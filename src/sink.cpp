@@ -0,0 +1,318 @@
+#include "sink.h"
+#include <algorithm>
+#include <string>
+#include "exception.h"
+#include "rtaudit.h"
+
+DeviceQueue::DeviceQueue(uint32_t channels, uint32_t sampleRate, uint64_t capacityFrames, uint64_t fadeFrames) :
+        channels(channels),
+        fadeFrames(std::max<uint64_t>(1, fadeFrames)),
+        ring(channels, capacityFrames),
+        timeline(channels, sampleRate, maxScheduledEvents),
+        fadeLevel(this->fadeFrames) {}
+
+uint64_t DeviceQueue::capacity() const {
+    return ring.capacity();
+}
+
+uint64_t DeviceQueue::size() const {
+    return ring.size();
+}
+
+uint64_t DeviceQueue::write(const float *samples, uint64_t frames) {
+    return ring.write(samples, frames);
+}
+
+void DeviceQueue::discard() {
+    ring.discard();
+}
+
+void DeviceQueue::pause() {
+    paused.store(true, std::memory_order_release);
+}
+
+void DeviceQueue::resume() {
+    paused.store(false, std::memory_order_release);
+}
+
+bool DeviceQueue::isPaused() const {
+    return paused.load(std::memory_order_acquire);
+}
+
+void DeviceQueue::notifyWhenFree(uint64_t frames, AsyncWaiter &next, SamplerExecutor &executor) {
+    waiterExecutor = &executor;
+    waiterFrames = std::min(frames, ring.capacity());
+    waiter.store(&next, std::memory_order_release);
+
+    // The device may have made room before it saw the waiter, in which case whoever takes the waiter back posts it
+    if (ring.capacity() - ring.size() >= waiterFrames) {
+        AsyncWaiter *expected = &next;
+        if (waiter.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)) {
+            executor.post(next);
+        }
+    }
+}
+
+void DeviceQueue::releaseWaiter() {
+    if (AsyncWaiter *pending = waiter.exchange(nullptr, std::memory_order_acq_rel)) {
+        waiterExecutor->post(*pending);
+    }
+}
+
+uint32_t DeviceQueue::freedCount() const {
+    return freed.load(std::memory_order_seq_cst);
+}
+
+void DeviceQueue::waitForRoom(uint32_t seen) {
+    // Sequentially consistent with `render`, so either it sees the flag or the wait sees its bump
+    writerWaiting.store(true, std::memory_order_seq_cst);
+    freed.wait(seen, std::memory_order_seq_cst);
+    writerWaiting.store(false, std::memory_order_relaxed);
+}
+
+void DeviceQueue::wakeWriter() {
+    freed.fetch_add(1, std::memory_order_seq_cst);
+    freed.notify_one();
+}
+
+uint64_t DeviceQueue::position() const {
+    return renderedFrames.load(std::memory_order_acquire);
+}
+
+bool DeviceQueue::schedule(std::unique_ptr<TimelineEvent> event) {
+    timeline.collect();
+    return timeline.schedule(std::move(event));
+}
+
+void DeviceQueue::resetTimeline() {
+    timeline.clear();
+    renderedFrames.store(0, std::memory_order_release);
+}
+
+uint64_t DeviceQueue::lateEvents() const {
+    return timeline.late();
+}
+
+uint64_t DeviceQueue::render(float *output, uint64_t frames, double outputTime) {
+    bool hold = paused.load(std::memory_order_acquire);
+
+    // While paused only the frames the fade-out still needs are taken, the rest stays queued for `resume`
+    uint64_t wanted = hold ? std::min(frames, fadeLevel) : frames;
+
+    uint64_t read = 0;
+    if (wanted > 0) {
+        read = ring.read(output, wanted);
+    } else {
+        ring.skipDiscarded();
+    }
+
+    for (uint64_t i = 0; i < read && (hold || fadeLevel < fadeFrames); ++i) {
+        if (!hold) ++fadeLevel;
+        float gain = static_cast<float>(fadeLevel) / static_cast<float>(fadeFrames);
+        if (hold) --fadeLevel;
+        for (uint32_t c = 0; c < channels; ++c) {
+            output[i * channels + c] *= gain;
+        }
+    }
+
+    // Underrun or hold, play silence
+    std::fill(output + read * channels, output + frames * channels, 0.0f);
+
+    uint64_t position = renderedFrames.load(std::memory_order_relaxed);
+    timeline.mix(output, frames, position, outputTime);
+    renderedFrames.store(position + frames, std::memory_order_release);
+
+    // The futex wake is only paid while a producer is actually blocked
+    if (read > 0) {
+        freed.fetch_add(1, std::memory_order_seq_cst);
+        if (writerWaiting.load(std::memory_order_seq_cst)) freed.notify_one();
+    }
+
+    AsyncWaiter *pending = waiter.load(std::memory_order_acquire);
+    if (pending && ring.capacity() - ring.size() >= waiterFrames && waiter.compare_exchange_strong(pending, nullptr, std::memory_order_acq_rel)) {
+        waiterExecutor->post(*pending);
+    }
+
+    return read;
+}
+
+int PortAudioSink::callback(const void *, void *output, unsigned long frames, const PaStreamCallbackTimeInfo *timeInfo,
+                            PaStreamCallbackFlags, void *userData) {
+    KLARITY_REALTIME_SECTION();
+
+    static_cast<PortAudioSink *>(userData)->queue->render(static_cast<float *>(output), frames, timeInfo->outputBufferDacTime);
+
+    return paContinue;
+}
+
+void PortAudioSink::finished(void *userData) {
+    // Nothing frees room anymore, so whoever waits for it is woken to find the stream inactive
+    auto *sink = static_cast<PortAudioSink *>(userData);
+    sink->queue->wakeWriter();
+    sink->queue->releaseWaiter();
+}
+
+PortAudioSink::PortAudioSink(uint32_t sampleRate, uint32_t channels) : sampleRate(sampleRate), channels(channels) {
+    PaDeviceIndex deviceIndex = Pa_GetDefaultOutputDevice();
+    if (deviceIndex == paNoDevice) {
+        throw SamplerException("Error: No default output device");
+    }
+
+    PaStreamParameters outputParameters;
+    outputParameters.device = deviceIndex;
+    outputParameters.channelCount = static_cast<int>(channels);
+    outputParameters.sampleFormat = paFloat32;
+    // The queue holds the high-latency share of the buffering, where `discard` and `pause` can still reach it
+    const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(outputParameters.device);
+    outputParameters.suggestedLatency = deviceInfo->defaultLowOutputLatency;
+    queue = std::make_unique<DeviceQueue>(channels, sampleRate, std::max<uint64_t>(1024, static_cast<uint64_t>(deviceInfo->defaultHighOutputLatency * sampleRate)), sampleRate / 200);
+    outputParameters.hostApiSpecificStreamInfo = nullptr;
+
+    PaStream *rawStream = nullptr;
+    PaError err = Pa_OpenStream(
+            &rawStream,
+            nullptr,
+            &outputParameters,
+            sampleRate,
+            paFramesPerBufferUnspecified,
+            paClipOff,
+            &PortAudioSink::callback,
+            this
+    );
+    if (err != paNoError) {
+        throw SamplerException("PortAudio error: " + std::string(Pa_GetErrorText(err)));
+    }
+
+    stream.reset(rawStream);
+
+    err = Pa_SetStreamFinishedCallback(rawStream, &PortAudioSink::finished);
+    if (err != paNoError) {
+        throw SamplerException("PortAudio error: " + std::string(Pa_GetErrorText(err)));
+    }
+}
+
+void PortAudioSink::start() {
+    // The callback isn't running, and the timeline counts from the start of the stream
+    queue->resetTimeline();
+
+    PaError err = Pa_StartStream(stream.get());
+    if (err != paNoError) {
+        throw SamplerException("Failed to start PortAudio stream: " + std::string(Pa_GetErrorText(err)));
+    }
+}
+
+void PortAudioSink::stop() {
+    // A paused queue would never play out, so stopping drops it
+    if (queue->isPaused()) {
+        queue->discard();
+        queue->resume();
+    }
+
+    // Let the queued frames play out, as a blocking stream would
+    for (uint32_t seen = queue->freedCount(); queue->size() > 0 && isActive(); seen = queue->freedCount()) {
+        queue->waitForRoom(seen);
+    }
+
+    PaError err = Pa_StopStream(stream.get());
+
+    // Nothing frees room anymore, so a waiting producer is woken to find the stream stopped
+    queue->releaseWaiter();
+
+    if (err != paNoError) {
+        throw SamplerException("Failed to stop PortAudio stream: " + std::string(Pa_GetErrorText(err)));
+    }
+}
+
+bool PortAudioSink::isActive() {
+    return Pa_IsStreamActive(stream.get()) == 1;
+}
+
+void PortAudioSink::write(const float *samples, uint64_t frames) {
+    while (frames > 0) {
+        uint32_t seen = queue->freedCount();
+        uint64_t written = queue->write(samples, frames);
+        samples += written * channels;
+        frames -= written;
+
+        if (frames > 0) {
+            // Callers count every frame as played once this returns, so a stream that stopped under them is an error
+            if (!isActive()) {
+                throw SamplerException("PortAudio stream stopped with " + std::to_string(frames) + " frames left to write");
+            }
+            queue->waitForRoom(seen);
+        }
+    }
+}
+
+uint64_t PortAudioSink::tryWrite(const float *samples, uint64_t frames) {
+    return queue->write(samples, frames);
+}
+
+void PortAudioSink::notifyWhenFree(uint64_t frames, AsyncWaiter &waiter, SamplerExecutor &executor) {
+    queue->notifyWhenFree(frames, waiter, executor);
+}
+
+void PortAudioSink::discard() {
+    queue->discard();
+}
+
+void PortAudioSink::pause() {
+    queue->pause();
+}
+
+void PortAudioSink::resume() {
+    queue->resume();
+}
+
+double PortAudioSink::latency() {
+    return Pa_GetStreamInfo(stream.get())->outputLatency + static_cast<double>(queue->capacity()) / sampleRate;
+}
+
+uint64_t PortAudioSink::position() {
+    return queue->position();
+}
+
+bool PortAudioSink::schedule(std::unique_ptr<TimelineEvent> event) {
+    return queue->schedule(std::move(event));
+}
+
+void NullSink::start() {
+    active = true;
+}
+
+void NullSink::stop() {
+    active = false;
+}
+
+bool NullSink::isActive() {
+    return active;
+}
+
+void NullSink::write(const float *, uint64_t count) {
+    frames += count;
+}
+
+void NullSink::discard() {
+}
+
+void NullSink::pause() {
+}
+
+void NullSink::resume() {
+}
+
+double NullSink::latency() {
+    return 0.0;
+}
+
+uint64_t NullSink::position() {
+    return frames;
+}
+
+bool NullSink::schedule(std::unique_ptr<TimelineEvent>) {
+    return true;
+}
+
+uint64_t NullSink::framesWritten() const {
+    return frames;
+}
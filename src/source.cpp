@@ -0,0 +1,193 @@
+#include "source.h"
+#include <algorithm>
+#include <cstring>
+#include "exception.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    uint32_t readU32(const uint8_t *bytes) {
+        return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+               static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+
+    uint16_t readU16(const uint8_t *bytes) {
+        return static_cast<uint16_t>(bytes[0] | bytes[1] << 8);
+    }
+
+    constexpr uint16_t formatFloat = 3;
+    constexpr uint16_t formatExtensible = 0xfffe;
+}
+
+PcmFile::PcmFile(const std::string &path, uint32_t channels) {
+    map(path);
+
+    auto *bytes = static_cast<const uint8_t *>(mapping);
+    if (mappedBytes >= 12 && std::memcmp(bytes, "RIFF", 4) == 0 && std::memcmp(bytes + 8, "WAVE", 4) == 0) {
+        parseWav();
+        return;
+    }
+
+    if (channels == 0) {
+        unmap();
+        throw SamplerException("Unable to open raw PCM file without a channel count");
+    }
+
+    channelCount = channels;
+    samples = static_cast<const float *>(mapping);
+    frameCount = mappedBytes / (sizeof(float) * channels);
+}
+
+PcmFile::~PcmFile() {
+    unmap();
+}
+
+void PcmFile::unmap() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    if (mapping) munmap(mapping, mappedBytes);
+#endif
+    mapping = nullptr;
+}
+
+void PcmFile::map(const std::string &path) {
+#ifdef _WIN32
+    // Sequential scan makes the cache manager read ahead aggressively and drop pages behind
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw SamplerException("Unable to open PCM file " + path);
+    }
+    fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        unmap();
+        throw SamplerException("Unable to map empty PCM file " + path);
+    }
+    mappedBytes = static_cast<size_t>(size.QuadPart);
+
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    mapping = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!mapping) {
+        unmap();
+        throw SamplerException("Unable to map PCM file " + path);
+    }
+#else
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        throw SamplerException("Unable to open PCM file " + path);
+    }
+
+    struct stat status{};
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close(descriptor);
+        throw SamplerException("Unable to map empty PCM file " + path);
+    }
+    mappedBytes = static_cast<size_t>(status.st_size);
+
+    // The mapping keeps the file referenced, the descriptor isn't needed anymore
+    void *address = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (address == MAP_FAILED) {
+        throw SamplerException("Unable to map PCM file " + path);
+    }
+    mapping = address;
+
+    // Larger read-ahead, and pages behind the reader are reclaimed first
+    posix_madvise(mapping, mappedBytes, POSIX_MADV_SEQUENTIAL);
+#endif
+}
+
+void PcmFile::parseWav() {
+    auto *bytes = static_cast<const uint8_t *>(mapping);
+
+    size_t offset = 12;
+    uint16_t format = 0, bitsPerSample = 0;
+    bool haveFormat = false;
+    while (offset + 8 <= mappedBytes) {
+        const uint8_t *chunk = bytes + offset;
+        uint64_t chunkSize = readU32(chunk + 4);
+        size_t body = offset + 8;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && body + 16 <= mappedBytes) {
+            format = readU16(bytes + body);
+            channelCount = readU16(bytes + body + 2);
+            rate = readU32(bytes + body + 4);
+            bitsPerSample = readU16(bytes + body + 14);
+            // The first two bytes of the extensible sub-format GUID are the format code
+            if (format == formatExtensible && chunkSize >= 40 && body + 26 <= mappedBytes) {
+                format = readU16(bytes + body + 24);
+            }
+            haveFormat = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat || format != formatFloat || bitsPerSample != 32 || channelCount == 0) {
+                unmap();
+                throw SamplerException("Unable to open WAV file that isn't 32-bit float PCM");
+            }
+            if (body % alignof(float) != 0) {
+                unmap();
+                throw SamplerException("Unable to map WAV file with unaligned samples");
+            }
+            // Streaming writers leave the size unset, the samples then run to the end of the file
+            uint64_t dataBytes = std::min<uint64_t>(chunkSize, mappedBytes - body);
+            samples = reinterpret_cast<const float *>(bytes + body);
+            frameCount = dataBytes / (sizeof(float) * channelCount);
+            return;
+        }
+
+        // Chunks are padded to an even size
+        offset = body + chunkSize + (chunkSize & 1);
+    }
+
+    unmap();
+    throw SamplerException("Unable to open WAV file without samples");
+}
+
+const float *PcmFile::data() const {
+    return samples;
+}
+
+uint64_t PcmFile::frames() const {
+    return frameCount;
+}
+
+uint32_t PcmFile::channels() const {
+    return channelCount;
+}
+
+uint32_t PcmFile::sampleRate() const {
+    return rate;
+}
+
+StridedFrames PcmFile::view(uint64_t frame) const {
+    return {samples + frame * channelCount, channelCount};
+}
+
+void PcmFile::release(uint64_t from, uint64_t to) const {
+#ifndef _WIN32
+    static const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+    // The page holding `to` is kept for the frames that follow, the one holding `from` was played before it
+    auto begin = reinterpret_cast<uintptr_t>(samples + from * channelCount) / pageSize * pageSize;
+    auto end = reinterpret_cast<uintptr_t>(samples + std::min(to, frameCount) * channelCount) / pageSize * pageSize;
+    if (end > begin) {
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+    }
+#else
+    // Windows trims unused pages of a read-only view from the working set on its own
+    (void) from;
+    (void) to;
+#endif
+}
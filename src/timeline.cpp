@@ -0,0 +1,94 @@
+#include "timeline.h"
+#include <algorithm>
+#include <cmath>
+
+Timeline::Timeline(uint32_t channels, uint32_t sampleRate, size_t capacity) :
+        channels(channels),
+        sampleRate(sampleRate),
+        capacity(capacity),
+        incoming(capacity),
+        finished(capacity) {
+    pending.reserve(capacity);
+    active.reserve(capacity);
+}
+
+bool Timeline::schedule(std::unique_ptr<TimelineEvent> event) {
+    // At most `capacity` events are in flight, so neither queue can overflow and `active` never reallocates
+    if (pending.size() >= capacity) {
+        return false;
+    }
+
+    pending.push_back(std::move(event));
+    incoming.push(pending.back().get());
+    return true;
+}
+
+void Timeline::collect() {
+    TimelineEvent *event;
+    while (finished.pop(event)) {
+        auto found = std::find_if(pending.begin(), pending.end(), [event](const auto &owned) { return owned.get() == event; });
+        if (found != pending.end()) {
+            std::swap(*found, pending.back());
+            pending.pop_back();
+        }
+    }
+}
+
+void Timeline::clear() {
+    TimelineEvent *event;
+    while (incoming.pop(event)) {}
+    while (finished.pop(event)) {}
+    active.clear();
+    pending.clear();
+}
+
+size_t Timeline::pendingEvents() const {
+    return pending.size();
+}
+
+uint64_t Timeline::late() const {
+    return lateEvents.load(std::memory_order_relaxed);
+}
+
+void Timeline::mix(float *output, uint64_t frames, uint64_t position, double outputTime) {
+    TimelineEvent *arrived;
+    while (incoming.pop(arrived)) {
+        if (arrived->timed) {
+            auto offset = static_cast<int64_t>(std::llround((arrived->time - outputTime) * sampleRate));
+            arrived->frame = offset >= 0 ? position + offset : position - std::min<uint64_t>(position, -offset);
+        }
+        active.push_back(arrived);
+    }
+
+    uint64_t end = position + frames;
+    for (size_t i = 0; i < active.size();) {
+        auto *event = active[i];
+        uint64_t eventEnd = event->frame + event->samples.size() / channels;
+
+        if (event->frame >= end) {
+            ++i;
+            continue;
+        }
+
+        uint64_t from = std::max(event->frame, position);
+        if (!event->started && event->frame < position) {
+            lateEvents.fetch_add(1, std::memory_order_relaxed);
+        }
+        event->started = true;
+
+        if (from < eventEnd) {
+            const float *source = event->samples.data() + (from - event->frame) * channels;
+            float *destination = output + (from - position) * channels;
+            uint64_t count = (std::min(end, eventEnd) - from) * channels;
+            for (uint64_t s = 0; s < count; ++s) destination[s] += source[s];
+        }
+
+        if (eventEnd <= end) {
+            finished.push(event);
+            active[i] = active.back();
+            active.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
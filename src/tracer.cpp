@@ -0,0 +1,130 @@
+#include "tracer.h"
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include "exception.h"
+
+namespace {
+    std::mutex &registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::vector<std::shared_ptr<TraceRing>> &registry() {
+        static std::vector<std::shared_ptr<TraceRing>> rings;
+        return rings;
+    }
+
+    // Rings of exited threads, so thread turnover reuses them instead of growing the registry
+    std::vector<std::shared_ptr<TraceRing>> &freeRings() {
+        static std::vector<std::shared_ptr<TraceRing>> rings;
+        return rings;
+    }
+
+    uint32_t lastThreadId = 0;
+
+    // Chrome trace timestamps are microseconds, written here with nanosecond precision
+    void writeMicros(std::ostream &output, uint64_t nanos) {
+        char fraction[4] = {
+                static_cast<char>('0' + nanos % 1000 / 100),
+                static_cast<char>('0' + nanos % 100 / 10),
+                static_cast<char>('0' + nanos % 10),
+                '\0'
+        };
+        output << nanos / 1000 << '.' << fraction;
+    }
+}
+
+Tracer::ThreadRing::ThreadRing() : ring(registerThread()) {}
+
+Tracer::ThreadRing::~ThreadRing() {
+    releaseThread(std::move(ring));
+}
+
+std::shared_ptr<TraceRing> Tracer::registerThread() {
+    std::unique_lock<std::mutex> lock(registryMutex());
+
+    uint32_t threadId = ++lastThreadId;
+
+    if (!freeRings().empty()) {
+        // The previous owner's events go with it, the new thread's get their own track
+        auto ring = std::move(freeRings().back());
+        freeRings().pop_back();
+        ring->tail.store(ring->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ring->threadId.store(threadId, std::memory_order_relaxed);
+        return ring;
+    }
+
+    auto ring = std::make_shared<TraceRing>(threadId);
+
+    registry().push_back(ring);
+
+    return ring;
+}
+
+void Tracer::releaseThread(std::shared_ptr<TraceRing> ring) {
+    std::unique_lock<std::mutex> lock(registryMutex());
+
+    // Stays registered, so its events are still dumped until another thread takes it over
+    freeRings().push_back(std::move(ring));
+}
+
+void Tracer::dumpChromeTrace(std::ostream &output) {
+    std::vector<std::shared_ptr<TraceRing>> rings;
+    {
+        std::unique_lock<std::mutex> lock(registryMutex());
+        rings = registry();
+    }
+
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool first = true;
+    std::vector<TraceEvent> events;
+    for (const auto &ring: rings) {
+        uint32_t threadId = ring->threadId.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = std::max(ring->tail.load(std::memory_order_relaxed), head > TraceRing::capacity ? head - TraceRing::capacity : 0);
+
+        events.clear();
+        for (uint64_t i = begin; i < head; ++i) {
+            events.push_back(ring->events[i & (TraceRing::capacity - 1)]);
+        }
+
+        // The owning thread may have overwritten the oldest entries while we were copying
+        uint64_t headAfter = ring->head.load(std::memory_order_acquire);
+        uint64_t overwritten = headAfter > TraceRing::capacity + begin ? headAfter - TraceRing::capacity - begin : 0;
+
+        for (size_t i = std::min<uint64_t>(overwritten, events.size()); i < events.size(); ++i) {
+            const TraceEvent &event = events[i];
+            if (!first) output << ',';
+            first = false;
+            output << "{\"name\":\"" << profileStageName(static_cast<ProfileStage>(event.stage))
+                   << "\",\"cat\":\"klarity\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+                   << ",\"ts\":";
+            writeMicros(output, event.startNanos);
+            output << ",\"dur\":";
+            writeMicros(output, event.durationNanos);
+            output << '}';
+        }
+    }
+
+    output << "]}";
+}
+
+void Tracer::dumpChromeTrace(const std::string &path) {
+    std::ofstream output(path);
+    if (!output) {
+        throw SamplerException("Unable to open trace file: " + path);
+    }
+
+    dumpChromeTrace(output);
+}
+
+void Tracer::clear() {
+    std::unique_lock<std::mutex> lock(registryMutex());
+
+    for (const auto &ring: registry()) {
+        ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}